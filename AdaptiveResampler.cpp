@@ -0,0 +1,158 @@
+// AdaptiveResampler.cpp
+#include "AdaptiveResampler.h"
+#include "AudioConverter.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define ADAPTIVE_RESAMPLER_SSE 1
+#include <xmmintrin.h>
+#endif
+
+namespace {
+const double kPi = 3.14159265358979323846;
+// Highest ratio correction Configure() sizes the input buffer for.
+const double kMaxCorrection = 0.002;
+}
+
+bool AdaptiveResampler::Configure(size_t channels, int input_rate, int output_rate, size_t max_output_frames) {
+    if (channels == 0 || input_rate <= 0 || output_rate <= 0 || max_output_frames == 0) {
+        return false;
+    }
+    channels_ = channels;
+    input_rate_ = input_rate;
+    output_rate_ = output_rate;
+    nominal_step_ = static_cast<double>(input_rate) / output_rate;
+    step_ = nominal_step_;
+    position_ = 0.0;
+    max_input_frames_ = static_cast<size_t>(std::ceil(max_output_frames * nominal_step_ * (1.0 + kMaxCorrection))) + 2;
+
+    BuildFilter();
+    coefficients_.assign(kTaps, 0.0f);
+    work_.assign(channels, std::vector<float>(kTaps + max_input_frames_, 0.0f));
+    output_.assign(max_output_frames * channels, 0.0f);
+    return true;
+}
+
+void AdaptiveResampler::BuildFilter() {
+    // Blackman-windowed sinc. When downsampling the cutoff follows the output
+    // Nyquist; a little headroom keeps the transition band out of the audio.
+    const double cutoff = 0.5 * std::min(1.0, 1.0 / nominal_step_) * 0.92;
+    const double half = kTaps / 2.0;
+    filter_.assign(static_cast<size_t>(kPhases + 1) * kTaps, 0.0f);
+    for (int phase = 0; phase <= kPhases; ++phase) {
+        const double fraction = static_cast<double>(phase) / kPhases;
+        float* row = &filter_[static_cast<size_t>(phase) * kTaps];
+        double sum = 0.0;
+        for (int k = 0; k < kTaps; ++k) {
+            // Tap k sits at this distance from the output instant.
+            const double d = k - (half - 1.0) - fraction;
+            const double x = 2.0 * cutoff * d;
+            const double sinc = x == 0.0 ? 1.0 : std::sin(kPi * x) / (kPi * x);
+            const double w = std::abs(d) >= half ? 0.0
+                : 0.42 + 0.5 * std::cos(kPi * d / half) + 0.08 * std::cos(2.0 * kPi * d / half);
+            row[k] = static_cast<float>(sinc * w);
+            sum += row[k];
+        }
+        // Unity DC gain for every phase, otherwise the ratio wobble would
+        // modulate the level.
+        for (int k = 0; k < kTaps; ++k) {
+            row[k] = static_cast<float>(row[k] / sum);
+        }
+    }
+}
+
+void AdaptiveResampler::SetRatioCorrection(double ppm) {
+    const double correction = std::clamp(ppm * 1e-6, -kMaxCorrection, kMaxCorrection);
+    step_ = nominal_step_ * (1.0 + correction);
+}
+
+size_t AdaptiveResampler::InputFramesNeeded(size_t output_frames) const {
+    return static_cast<size_t>(position_ + output_frames * step_);
+}
+
+float AdaptiveResampler::Dot(const float* samples, const float* coefficients) const {
+#ifdef ADAPTIVE_RESAMPLER_SSE
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (int k = 0; k < kTaps; k += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(samples + k), _mm_loadu_ps(coefficients + k)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(samples + k + 4), _mm_loadu_ps(coefficients + k + 4)));
+    }
+    acc0 = _mm_add_ps(acc0, acc1);
+    acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+    acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+    return _mm_cvtss_f32(acc0);
+#else
+    float acc = 0.0f;
+    for (int k = 0; k < kTaps; ++k) {
+        acc += samples[k] * coefficients[k];
+    }
+    return acc;
+#endif
+}
+
+void AdaptiveResampler::Process(const int16_t* in, size_t input_frames, int16_t* out, size_t output_frames) {
+    input_frames = std::min(input_frames, max_input_frames_);
+    output_frames = std::min(output_frames, output_.size() / channels_);
+
+    // Append the new input behind kTaps frames of history.
+    for (size_t c = 0; c < channels_; ++c) {
+        float* dst = work_[c].data() + kTaps;
+        for (size_t i = 0; i < input_frames; ++i) {
+            dst[i] = in[i * channels_ + c] * (1.0f / 32768.0f);
+        }
+    }
+
+    for (size_t j = 0; j < output_frames; ++j) {
+        const size_t index = static_cast<size_t>(position_);
+        const double phase = (position_ - index) * kPhases;
+        const int p = std::min(static_cast<int>(phase), kPhases - 1);
+        const float blend = static_cast<float>(phase - p);
+        const float* lower = &filter_[static_cast<size_t>(p) * kTaps];
+        const float* upper = lower + kTaps;
+        for (int k = 0; k < kTaps; ++k) {
+            coefficients_[k] = lower[k] + blend * (upper[k] - lower[k]);
+        }
+        // InputFramesNeeded() guarantees index <= input_frames, so the
+        // window never reaches past the newest input frame.
+        for (size_t c = 0; c < channels_; ++c) {
+            output_[j * channels_ + c] = Dot(work_[c].data() + index, coefficients_.data());
+        }
+        position_ += step_;
+    }
+
+    // Drop the consumed frames, keeping the newest kTaps as history.
+    for (size_t c = 0; c < channels_; ++c) {
+        float* data = work_[c].data();
+        std::copy(data + input_frames, data + input_frames + kTaps, data);
+    }
+    position_ -= static_cast<double>(input_frames);
+    if (position_ < 0.0) {
+        position_ = 0.0;
+    }
+
+    audio_convert::FloatToS16(output_.data(), out, output_frames * channels_);
+}
+
+void DriftEstimator::Reset(double target_ms) {
+    metrics_ = Metrics();
+    metrics_.target_ms = target_ms;
+    first_sample_ = true;
+}
+
+double DriftEstimator::Update(double fill_ms) {
+    if (first_sample_) {
+        metrics_.fill_ms = fill_ms;
+        first_sample_ = false;
+    }
+    else {
+        metrics_.fill_ms += kSmoothing * (fill_ms - metrics_.fill_ms);
+    }
+    const double error_ms = metrics_.fill_ms - metrics_.target_ms;
+    metrics_.drift_ppm = std::clamp(metrics_.drift_ppm + kIntegralPpmPerMsTick * error_ms,
+        -kMaxCorrectionPpm, kMaxCorrectionPpm);
+    metrics_.correction_ppm = std::clamp(kProportionalPpmPerMs * error_ms + metrics_.drift_ppm,
+        -kMaxCorrectionPpm, kMaxCorrectionPpm);
+    return metrics_.correction_ppm;
+}
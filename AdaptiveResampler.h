@@ -0,0 +1,92 @@
+// AdaptiveResampler.h
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Polyphase windowed-sinc resampler for interleaved int16 audio whose ratio
+// can be nudged by a few hundred ppm between calls without clicks. Used to
+// convert the device rate to 48 kHz and to absorb clock drift between the
+// capture device and the consumer. All buffers are sized in Configure().
+class AdaptiveResampler {
+public:
+    bool Configure(size_t channels, int input_rate, int output_rate, size_t max_output_frames);
+
+    // Scales the nominal input/output ratio by (1 + ppm * 1e-6). Positive
+    // values consume input faster.
+    void SetRatioCorrection(double ppm);
+
+    // Input frames the next Process() call must be given to produce
+    // `output_frames`. Depends on the current phase and ratio.
+    size_t InputFramesNeeded(size_t output_frames) const;
+
+    // Consumes exactly InputFramesNeeded(output_frames) frames from `in` and
+    // writes `output_frames` frames to `out`.
+    void Process(const int16_t* in, size_t input_frames, int16_t* out, size_t output_frames);
+
+    // How far, in input frames, the next output frame lags the first input
+    // frame of the next Process() call. Callers timestamping output subtract
+    // this from the input's capture time.
+    double LatencyFrames() const { return kTaps / 2 + 1 - position_; }
+
+    int InputRate() const { return input_rate_; }
+    int OutputRate() const { return output_rate_; }
+
+private:
+    static constexpr int kTaps = 32;      // Per phase; multiple of 4 for SSE
+    static constexpr int kPhases = 128;   // Linearly interpolated between
+
+    void BuildFilter();
+    float Dot(const float* samples, const float* coefficients) const;
+
+    size_t channels_ = 0;
+    int input_rate_ = 0;
+    int output_rate_ = 0;
+    size_t max_input_frames_ = 0;
+    double nominal_step_ = 1.0;
+    double step_ = 1.0;
+    double position_ = 0.0;  // Next output's position within work_, in frames
+
+    // (kPhases + 1) x kTaps coefficients; the extra row makes phase + 1
+    // interpolation branch-free.
+    std::vector<float> filter_;
+    std::vector<float> coefficients_;  // Interpolated row for one output frame
+    // Planar per channel: kTaps frames of history followed by new input.
+    std::vector<std::vector<float>> work_;
+    std::vector<float> output_;        // Interleaved float output
+};
+
+// Turns the consumer-side fill level of the capture ring into a ratio
+// correction for AdaptiveResampler with a PI controller, so the buffered
+// latency settles on the target. The integral term converges on the clock
+// drift between the device and the consumer.
+class DriftEstimator {
+public:
+    struct Metrics {
+        double drift_ppm = 0.0;       // Integral term: estimated clock drift
+        double correction_ppm = 0.0;  // Ratio correction currently applied
+        double fill_ms = 0.0;         // Smoothed buffered audio
+        double target_ms = 0.0;
+    };
+
+    void Reset(double target_ms);
+    // Moves the set point without disturbing the drift estimate.
+    void SetTarget(double target_ms) { metrics_.target_ms = target_ms; }
+
+    // Feeds one fill-level sample (taken once per 10 ms tick) and returns the
+    // ratio correction to apply, in ppm.
+    double Update(double fill_ms);
+
+    const Metrics& GetMetrics() const { return metrics_; }
+
+private:
+    static constexpr double kSmoothing = 0.01;        // EMA weight, ~1 s time constant
+    // Near-critically damped against the ~1 s smoothing: a 10 ms error
+    // corrects at 500 ppm and the integral time is about 70 s.
+    static constexpr double kProportionalPpmPerMs = 50.0;
+    static constexpr double kIntegralPpmPerMsTick = 0.007;
+    static constexpr double kMaxCorrectionPpm = 1000.0;
+
+    Metrics metrics_;
+    bool first_sample_ = true;
+};
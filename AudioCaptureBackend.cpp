@@ -0,0 +1,87 @@
+// AudioCaptureBackend.cpp
+#include "AudioCaptureBackend.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+int64_t PacedAudioCapture::SteadyMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+PacedAudioCapture::PacedAudioCapture(const AudioFormat& format, const Pacing& pacing)
+    : format_(format), pacing_(pacing) {
+    packet_.assign(PacketFrames() * format_.number_of_channels, 0);
+}
+
+size_t PacedAudioCapture::PacketFrames() const {
+    return std::max<size_t>(1, static_cast<size_t>(format_.sample_rate) * std::max(pacing_.packet_ms, 1) / 1000);
+}
+
+void PacedAudioCapture::StartStream() {
+    std::lock_guard<std::mutex> lock(started_mutex_);
+    if (start_count_++ == 0) {
+        produced_ = 0;
+        ended_ = false;
+        start_us_ = pacing_.now_us();
+        started_ = true;
+    }
+}
+
+void PacedAudioCapture::StopStream() {
+    std::lock_guard<std::mutex> lock(started_mutex_);
+    if (start_count_ == 0 || --start_count_ > 0) {
+        return;
+    }
+    started_ = false;
+}
+
+bool PacedAudioCapture::WaitForPacket(uint32_t timeout_ms) {
+    if (!pacing_.realtime || !started_) {
+        return started_;
+    }
+    const int64_t due_us = start_us_ + static_cast<int64_t>(
+        (produced_ + PacketFrames()) * 1000000 / static_cast<uint64_t>(format_.sample_rate));
+    const int64_t wait_us = std::min<int64_t>(due_us - pacing_.now_us(), static_cast<int64_t>(timeout_ms) * 1000);
+    if (wait_us > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(wait_us));
+    }
+    return pacing_.now_us() >= due_us;
+}
+
+size_t PacedAudioCapture::ReadPackets(SpscRingBuffer<uint8_t>* ring, SpscRingBuffer<AudioTimestampAnchor>* anchors) {
+    if (!started_ || ended_) {
+        return 0;
+    }
+    const size_t frame_bytes = format_.BytesPerFrame();
+    const size_t packet_frames = PacketFrames();
+    const uint64_t rate = static_cast<uint64_t>(format_.sample_rate);
+    const uint64_t due = pacing_.realtime
+        ? static_cast<uint64_t>(std::max<int64_t>(pacing_.now_us() - start_us_, 0)) * rate / 1000000
+        : UINT64_MAX;
+    size_t written_frames = 0;
+    uint64_t produced = produced_;
+    while (due - produced >= packet_frames && !ended_) {
+        const size_t room = ring->WriteAvailable() / frame_bytes;
+        if (!pacing_.realtime && room < packet_frames) {
+            break;  // Back-pressure: wait for the consumer
+        }
+        const size_t frames = Produce(packet_.data(), packet_frames);
+        if (frames < packet_frames) {
+            ended_ = true;
+        }
+        if (anchors && frames > 0 && room > 0) {
+            AudioTimestampAnchor anchor;
+            anchor.frame = ring->TotalWritten() / frame_bytes;
+            anchor.capture_time_us = start_us_ + static_cast<int64_t>(produced * 1000000 / rate);
+            anchors->Write(&anchor, 1);
+        }
+        // Like a device, a real-time packet that does not fit is dropped
+        // rather than delayed.
+        written_frames += ring->Write(reinterpret_cast<const uint8_t*>(packet_.data()),
+            std::min(frames, room) * frame_bytes) / frame_bytes;
+        produced += frames;
+    }
+    produced_ = produced;
+    return written_frames;
+}
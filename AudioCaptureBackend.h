@@ -0,0 +1,91 @@
+// AudioCaptureBackend.h
+#pragma once
+#include "AudioData.h"
+#include "SpscRingBuffer.h"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Producer side of the audio capture path: an endpoint that yields 16-bit
+// interleaved PCM on its own clock. AudioCaptureSource runs one thread over
+// its backends, waiting for packets and moving them into per-endpoint rings
+// for the AudioPump. AudioStreamCapture (WASAPI) is the production backend;
+// SyntheticAudioCapture and FileAudioCapture run the same pipeline headless.
+class AudioCaptureBackend {
+public:
+    virtual ~AudioCaptureBackend() = default;
+
+    // Calls are counted: the stream stops with the last StopStream().
+    virtual void StartStream() = 0;
+    virtual void StopStream() = 0;
+    virtual bool Started() = 0;
+
+    // Format of the samples ReadPackets() produces; always 16-bit PCM.
+    virtual AudioFormat Format() const = 0;
+
+    // Blocks until a packet may be ready or `timeout_ms` passes. Returns
+    // false on timeout; callers should drain either way.
+    virtual bool WaitForPacket(uint32_t timeout_ms) = 0;
+    // Native handle signalled per packet (a Win32 event), so a caller can
+    // wait on several backends at once; null if the backend has none.
+    virtual void* PacketEvent() const { return nullptr; }
+
+    // Moves every packet that is ready into `ring` and returns the number
+    // of frames written. When `anchors` is given, packets with a known
+    // capture instant also push it there.
+    virtual size_t ReadPackets(SpscRingBuffer<uint8_t>* ring,
+        SpscRingBuffer<AudioTimestampAnchor>* anchors = nullptr) = 0;
+};
+
+// Base for backends that generate their own packets instead of waiting on
+// a device: packets of `packet_ms` become due as the clock advances, like a
+// device period. Without real-time pacing they are produced as fast as the
+// ring drains and stamped on a virtual clock that starts at StartStream().
+class PacedAudioCapture : public AudioCaptureBackend {
+public:
+    // Microseconds on the clock anchors are stamped with; AudioCaptureSource
+    // needs rtc::TimeMicros, the benchmarks use SteadyMicros.
+    using Clock = int64_t (*)();
+
+    struct Pacing {
+        bool realtime = true;
+        int packet_ms = 10;
+        Clock now_us = &PacedAudioCapture::SteadyMicros;
+    };
+
+    void StartStream() override;
+    void StopStream() override;
+    bool Started() override { return started_; }
+    AudioFormat Format() const override { return format_; }
+    bool WaitForPacket(uint32_t timeout_ms) override;
+    size_t ReadPackets(SpscRingBuffer<uint8_t>* ring,
+        SpscRingBuffer<AudioTimestampAnchor>* anchors = nullptr) override;
+
+    // True once a finite source has nothing left to give.
+    bool Ended() const { return ended_; }
+    uint64_t FramesProduced() const { return produced_; }
+
+    static int64_t SteadyMicros();
+
+protected:
+    PacedAudioCapture(const AudioFormat& format, const Pacing& pacing);
+
+    // Fills `out` with up to `frames` frames in Format(). Returning fewer
+    // ends the stream. Runs on the capture thread only.
+    virtual size_t Produce(int16_t* out, size_t frames) = 0;
+
+private:
+    size_t PacketFrames() const;
+
+    const AudioFormat format_;
+    const Pacing pacing_;
+    std::mutex started_mutex_;
+    int start_count_ = 0;
+    std::atomic<bool> started_ = false;
+    // Capture thread state, reset by the first StartStream().
+    std::atomic<int64_t> start_us_ = 0;
+    std::atomic<uint64_t> produced_ = 0;
+    std::atomic<bool> ended_ = false;
+    std::vector<int16_t> packet_;
+};
@@ -0,0 +1,221 @@
+// AudioConverter.cpp
+#include "AudioConverter.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define AUDIO_CONVERT_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace audio_convert {
+
+void FloatToS16Scalar(const float* in, int16_t* out, size_t samples) {
+    for (size_t i = 0; i < samples; ++i) {
+        const float scaled = std::clamp(in[i], -1.0f, 1.0f) * 32768.0f;
+        out[i] = static_cast<int16_t>(std::clamp(std::lrintf(scaled), -32768L, 32767L));
+    }
+}
+
+void S32ToS16Scalar(const int32_t* in, int16_t* out, size_t samples) {
+    for (size_t i = 0; i < samples; ++i) {
+        out[i] = static_cast<int16_t>(in[i] >> 16);
+    }
+}
+
+void MonoToStereoScalar(const int16_t* in, int16_t* out, size_t frames) {
+    for (size_t i = 0; i < frames; ++i) {
+        out[2 * i] = in[i];
+        out[2 * i + 1] = in[i];
+    }
+}
+
+void StereoToMonoScalar(const int16_t* in, int16_t* out, size_t frames) {
+    for (size_t i = 0; i < frames; ++i) {
+        out[i] = static_cast<int16_t>((in[2 * i] + in[2 * i + 1]) >> 1);
+    }
+}
+
+void AccumulateS16Scalar(const int16_t* in, float gain, float* acc, size_t samples) {
+    const float scale = gain * (1.0f / 32768.0f);
+    for (size_t i = 0; i < samples; ++i) {
+        acc[i] += in[i] * scale;
+    }
+}
+
+#ifdef AUDIO_CONVERT_SSE2
+
+void FloatToS16(const float* in, int16_t* out, size_t samples) {
+    const __m128 lo = _mm_set1_ps(-1.0f);
+    const __m128 hi = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(32768.0f);
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        // Clamp first: cvtps maps out-of-range values to INT_MIN. 1.0 scales
+        // to 32768, which the saturating pack turns into 32767.
+        __m128 a = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i), lo), hi), scale);
+        __m128 b = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i + 4), lo), hi), scale);
+        __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+    }
+    FloatToS16Scalar(in + i, out + i, samples - i);
+}
+
+void S32ToS16(const int32_t* in, int16_t* out, size_t samples) {
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        __m128i a = _mm_srai_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), 16);
+        __m128i b = _mm_srai_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 4)), 16);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(a, b));
+    }
+    S32ToS16Scalar(in + i, out + i, samples - i);
+}
+
+void MonoToStereo(const int16_t* in, int16_t* out, size_t frames) {
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        __m128i mono = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), _mm_unpacklo_epi16(mono, mono));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i + 8), _mm_unpackhi_epi16(mono, mono));
+    }
+    MonoToStereoScalar(in + i, out + 2 * i, frames - i);
+}
+
+void StereoToMono(const int16_t* in, int16_t* out, size_t frames) {
+    const __m128i ones = _mm_set1_epi16(1);
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        // madd sums each L/R pair into 32 bits, so the average cannot overflow.
+        __m128i a = _mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i)), ones);
+        __m128i b = _mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i + 8)), ones);
+        __m128i packed = _mm_packs_epi32(_mm_srai_epi32(a, 1), _mm_srai_epi32(b, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+    }
+    StereoToMonoScalar(in + 2 * i, out + i, frames - i);
+}
+
+void AccumulateS16(const int16_t* in, float gain, float* acc, size_t samples) {
+    const __m128 scale = _mm_set1_ps(gain * (1.0f / 32768.0f));
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        // Sign-extend by unpacking into the high halves, then shift down.
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        const __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+        const __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+        _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(lo, scale)));
+        _mm_storeu_ps(acc + i + 4, _mm_add_ps(_mm_loadu_ps(acc + i + 4), _mm_mul_ps(hi, scale)));
+    }
+    AccumulateS16Scalar(in + i, gain, acc + i, samples - i);
+}
+
+#else
+
+void FloatToS16(const float* in, int16_t* out, size_t samples) { FloatToS16Scalar(in, out, samples); }
+void S32ToS16(const int32_t* in, int16_t* out, size_t samples) { S32ToS16Scalar(in, out, samples); }
+void MonoToStereo(const int16_t* in, int16_t* out, size_t frames) { MonoToStereoScalar(in, out, frames); }
+void StereoToMono(const int16_t* in, int16_t* out, size_t frames) { StereoToMonoScalar(in, out, frames); }
+void AccumulateS16(const int16_t* in, float gain, float* acc, size_t samples) { AccumulateS16Scalar(in, gain, acc, samples); }
+
+#endif
+
+void DownmixToStereo(const int16_t* in, size_t channels, int16_t* out, size_t frames) {
+    // Per-channel (left, right) gains in WAVE speaker order.
+    static const float kGains[8][2] = {
+        { 1.0f, 0.0f },      // FL
+        { 0.0f, 1.0f },      // FR
+        { 0.707f, 0.707f },  // FC
+        { 0.0f, 0.0f },      // LFE
+        { 0.707f, 0.0f },    // BL
+        { 0.0f, 0.707f },    // BR
+        { 0.707f, 0.0f },    // SL
+        { 0.0f, 0.707f },    // SR
+    };
+    const size_t mapped = std::min<size_t>(channels, 8);
+    float norm = 0.0f;
+    for (size_t c = 0; c < mapped; ++c) {
+        norm += kGains[c][0];
+    }
+    const float scale = norm > 1.0f ? 1.0f / norm : 1.0f;
+    for (size_t i = 0; i < frames; ++i) {
+        const int16_t* frame = in + i * channels;
+        float left = 0.0f;
+        float right = 0.0f;
+        for (size_t c = 0; c < mapped; ++c) {
+            left += frame[c] * kGains[c][0];
+            right += frame[c] * kGains[c][1];
+        }
+        out[2 * i] = static_cast<int16_t>(std::clamp(left * scale, -32768.0f, 32767.0f));
+        out[2 * i + 1] = static_cast<int16_t>(std::clamp(right * scale, -32768.0f, 32767.0f));
+    }
+}
+
+} // namespace audio_convert
+
+bool AudioConverter::Configure(const DeviceFormat& input, size_t output_channels, size_t max_frames) {
+    if (input.number_of_channels == 0 || input.sample_rate <= 0 ||
+        (output_channels != 1 && output_channels != 2)) {
+        return false;
+    }
+    input_ = input;
+    output_channels_ = output_channels;
+    max_frames_ = max_frames;
+    scratch_.assign(max_frames * input.number_of_channels, 0);
+    return true;
+}
+
+AudioFormat AudioConverter::OutputFormat() const {
+    AudioFormat format;
+    format.bits_per_sample = 16;
+    format.sample_rate = input_.sample_rate;
+    format.number_of_channels = output_channels_;
+    return format;
+}
+
+size_t AudioConverter::Convert(const void* in, size_t frames, int16_t* out) {
+    frames = std::min(frames, max_frames_);
+    const size_t channels = input_.number_of_channels;
+    const size_t samples = frames * channels;
+
+    // Step 1: sample format. Skip the scratch pass when the layout already
+    // matches so the common case is a single conversion.
+    const bool direct = channels == output_channels_;
+    int16_t* converted = direct ? out : scratch_.data();
+    const int16_t* s16 = converted;
+    switch (input_.sample_type) {
+    case SampleType::kInt16:
+        if (direct) {
+            std::copy_n(static_cast<const int16_t*>(in), samples, out);
+        }
+        s16 = static_cast<const int16_t*>(in);
+        break;
+    case SampleType::kInt32:
+        audio_convert::S32ToS16(static_cast<const int32_t*>(in), converted, samples);
+        break;
+    case SampleType::kFloat32:
+        audio_convert::FloatToS16(static_cast<const float*>(in), converted, samples);
+        break;
+    }
+    if (direct) {
+        return frames;
+    }
+
+    // Step 2: channel layout.
+    if (output_channels_ == 2) {
+        if (channels == 1) {
+            audio_convert::MonoToStereo(s16, out, frames);
+        }
+        else {
+            audio_convert::DownmixToStereo(s16, channels, out, frames);
+        }
+    }
+    else if (channels == 2) {
+        audio_convert::StereoToMono(s16, out, frames);
+    }
+    else {
+        // N > 2 to mono: fold to stereo in the scratch buffer (the write
+        // position never overtakes the read position), then average.
+        audio_convert::DownmixToStereo(s16, channels, scratch_.data(), frames);
+        audio_convert::StereoToMono(scratch_.data(), out, frames);
+    }
+    return frames;
+}
@@ -0,0 +1,80 @@
+// AudioConverter.h
+#pragma once
+#include "AudioData.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Sample encodings a shared-mode capture endpoint can hand us.
+enum class SampleType {
+    kInt16,    // 16-bit PCM
+    kInt32,    // 32-bit container, PCM left-justified (covers 24-in-32)
+    kFloat32   // IEEE float, nominal range [-1, 1]
+};
+
+struct DeviceFormat {
+    SampleType sample_type = SampleType::kInt16;
+    int sample_rate = 0;
+    size_t number_of_channels = 0;
+
+    size_t BytesPerFrame() const {
+        return (sample_type == SampleType::kInt16 ? 2 : 4) * number_of_channels;
+    }
+};
+
+// Sample-format and channel-layout kernels. The unsuffixed versions use SSE2
+// on x64 (always available there) and fall back to the *Scalar versions on
+// other targets; the scalar versions are exported for benchmarking.
+namespace audio_convert {
+
+// Float to int16 with saturation; out-of-range input clips instead of wrapping.
+void FloatToS16(const float* in, int16_t* out, size_t samples);
+void FloatToS16Scalar(const float* in, int16_t* out, size_t samples);
+
+// Keeps the top 16 bits of each 32-bit sample (24-in-32 and 32-bit PCM).
+void S32ToS16(const int32_t* in, int16_t* out, size_t samples);
+void S32ToS16Scalar(const int32_t* in, int16_t* out, size_t samples);
+
+// Duplicates a mono channel into interleaved stereo.
+void MonoToStereo(const int16_t* in, int16_t* out, size_t frames);
+void MonoToStereoScalar(const int16_t* in, int16_t* out, size_t frames);
+
+// Averages interleaved stereo into mono.
+void StereoToMono(const int16_t* in, int16_t* out, size_t frames);
+void StereoToMonoScalar(const int16_t* in, int16_t* out, size_t frames);
+
+// Mixing: adds int16 `in` scaled by `gain` onto a float accumulator in
+// FloatToS16's nominal range. FloatToS16 then clamps the mix back to int16.
+void AccumulateS16(const int16_t* in, float gain, float* acc, size_t samples);
+void AccumulateS16Scalar(const int16_t* in, float gain, float* acc, size_t samples);
+
+// Folds 3+ interleaved channels into stereo. Channels follow the WAVE
+// speaker order (FL, FR, FC, LFE, BL, BR, SL, SR); centre and surrounds are
+// mixed in at -3 dB, LFE is dropped, and the result is normalised to avoid
+// clipping.
+void DownmixToStereo(const int16_t* in, size_t channels, int16_t* out, size_t frames);
+
+} // namespace audio_convert
+
+// Converts device packets of any supported DeviceFormat into interleaved
+// int16 at the requested channel count (1 or 2), which is what WebRTC sinks
+// consume. Scratch space is sized once in Configure(); Convert() does not
+// allocate.
+class AudioConverter {
+public:
+    // `max_frames` is the largest packet Convert() will be given.
+    bool Configure(const DeviceFormat& input, size_t output_channels, size_t max_frames);
+
+    const DeviceFormat& InputFormat() const { return input_; }
+    AudioFormat OutputFormat() const;
+
+    // Converts `frames` frames from `in` into `out`, which must hold
+    // frames * output channels samples. Returns the number of frames written.
+    size_t Convert(const void* in, size_t frames, int16_t* out);
+
+private:
+    DeviceFormat input_;
+    size_t output_channels_ = 0;
+    size_t max_frames_ = 0;
+    std::vector<int16_t> scratch_;  // int16 at the device channel count
+};
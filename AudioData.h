@@ -1,8 +1,30 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Interleaved PCM layout of a capture stream.
+struct AudioFormat {
+    int bits_per_sample = 0;
+    int sample_rate = 0;
+    size_t number_of_channels = 0;
+
+    size_t BytesPerFrame() const { return (bits_per_sample / 8) * number_of_channels; }
+    // WebRTC consumes audio in 10 ms blocks (480 frames at 48 kHz).
+    size_t FramesPer10Ms() const { return static_cast<size_t>(sample_rate / 100); }
+};
+
+// Ties a frame of a capture stream to the instant the device captured it,
+// on the rtc::TimeMicros() clock. `frame` counts frames written to the
+// stream's ring since it was created.
+struct AudioTimestampAnchor {
+    uint64_t frame = 0;
+    int64_t capture_time_us = 0;
+};
+
 struct AudioData {
     int bits_per_sample;
     int sample_rate;
     size_t number_of_channels;
     size_t number_of_frames;
     const void* audio_data;
-};
\ No newline at end of file
+};
@@ -1,14 +1,27 @@
 //AudioEncoder.cpp
 #include "Encoder.h"
 #include <iostream>
+#include <algorithm>
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavutil/opt.h>
 #include <libavutil/error.h>
+#include <libavutil/audio_fifo.h>
+#include <libavutil/buffer.h>
+#include <libavutil/samplefmt.h>
+#include <libswresample/swresample.h>
+}
+
+namespace {
+// Largest encoded packet we expect; Opus tops out well below this.
+const int kMaxPacketBytes = 4000;
 }
 
 AudioEncoder::AudioEncoder()
-	: sampleRate(44100), channels(2), sampleFormat(AV_SAMPLE_FMT_FLTP) {
+	: sampleRate(48000), channels(2), sampleFormat(AV_SAMPLE_FMT_FLTP),
+	resampler(nullptr), resamplerInRate(0), resamplerInChannels(0), resamplerInFormat(AV_SAMPLE_FMT_NONE),
+	fifo(nullptr), convertBuffer(nullptr), convertCapacity(0),
+	codecFrame(nullptr), codecPacket(nullptr), packetPool(nullptr), nextPts(0) {
 	SetCodecName("opus");
 }
 
@@ -32,15 +45,83 @@ bool AudioEncoder::Open() {
 	codecContext->sample_rate = sampleRate;
 	codecContext->sample_fmt = static_cast<AVSampleFormat>(sampleFormat);
 	av_channel_layout_default(&codecContext->ch_layout, channels);
+	// FFmpeg's native Opus encoder is still flagged experimental.
+	if (codec->capabilities & AV_CODEC_CAP_EXPERIMENTAL) {
+		codecContext->strict_std_compliance = FF_COMPLIANCE_EXPERIMENTAL;
+	}
+	// Serve packet payloads from a pool so steady-state encoding reuses them.
+	if (codec->capabilities & AV_CODEC_CAP_DR1) {
+		packetPool = av_buffer_pool_init(kMaxPacketBytes + AV_INPUT_BUFFER_PADDING_SIZE, nullptr);
+		codecContext->opaque = this;
+		codecContext->get_encode_buffer = &AudioEncoder::GetPacketBuffer;
+	}
 
 	if (int ret = avcodec_open2(codecContext, codec, nullptr); ret < 0) {
 		std::cerr << "Failed to open codec." << std::endl;
+		Close();
+		return false;
+	}
+
+	// Codecs without a fixed frame size take 10 ms per frame.
+	const int frameSize = codecContext->frame_size > 0 ? codecContext->frame_size : sampleRate / 100;
+	codecFrame = av_frame_alloc();
+	codecPacket = av_packet_alloc();
+	fifo = av_audio_fifo_alloc(codecContext->sample_fmt, channels, sampleRate);
+	if (!codecFrame || !codecPacket || !fifo) {
+		std::cerr << "Failed to allocate audio buffers." << std::endl;
+		Close();
+		return false;
+	}
+	codecFrame->nb_samples = frameSize;
+	codecFrame->format = codecContext->sample_fmt;
+	codecFrame->sample_rate = sampleRate;
+	av_channel_layout_copy(&codecFrame->ch_layout, &codecContext->ch_layout);
+	if (av_frame_get_buffer(codecFrame, 0) < 0) {
+		std::cerr << "Failed to allocate audio frame." << std::endl;
+		Close();
 		return false;
 	}
+
+	nextPts = 0;
 	isOpen = true;
 	return true;
 }
 
+bool AudioEncoder::Close() {
+	swr_free(&resampler);
+	resamplerInRate = 0;
+	resamplerInChannels = 0;
+	resamplerInFormat = AV_SAMPLE_FMT_NONE;
+	if (convertBuffer) {
+		av_freep(&convertBuffer[0]);
+		av_freep(&convertBuffer);
+	}
+	convertCapacity = 0;
+	if (fifo) {
+		av_audio_fifo_free(fifo);
+		fifo = nullptr;
+	}
+	av_frame_free(&codecFrame);
+	av_packet_free(&codecPacket);
+	bool closed = Encoder::Close();
+	// The pool is freed once the last outstanding packet is released.
+	av_buffer_pool_uninit(&packetPool);
+	return closed;
+}
+
+int AudioEncoder::GetPacketBuffer(AVCodecContext* context, AVPacket* packet, int flags) {
+	AudioEncoder* self = static_cast<AudioEncoder*>(context->opaque);
+	if (!self->packetPool || packet->size > kMaxPacketBytes) {
+		return avcodec_default_get_encode_buffer(context, packet, flags);
+	}
+	packet->buf = av_buffer_pool_get(self->packetPool);
+	if (!packet->buf) {
+		return AVERROR(ENOMEM);
+	}
+	packet->data = packet->buf->data;
+	return 0;
+}
+
 bool AudioEncoder::EncodeFrame(const AVFrame* frame, AVPacket* packet) {
 	if (!isOpen) {
 		std::cerr << "Encoder is not open." << std::endl;
@@ -61,6 +142,122 @@ bool AudioEncoder::EncodeFrame(const AVFrame* frame, AVPacket* packet) {
 	return true;
 }
 
+bool AudioEncoder::ConfigureResampler(int inRate, int inChannels, int inFormat) {
+	if (resampler && inRate == resamplerInRate && inChannels == resamplerInChannels && inFormat == resamplerInFormat) {
+		return true;
+	}
+
+	// Format change (or first block): rebuild the converter and size the
+	// scratch buffer for the largest chunk we feed it.
+	swr_free(&resampler);
+	AVChannelLayout inLayout;
+	av_channel_layout_default(&inLayout, inChannels);
+	int ret = swr_alloc_set_opts2(&resampler,
+		&codecContext->ch_layout, codecContext->sample_fmt, sampleRate,
+		&inLayout, static_cast<AVSampleFormat>(inFormat), inRate, 0, nullptr);
+	av_channel_layout_uninit(&inLayout);
+	if (ret < 0 || swr_init(resampler) < 0) {
+		std::cerr << "Failed to initialize audio resampler." << std::endl;
+		swr_free(&resampler);
+		return false;
+	}
+
+	const int capacity = static_cast<int>(av_rescale_rnd(kMaxInputChunkFrames, sampleRate, inRate, AV_ROUND_UP)) + 256;
+	if (capacity > convertCapacity) {
+		if (convertBuffer) {
+			av_freep(&convertBuffer[0]);
+			av_freep(&convertBuffer);
+		}
+		if (av_samples_alloc_array_and_samples(&convertBuffer, nullptr, channels, capacity,
+			codecContext->sample_fmt, 0) < 0) {
+			std::cerr << "Failed to allocate conversion buffer." << std::endl;
+			convertCapacity = 0;
+			return false;
+		}
+		convertCapacity = capacity;
+	}
+
+	resamplerInRate = inRate;
+	resamplerInChannels = inChannels;
+	resamplerInFormat = inFormat;
+	return true;
+}
+
+bool AudioEncoder::EncodePcm(const void* data, int bitsPerSample, int inputSampleRate,
+	size_t inputChannels, size_t frames, const PacketCallback& onPacket) {
+	if (!isOpen) {
+		std::cerr << "Encoder is not open." << std::endl;
+		return false;
+	}
+	AVSampleFormat inFormat;
+	if (bitsPerSample == 16) {
+		inFormat = AV_SAMPLE_FMT_S16;
+	}
+	else if (bitsPerSample == 32) {
+		inFormat = AV_SAMPLE_FMT_FLT;
+	}
+	else {
+		std::cerr << "Unsupported PCM sample size: " << bitsPerSample << std::endl;
+		return false;
+	}
+	if (!ConfigureResampler(inputSampleRate, static_cast<int>(inputChannels), inFormat)) {
+		return false;
+	}
+
+	const size_t bytesPerFrame = (bitsPerSample / 8) * inputChannels;
+	const uint8_t* input = static_cast<const uint8_t*>(data);
+	while (frames > 0) {
+		const int chunk = static_cast<int>(std::min<size_t>(frames, kMaxInputChunkFrames));
+		const uint8_t* in[] = { input };
+		int converted = swr_convert(resampler, convertBuffer, convertCapacity, in, chunk);
+		if (converted < 0) {
+			std::cerr << "Failed to convert audio samples." << std::endl;
+			return false;
+		}
+		if (converted > 0 && av_audio_fifo_write(fifo, reinterpret_cast<void**>(convertBuffer), converted) < converted) {
+			std::cerr << "Failed to queue audio samples." << std::endl;
+			return false;
+		}
+		if (!EncodeQueuedFrames(onPacket)) {
+			return false;
+		}
+		input += chunk * bytesPerFrame;
+		frames -= chunk;
+	}
+	return true;
+}
+
+bool AudioEncoder::EncodeQueuedFrames(const PacketCallback& onPacket) {
+	const int frameSize = codecFrame->nb_samples;
+	while (av_audio_fifo_size(fifo) >= frameSize) {
+		// The encoder dropped its reference after the last receive, so this
+		// keeps the buffer allocated in Open().
+		if (av_frame_make_writable(codecFrame) < 0) {
+			return false;
+		}
+		av_audio_fifo_read(fifo, reinterpret_cast<void**>(codecFrame->data), frameSize);
+		codecFrame->pts = nextPts;
+		nextPts += frameSize;
+
+		int ret = avcodec_send_frame(codecContext, codecFrame);
+		if (ret < 0) {
+			std::cerr << "Failed to send frame." << std::endl;
+			return false;
+		}
+		while ((ret = avcodec_receive_packet(codecContext, codecPacket)) == 0) {
+			if (onPacket) {
+				onPacket(codecPacket);
+			}
+			av_packet_unref(codecPacket);
+		}
+		if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+			std::cerr << "Error during encoding" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
 void AudioEncoder::SetSampleRate(int sampleRate) {
 	this->sampleRate = sampleRate;
 }
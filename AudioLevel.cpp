@@ -0,0 +1,104 @@
+// AudioLevel.cpp
+#include "AudioLevel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define AUDIO_LEVEL_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace audio_level {
+
+void MeasureScalar(const int16_t* samples, size_t count, BlockLevel* level) {
+    int peak = 0;
+    uint64_t sum_squares = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const int sample = samples[i];
+        peak = std::max(peak, std::abs(sample));
+        sum_squares += static_cast<uint64_t>(sample * sample);
+    }
+    level->peak = peak;
+    level->sum_squares = sum_squares;
+}
+
+#ifdef AUDIO_LEVEL_SSE2
+
+void Measure(const int16_t* samples, size_t count, BlockLevel* level) {
+    const __m128i zero = _mm_setzero_si128();
+    // Magnitudes are kept as max(x, -x) with saturation, so -32768 reads as
+    // 32767 here; the scalar tail and the final fix-up restore it.
+    __m128i peak = zero;
+    __m128i min = zero;
+    __m128i sum = zero;  // Two 64-bit lanes
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+        peak = _mm_max_epi16(peak, _mm_max_epi16(x, _mm_subs_epi16(zero, x)));
+        min = _mm_min_epi16(min, x);
+        // Each madd lane is a sum of two squares, at most 2^31: it fits as
+        // unsigned 32-bit, so widen with zeros before accumulating.
+        const __m128i squares = _mm_madd_epi16(x, x);
+        sum = _mm_add_epi64(sum, _mm_unpacklo_epi32(squares, zero));
+        sum = _mm_add_epi64(sum, _mm_unpackhi_epi32(squares, zero));
+    }
+    peak = _mm_max_epi16(peak, _mm_srli_si128(peak, 8));
+    peak = _mm_max_epi16(peak, _mm_srli_si128(peak, 4));
+    peak = _mm_max_epi16(peak, _mm_srli_si128(peak, 2));
+    min = _mm_min_epi16(min, _mm_srli_si128(min, 8));
+    min = _mm_min_epi16(min, _mm_srli_si128(min, 4));
+    min = _mm_min_epi16(min, _mm_srli_si128(min, 2));
+    alignas(16) uint64_t lanes[2];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), sum);
+
+    BlockLevel tail;
+    MeasureScalar(samples + i, count - i, &tail);
+    int vector_peak = static_cast<int16_t>(_mm_cvtsi128_si32(peak));
+    if (static_cast<int16_t>(_mm_cvtsi128_si32(min)) == -32768) {
+        vector_peak = 32768;
+    }
+    level->peak = std::max(vector_peak, tail.peak);
+    level->sum_squares = lanes[0] + lanes[1] + tail.sum_squares;
+}
+
+#else
+
+void Measure(const int16_t* samples, size_t count, BlockLevel* level) { MeasureScalar(samples, count, level); }
+
+#endif
+
+double RmsDbfs(const BlockLevel& level, size_t count) {
+    if (count == 0 || level.sum_squares == 0) {
+        return kSilenceDbfs;
+    }
+    const double mean_square = static_cast<double>(level.sum_squares) / count;
+    return std::max(kSilenceDbfs, 10.0 * std::log10(mean_square / (32768.0 * 32768.0)));
+}
+
+} // namespace audio_level
+
+double AudioLevelMeter::Process(const int16_t* samples, size_t count) {
+    BlockLevel block;
+    audio_level::Measure(samples, count, &block);
+    running_peak_ = std::max(running_peak_, std::min(block.peak, 32767));
+    if (++blocks_ >= kUpdateBlocks) {
+        level_.store(running_peak_, std::memory_order_relaxed);
+        running_peak_ = 0;
+        blocks_ = 0;
+    }
+    return audio_level::RmsDbfs(block, count);
+}
+
+bool SilenceGate::Process(double rms_dbfs) {
+    if (!config_.enabled || rms_dbfs >= config_.threshold_dbfs) {
+        silent_ms_ = 0;
+        open_.store(true, std::memory_order_relaxed);
+        return true;
+    }
+    silent_ms_ = std::min(silent_ms_ + 10, config_.hangover_ms);
+    if (silent_ms_ >= config_.hangover_ms) {
+        open_.store(false, std::memory_order_relaxed);
+    }
+    return Open();
+}
@@ -0,0 +1,70 @@
+// AudioLevel.h
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Peak and energy of one block of int16 samples.
+struct BlockLevel {
+    int peak = 0;               // Largest magnitude, 0..32768
+    uint64_t sum_squares = 0;   // Sum of squared samples
+};
+
+// Block measurement kernels. Measure() uses SSE2 on x64 and falls back to
+// MeasureScalar() elsewhere; the scalar version is exported for benchmarking.
+namespace audio_level {
+
+void Measure(const int16_t* samples, size_t count, BlockLevel* level);
+void MeasureScalar(const int16_t* samples, size_t count, BlockLevel* level);
+
+// RMS of `count` samples in dBFS; digital silence maps to kSilenceDbfs.
+double RmsDbfs(const BlockLevel& level, size_t count);
+
+constexpr double kSilenceDbfs = -96.0;
+
+} // namespace audio_level
+
+// Tracks the level of a stream of 10 ms blocks the way WebRTC's own meter
+// does: Level() is the peak magnitude (0..32767) over the last kUpdateBlocks
+// blocks. Process() runs on the audio thread; Level() may be read from any.
+class AudioLevelMeter {
+public:
+    // Measures one interleaved block and returns its RMS in dBFS.
+    double Process(const int16_t* samples, size_t count);
+
+    int Level() const { return level_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr int kUpdateBlocks = 10;
+
+    int running_peak_ = 0;
+    int blocks_ = 0;
+    std::atomic<int> level_ = 0;
+};
+
+// Decides per 10 ms block whether the stream is silent. The gate closes once
+// the block RMS has stayed below the threshold for the hangover time, and
+// reopens on the first block above it, so speech onsets are never clipped.
+class SilenceGate {
+public:
+    struct Config {
+        bool enabled = true;
+        double threshold_dbfs = -70.0;
+        int hangover_ms = 1000;
+    };
+
+    SilenceGate() = default;
+    explicit SilenceGate(const Config& config) : config_(config) {}
+
+    // Feeds one 10 ms block's RMS and returns true if it should be delivered
+    // as captured, false if the gate is closed.
+    bool Process(double rms_dbfs);
+
+    bool Open() const { return open_.load(std::memory_order_relaxed); }
+    const Config& GetConfig() const { return config_; }
+
+private:
+    Config config_;
+    int silent_ms_ = 0;
+    std::atomic<bool> open_ = true;
+};
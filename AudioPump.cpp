@@ -0,0 +1,292 @@
+// AudioPump.cpp
+#include "AudioPump.h"
+#include "AudioConverter.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+AudioPump::AudioPump(BlockCallback on_block) : on_block_(std::move(on_block)) {
+}
+
+AudioPump::~AudioPump() {
+    Stop();
+}
+
+size_t AudioPump::AddInput(SpscRingBuffer<uint8_t>* ring, const AudioFormat& format,
+    SpscRingBuffer<AudioTimestampAnchor>* anchors, float gain) {
+    if (running_ || !ring || format.bits_per_sample != 16 || format.BytesPerFrame() == 0 ||
+        format.FramesPer10Ms() == 0) {
+        return SIZE_MAX;
+    }
+    if (!inputs_.empty() && format.number_of_channels != inputs_.front()->format.number_of_channels) {
+        return SIZE_MAX;
+    }
+    auto input = std::make_unique<Input>();
+    input->ring = ring;
+    input->anchors = anchors;
+    input->format = format;
+    input->gain = gain;
+    const size_t output_frames = kOutputSampleRate / 100;
+    if (!input->resampler.Configure(format.number_of_channels, format.sample_rate, kOutputSampleRate, output_frames)) {
+        return SIZE_MAX;
+    }
+    // Room for the most input one block can need, at the correction limit.
+    input->input_block.assign((format.FramesPer10Ms() * 11 / 10 + 2) * format.number_of_channels, 0);
+    input->output_block.assign(output_frames * format.number_of_channels, 0);
+    inputs_.push_back(std::move(input));
+    return inputs_.size() - 1;
+}
+
+void AudioPump::ClearInputs() {
+    if (!running_) {
+        inputs_.clear();
+    }
+}
+
+void AudioPump::SetInputGain(size_t index, float gain) {
+    if (index < inputs_.size()) {
+        inputs_[index]->gain = gain;
+    }
+}
+
+void AudioPump::Start(SpscRingBuffer<uint8_t>* ring, const AudioFormat& format,
+    SpscRingBuffer<AudioTimestampAnchor>* anchors) {
+    if (running_) {
+        return;
+    }
+    ClearInputs();
+    if (AddInput(ring, format, anchors) == SIZE_MAX) {
+        return;
+    }
+    Start();
+}
+
+void AudioPump::Start() {
+    if (running_ || inputs_.empty()) {
+        return;
+    }
+    output_format_ = inputs_.front()->format;
+    output_format_.sample_rate = kOutputSampleRate;
+    const size_t output_samples = output_format_.FramesPer10Ms() * output_format_.number_of_channels;
+    mix_.assign(output_samples, 0.0f);
+    mixed_block_.assign(output_samples, 0);
+    for (auto& input : inputs_) {
+        input->target_ms = kTargetFillMs;
+        input->drift.Reset(kTargetFillMs);
+        input->primed = false;
+        input->have_anchor = false;
+        input->have_next_anchor = false;
+        input->offset_ms = 0.0;
+    }
+    running_ = true;
+    thread_ = std::thread(&AudioPump::Run, this);
+}
+
+void AudioPump::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        running_ = false;
+    }
+    wake_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+AudioPump::Stats AudioPump::GetStats() const {
+    Stats stats;
+    stats.delivered_blocks = delivered_blocks_;
+    std::lock_guard<std::mutex> lock(metrics_mutex_);
+    for (const auto& input : inputs_) {
+        stats.underruns += input->underruns;
+        stats.dropped_frames += input->dropped_frames;
+    }
+    if (!inputs_.empty()) {
+        stats.drift = inputs_.front()->drift_metrics;
+    }
+    return stats;
+}
+
+AudioPump::InputStats AudioPump::GetInputStats(size_t index) const {
+    InputStats stats;
+    if (index >= inputs_.size()) {
+        return stats;
+    }
+    const Input& input = *inputs_[index];
+    stats.underruns = input.underruns;
+    stats.dropped_frames = input.dropped_frames;
+    std::lock_guard<std::mutex> lock(metrics_mutex_);
+    stats.drift = input.drift_metrics;
+    stats.offset_ms = input.offset_ms;
+    return stats;
+}
+
+void AudioPump::Run() {
+    auto next_tick = std::chrono::steady_clock::now() + kBlockInterval;
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    while (running_) {
+        if (wake_.wait_until(lock, next_tick, [this] { return !running_; })) {
+            break;
+        }
+        lock.unlock();
+        Tick();
+        lock.lock();
+
+        next_tick += kBlockInterval;
+        const auto now = std::chrono::steady_clock::now();
+        if (now - next_tick > kMaxLag) {
+            next_tick = now + kBlockInterval;
+        }
+    }
+}
+
+int64_t AudioPump::BlockCaptureTime(Input* input, uint64_t first_frame) {
+    if (!input->anchors) {
+        return 0;
+    }
+    // Anchors arrive in frame order; advance to the last one not past the
+    // block. Ones for discarded audio are simply skipped over.
+    for (;;) {
+        if (!input->have_next_anchor) {
+            input->have_next_anchor = input->anchors->Read(&input->next_anchor, 1) == 1;
+        }
+        if (!input->have_next_anchor || input->next_anchor.frame > first_frame) {
+            break;
+        }
+        input->anchor = input->next_anchor;
+        input->have_anchor = true;
+        input->have_next_anchor = false;
+    }
+    if (!input->have_anchor) {
+        return 0;
+    }
+    const double frames_since_anchor =
+        static_cast<double>(first_frame - input->anchor.frame) - input->resampler.LatencyFrames();
+    return input->anchor.capture_time_us +
+        static_cast<int64_t>(frames_since_anchor * 1e6 / input->format.sample_rate);
+}
+
+bool AudioPump::PullBlock(Input* input, int64_t* capture_time_us) {
+    const AudioFormat& format = input->format;
+    const size_t frame_bytes = format.BytesPerFrame();
+    const double ms_per_frame = 1000.0 / format.sample_rate;
+    size_t available = input->ring->ReadAvailable() / frame_bytes;
+    if (!input->primed) {
+        if (available * ms_per_frame < input->target_ms) {
+            return false;
+        }
+        input->primed = true;
+    }
+    if (available * ms_per_frame > kMaxBacklogMs) {
+        const size_t excess = available - static_cast<size_t>(input->target_ms / ms_per_frame);
+        input->dropped_frames += input->ring->Discard(excess * frame_bytes) / frame_bytes;
+        available -= excess;
+    }
+
+    // Steer the resampling ratio by how far the fill level sits from the
+    // target, then take exactly the input this block needs.
+    input->resampler.SetRatioCorrection(input->drift.Update(available * ms_per_frame));
+    {
+        std::lock_guard<std::mutex> lock(metrics_mutex_);
+        input->drift_metrics = input->drift.GetMetrics();
+    }
+    const size_t output_frames = output_format_.FramesPer10Ms();
+    const size_t needed = input->resampler.InputFramesNeeded(output_frames);
+    if (available < needed || needed * format.number_of_channels > input->input_block.size()) {
+        // Ran dry: skip this tick and wait for a fresh cushion.
+        ++input->underruns;
+        input->primed = false;
+        return false;
+    }
+
+    *capture_time_us = BlockCaptureTime(input, input->ring->TotalRead() / frame_bytes);
+    input->ring->Read(reinterpret_cast<uint8_t*>(input->input_block.data()), needed * frame_bytes);
+    input->resampler.Process(input->input_block.data(), needed, input->output_block.data(), output_frames);
+    return true;
+}
+
+void AudioPump::SetInputTarget(Input* input, double target_ms, bool immediate) {
+    const double previous_ms = input->target_ms;
+    input->target_ms = std::clamp(target_ms, kMinTargetFillMs, kMaxTargetFillMs);
+    input->drift.SetTarget(input->target_ms);
+    if (!immediate) {
+        return;
+    }
+    // Take the step at once: drop the surplus, or re-prime on a deeper
+    // cushion.
+    if (input->target_ms < previous_ms) {
+        const size_t frame_bytes = input->format.BytesPerFrame();
+        const size_t surplus = static_cast<size_t>((previous_ms - input->target_ms) * input->format.sample_rate / 1000);
+        input->dropped_frames += input->ring->Discard(surplus * frame_bytes) / frame_bytes;
+    }
+    else if (input->target_ms > previous_ms) {
+        input->primed = false;
+    }
+}
+
+void AudioPump::Align(Input* input, double offset_ms) {
+    // Positive offset: this input's audio is older than the reference's, so
+    // it is buffered too long and its set point has to come down. Big steps
+    // (startup, a device change) are taken at once; small residuals are left
+    // to the drift controller.
+    const bool immediate = std::abs(offset_ms) > kCoarseAlignMs;
+    const double desired_ms = input->target_ms - (immediate ? offset_ms : kAlignGain * offset_ms);
+    if (desired_ms < kMinTargetFillMs) {
+        // This endpoint lags by more than the reference's cushion: delay the
+        // reference instead of starving this input.
+        Input* reference = inputs_.front().get();
+        SetInputTarget(reference, reference->target_ms + (kMinTargetFillMs - desired_ms), immediate);
+    }
+    SetInputTarget(input, desired_ms, immediate);
+    std::lock_guard<std::mutex> lock(metrics_mutex_);
+    input->offset_ms = offset_ms;
+}
+
+void AudioPump::Tick() {
+    const size_t output_frames = output_format_.FramesPer10Ms();
+    const size_t samples = mix_.size();
+    Input* const reference = inputs_.front().get();
+    int64_t reference_time_us = 0;
+    int64_t block_time_us = 0;
+    const int16_t* block = nullptr;
+    size_t contributing = 0;
+    for (auto& input : inputs_) {
+        int64_t capture_time_us = 0;
+        if (!PullBlock(input.get(), &capture_time_us)) {
+            continue;
+        }
+        if (block_time_us == 0) {
+            block_time_us = capture_time_us;
+        }
+        if (input.get() == reference) {
+            reference_time_us = capture_time_us;
+        }
+        else if (reference_time_us != 0 && capture_time_us != 0) {
+            Align(input.get(), (reference_time_us - capture_time_us) / 1000.0);
+        }
+
+        const float gain = input->gain.load(std::memory_order_relaxed);
+        if (inputs_.size() == 1 && gain == 1.0f) {
+            // Nothing to mix: hand the resampled block straight through.
+            block = input->output_block.data();
+            ++contributing;
+            break;
+        }
+        if (contributing == 0) {
+            std::fill(mix_.begin(), mix_.end(), 0.0f);
+        }
+        audio_convert::AccumulateS16(input->output_block.data(), gain, mix_.data(), samples);
+        ++contributing;
+    }
+    if (contributing == 0) {
+        return;
+    }
+    if (!block) {
+        audio_convert::FloatToS16(mix_.data(), mixed_block_.data(), samples);
+        block = mixed_block_.data();
+    }
+    ++delivered_blocks_;
+    if (on_block_) {
+        on_block_(block, output_format_, output_frames, block_time_us);
+    }
+}
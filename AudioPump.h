@@ -0,0 +1,149 @@
+// AudioPump.h
+#pragma once
+#include "AdaptiveResampler.h"
+#include "AudioData.h"
+#include "SpscRingBuffer.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Consumer side of the audio capture path. Runs its own thread that wakes
+// every 10 ms and delivers exactly one 10 ms block at 48 kHz, so sinks see a
+// steady cadence regardless of how the device sized its packets. Blocks pass
+// through an AdaptiveResampler whose ratio is steered by the ring fill level,
+// which keeps the buffered latency constant while the device clock drifts
+// against ours. Platform independent: the producer can be WASAPI or a
+// synthetic source. The ring carries 16-bit PCM.
+//
+// Several inputs (e.g. loopback plus a microphone) can be mixed into the one
+// output stream. Each has its own ring, resampler and drift controller; when
+// they carry timestamp anchors, the buffered latency of each is steered so
+// their capture instants line up with the first input's.
+class AudioPump {
+public:
+    // `capture_time_us` is when the block's first frame was captured, on the
+    // clock of the producer's anchors, or 0 if no anchor has arrived yet.
+    using BlockCallback = std::function<void(const void* data, const AudioFormat& format, size_t number_of_frames,
+        int64_t capture_time_us)>;
+
+    struct Stats {
+        uint64_t delivered_blocks = 0;
+        uint64_t underruns = 0;       // Ticks skipped because the ring ran dry
+        uint64_t dropped_frames = 0;  // Frames discarded to bound latency
+        DriftEstimator::Metrics drift;
+    };
+
+    struct InputStats {
+        uint64_t underruns = 0;       // Ticks this input contributed nothing
+        uint64_t dropped_frames = 0;
+        DriftEstimator::Metrics drift;
+        double offset_ms = 0.0;       // Capture time relative to input 0
+    };
+
+    explicit AudioPump(BlockCallback on_block);
+    ~AudioPump();
+    AudioPump(const AudioPump&) = delete;
+    AudioPump& operator=(const AudioPump&) = delete;
+
+    // Registers an input while stopped and returns its index. `ring` (and
+    // `anchors`) must outlive the pump. All inputs must have the same
+    // channel count; any sample rate is resampled to kOutputSampleRate.
+    size_t AddInput(SpscRingBuffer<uint8_t>* ring, const AudioFormat& format,
+        SpscRingBuffer<AudioTimestampAnchor>* anchors = nullptr, float gain = 1.0f);
+    void ClearInputs();
+    void SetInputGain(size_t index, float gain);
+
+    // Starts delivery from the registered inputs.
+    void Start();
+    // Single-input shorthand: replaces the inputs with `ring` and starts.
+    // `format` describes what the producer writes; sinks always get
+    // kOutputSampleRate. The optional `anchors` ring carries the producer's
+    // capture timestamps.
+    void Start(SpscRingBuffer<uint8_t>* ring, const AudioFormat& format,
+        SpscRingBuffer<AudioTimestampAnchor>* anchors = nullptr);
+    void Stop();
+    bool Running() const { return running_; }
+
+    // Aggregate counters; `drift` is input 0's.
+    Stats GetStats() const;
+    InputStats GetInputStats(size_t index) const;
+    size_t InputCount() const { return inputs_.size(); }
+
+    static constexpr int kOutputSampleRate = 48000;
+
+private:
+    static constexpr std::chrono::milliseconds kBlockInterval{ 10 };
+    // Delivery (re)starts once this much audio is buffered, and the drift
+    // controller holds the fill level there. It absorbs the scheduling jitter
+    // between the device and the pump thread.
+    static constexpr double kTargetFillMs = 20.0;
+    // Beyond this backlog the oldest audio is dropped back to the target;
+    // the controller only handles slow drift, not stalls.
+    static constexpr double kMaxBacklogMs = 80.0;
+    // Offsets beyond this are corrected in one step; smaller ones move the
+    // input's target by kAlignGain of the offset per tick (about a 1 s time
+    // constant). Targets stay within the bounds below; the lower one still
+    // covers a 10 ms device period plus scheduling jitter.
+    static constexpr double kCoarseAlignMs = 3.0;
+    static constexpr double kAlignGain = 0.01;
+    static constexpr double kMinTargetFillMs = 15.0;
+    static constexpr double kMaxTargetFillMs = 60.0;
+    // If the thread was stalled longer than this, restart the schedule
+    // instead of bursting the missed ticks.
+    static constexpr std::chrono::milliseconds kMaxLag{ 50 };
+
+    struct Input {
+        SpscRingBuffer<uint8_t>* ring = nullptr;
+        SpscRingBuffer<AudioTimestampAnchor>* anchors = nullptr;
+        AudioFormat format;
+        std::atomic<float> gain = 1.0f;
+        AdaptiveResampler resampler;
+        DriftEstimator drift;
+        double target_ms = kTargetFillMs;
+        std::vector<int16_t> input_block;
+        std::vector<int16_t> output_block;
+        bool primed = false;
+        // Latest anchor at or before the block being delivered, and the
+        // next one already taken from the ring but not reached yet.
+        AudioTimestampAnchor anchor;
+        AudioTimestampAnchor next_anchor;
+        bool have_anchor = false;
+        bool have_next_anchor = false;
+
+        std::atomic<uint64_t> underruns = 0;
+        std::atomic<uint64_t> dropped_frames = 0;
+        // Guarded by AudioPump::metrics_mutex_.
+        DriftEstimator::Metrics drift_metrics;
+        double offset_ms = 0.0;
+    };
+
+    void Run();
+    void Tick();
+    // Produces one 10 ms output block from `input` into its output_block.
+    // Returns false if the input had nothing to give this tick.
+    bool PullBlock(Input* input, int64_t* capture_time_us);
+    int64_t BlockCaptureTime(Input* input, uint64_t first_frame);
+    // Steers `input` towards the reference input's capture time.
+    void Align(Input* input, double offset_ms);
+    void SetInputTarget(Input* input, double target_ms, bool immediate);
+
+    BlockCallback on_block_;
+    std::vector<std::unique_ptr<Input>> inputs_;
+    AudioFormat output_format_;
+    std::vector<float> mix_;
+    std::vector<int16_t> mixed_block_;
+
+    std::thread thread_;
+    std::atomic<bool> running_ = false;
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+
+    std::atomic<uint64_t> delivered_blocks_ = 0;
+    mutable std::mutex metrics_mutex_;
+};
@@ -1,17 +1,65 @@
 // AudioStreamCapture.cpp
 #include "AudioStreamCapture.h"
+#include "CaptureClock.h"
+#include <mmreg.h>
+#include <ksmedia.h>
 #include <iostream>
 #include <exception>
 #include <string>
 #include <vector>
 #include <cmath>
+#include <algorithm>
 #define REFTIMES_PER_SEC  100000 // 10Ms
 
+namespace {
+// CoTaskMem copy so m_waveFormat is freed the same way whichever path set it.
+WAVEFORMATEX* CopyWaveFormat(const WAVEFORMATEX* format) {
+    const size_t size = sizeof(WAVEFORMATEX) + (format->wFormatTag == WAVE_FORMAT_PCM ? 0 : format->cbSize);
+    auto* copy = static_cast<WAVEFORMATEX*>(CoTaskMemAlloc(size));
+    if (copy) {
+        memcpy(copy, format, size);
+    }
+    return copy;
+}
+
+bool ParseWaveFormat(const WAVEFORMATEX* format, DeviceFormat* out) {
+    bool isFloat = format->wFormatTag == WAVE_FORMAT_IEEE_FLOAT;
+    bool isPcm = format->wFormatTag == WAVE_FORMAT_PCM;
+    if (format->wFormatTag == WAVE_FORMAT_EXTENSIBLE && format->cbSize >= sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)) {
+        const auto* extensible = reinterpret_cast<const WAVEFORMATEXTENSIBLE*>(format);
+        isFloat = IsEqualGUID(extensible->SubFormat, KSDATAFORMAT_SUBTYPE_IEEE_FLOAT);
+        isPcm = IsEqualGUID(extensible->SubFormat, KSDATAFORMAT_SUBTYPE_PCM);
+    }
+    if (isFloat && format->wBitsPerSample == 32) {
+        out->sample_type = SampleType::kFloat32;
+    }
+    else if (isPcm && format->wBitsPerSample == 16) {
+        out->sample_type = SampleType::kInt16;
+    }
+    else if (isPcm && format->wBitsPerSample == 32) {
+        // Also covers 24 valid bits in a 32-bit container (left-justified).
+        out->sample_type = SampleType::kInt32;
+    }
+    else {
+        return false;
+    }
+    out->sample_rate = format->nSamplesPerSec;
+    out->number_of_channels = format->nChannels;
+    return out->number_of_channels > 0 && format->nBlockAlign == out->BytesPerFrame();
+}
+}
+
 AudioStreamCapture* AudioStreamCapture::instance = nullptr;
 std::mutex AudioStreamCapture::inst_mtx;
-std::mutex AudioStreamCapture::started_mtx;
-bool AudioStreamCapture::started_ = false;
-std::atomic<int> AudioStreamCapture::instance_count = 0;
+
+std::unique_ptr<AudioStreamCapture> AudioStreamCapture::Create(const AudioEndpoint& endpoint) {
+    std::unique_ptr<AudioStreamCapture> capture(new AudioStreamCapture());
+    if (!capture->Initialize(endpoint)) {
+        std::cerr << "Failed to initialize audio endpoint capture" << std::endl;
+        return nullptr;
+    }
+    return capture;
+}
 
 AudioStreamCapture::~AudioStreamCapture() {
     if (m_captureClient) {
@@ -29,20 +77,29 @@ AudioStreamCapture::~AudioStreamCapture() {
     if (m_waveFormat) {
         CoTaskMemFree(m_waveFormat);
     }
+    if (m_captureEvent) {
+        CloseHandle(m_captureEvent);
+    }
 }
 
-bool AudioStreamCapture::Initialize() {
+bool AudioStreamCapture::Initialize(const AudioEndpoint& endpoint) {
     REFERENCE_TIME hnsRequestedDuration = REFTIMES_PER_SEC;
+    const bool loopback = endpoint.kind == AudioEndpoint::Kind::kLoopback;
 
-    // Get the default audio device
     HRESULT hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr, CLSCTX_ALL, __uuidof(IMMDeviceEnumerator), (void**)&m_deviceEnumerator);
     if (FAILED(hr)) {
         std::cerr << "Failed to create MMDeviceEnumerator: " << std::hex << hr << std::endl;
         return false;
     }
-    hr = m_deviceEnumerator->GetDefaultAudioEndpoint(eRender, eConsole, &m_device);
+    if (endpoint.device_id.empty()) {
+        // Loopback records a render endpoint; a microphone is a capture one.
+        hr = m_deviceEnumerator->GetDefaultAudioEndpoint(loopback ? eRender : eCapture, eConsole, &m_device);
+    }
+    else {
+        hr = m_deviceEnumerator->GetDevice(endpoint.device_id.c_str(), &m_device);
+    }
     if (FAILED(hr)) {
-        std::cerr << "Failed to get default audio endpoint: " << std::hex << hr << std::endl;
+        std::cerr << "Failed to get audio endpoint: " << std::hex << hr << std::endl;
         return false;
     }
 
@@ -53,21 +110,19 @@ bool AudioStreamCapture::Initialize() {
         return false;
     }
 
-    // WebRTC works best with these specific parameters:
-    // - 48kHz sample rate
-    // - 10ms frames
-    // - Stereo or Mono
-
-   // First check if the format is supported
+    // WebRTC works best with 48 kHz 16-bit stereo in 10 ms frames. Shared-mode
+    // loopback usually only accepts the engine mix format (typically 32-bit
+    // float), so fall back to the closest match or the mix format and convert
+    // to 16-bit in ReadPackets(). m_waveFormat always holds the format the
+    // client was actually initialized with.
     WAVEFORMATEX webrtcFormat = { 0 };
     webrtcFormat.wFormatTag = WAVE_FORMAT_PCM;
-    webrtcFormat.nChannels = 2;  // Mono
+    webrtcFormat.nChannels = 2;
     webrtcFormat.nSamplesPerSec = 48000;  // 48kHz is the WebRTC internal standard
     webrtcFormat.wBitsPerSample = 16;  // 16-bit PCM
     webrtcFormat.nBlockAlign = webrtcFormat.nChannels * (webrtcFormat.wBitsPerSample / 8);
     webrtcFormat.nAvgBytesPerSec = webrtcFormat.nSamplesPerSec * webrtcFormat.nBlockAlign;
 
-    // Check if format is supported
     WAVEFORMATEX* closestMatch = NULL;
     hr = m_audioClient->IsFormatSupported(
         AUDCLNT_SHAREMODE_SHARED,
@@ -75,49 +130,76 @@ bool AudioStreamCapture::Initialize() {
         &closestMatch);
 
     if (hr == S_OK) {
-        
-        hr = m_audioClient->Initialize(
-            AUDCLNT_SHAREMODE_SHARED,
-            AUDCLNT_STREAMFLAGS_LOOPBACK,
-            hnsRequestedDuration,  // Buffer size
-            0,                 // Period
-            &webrtcFormat,     // Format
-            NULL);             // Session GUID
+        m_waveFormat = CopyWaveFormat(&webrtcFormat);
     }
     else if (hr == S_FALSE && closestMatch) {
-        // Your exact format isn't supported, but a similar one is
         std::cout << "Using closest matching format instead" << std::endl;
-
-        // Initialize with the closest matching format
-        hr = m_audioClient->Initialize(
-            AUDCLNT_SHAREMODE_SHARED,
-            AUDCLNT_STREAMFLAGS_LOOPBACK,
-            hnsRequestedDuration,
-            0,
-            closestMatch,
-            NULL);
-
-        CoTaskMemFree(closestMatch);
+        m_waveFormat = closestMatch;
     }
     else {
-        // Format not supported and no alternative provided
-        std::cerr << "Audio format not supported: " << std::hex << hr << std::endl;
-        return false;
+        CoTaskMemFree(closestMatch);
+        hr = m_audioClient->GetMixFormat(&m_waveFormat);
+        if (FAILED(hr)) {
+            std::cerr << "Audio format not supported and no mix format available: " << std::hex << hr << std::endl;
+            return false;
+        }
+        std::cout << "Using device mix format instead" << std::endl;
     }
-
-    // Store the format for future use
-    m_waveFormat = (WAVEFORMATEX*)CoTaskMemAlloc(sizeof(WAVEFORMATEX));
     if (!m_waveFormat) {
         std::cerr << "Failed to allocate memory for wave format." << std::endl;
         return false;
     }
-    memcpy(m_waveFormat, &webrtcFormat, sizeof(WAVEFORMATEX));
 
+    DeviceFormat deviceFormat;
+    if (!ParseWaveFormat(m_waveFormat, &deviceFormat)) {
+        std::cerr << "Unsupported capture sample format: tag " << m_waveFormat->wFormatTag
+            << ", " << m_waveFormat->wBitsPerSample << " bits" << std::endl;
+        return false;
+    }
+
+    hr = m_audioClient->Initialize(
+        AUDCLNT_SHAREMODE_SHARED,
+        (loopback ? AUDCLNT_STREAMFLAGS_LOOPBACK : 0) | AUDCLNT_STREAMFLAGS_EVENTCALLBACK,
+        hnsRequestedDuration,  // Buffer size
+        0,                 // Period
+        m_waveFormat,      // Format
+        NULL);             // Session GUID
+    if (FAILED(hr)) {
+        std::cerr << "Failed to initialize audio client: " << std::hex << hr << std::endl;
+        return false;
+    }
+
+    // Packets are announced through an auto-reset event instead of polling.
+    m_captureEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    if (!m_captureEvent) {
+        std::cerr << "Failed to create audio capture event." << std::endl;
+        return false;
+    }
+    hr = m_audioClient->SetEventHandle(m_captureEvent);
+    if (FAILED(hr)) {
+        std::cerr << "Failed to set audio event handle: " << std::hex << hr << std::endl;
+        return false;
+    }
+
+    // No packet can exceed the endpoint buffer, so size the conversion
+    // scratch for that once.
+    UINT32 bufferFrames = 0;
+    hr = m_audioClient->GetBufferSize(&bufferFrames);
+    if (FAILED(hr)) {
+        std::cerr << "Failed to get audio buffer size: " << std::hex << hr << std::endl;
+        return false;
+    }
+    if (!m_converter.Configure(deviceFormat, kOutputChannels, bufferFrames)) {
+        std::cerr << "Failed to configure audio converter." << std::endl;
+        return false;
+    }
+    m_convertBuffer.assign(static_cast<size_t>(bufferFrames) * kOutputChannels, 0);
 
     std::cout << "Audio client initialized with format: "
         << m_waveFormat->nChannels << " channels, "
         << m_waveFormat->nSamplesPerSec << " Hz, "
-        << m_waveFormat->wBitsPerSample << " bits" << std::endl;
+        << m_waveFormat->wBitsPerSample << " bits"
+        << (deviceFormat.sample_type == SampleType::kFloat32 ? " float" : " PCM") << std::endl;
     // Get the capture client
     hr = m_audioClient->GetService(__uuidof(IAudioCaptureClient), (void**)&m_captureClient);
     if (FAILED(hr)) {
@@ -147,6 +229,12 @@ void AudioStreamCapture::StartStream() {
 }
 
 void AudioStreamCapture::StopStream() {
+    std::lock_guard<std::mutex> lock(AudioStreamCapture::started_mtx);
+    // The device keeps running until the last StartStream() is balanced.
+    if (AudioStreamCapture::instance_count == 0 || --AudioStreamCapture::instance_count > 0) {
+        return;
+    }
+    AudioStreamCapture::started_ = false;
     // Stop the audio stream
     if (!m_audioClient) {
         std::cerr << "Audio client not initialized." << std::endl;
@@ -157,22 +245,27 @@ void AudioStreamCapture::StopStream() {
         throw std::runtime_error("Failed to stop audio client: " + std::to_string(hr));
         return;
     }
-    std::lock_guard<std::mutex> lock(AudioStreamCapture::started_mtx);
-    if (--AudioStreamCapture::instance_count==0) {
-        AudioStreamCapture::started_ = false;
-    }
 }
 
 bool AudioStreamCapture::Started(){
     std::lock_guard<std::mutex> lock(started_mtx);
     return AudioStreamCapture::started_;
 }
-void AudioStreamCapture::CaptureAudio(std::vector<BYTE>& data,
-    int* bits_per_sample,
-    int* sample_rate,
-    size_t* number_of_channels,
-    size_t* number_of_frames) {
+AudioFormat AudioStreamCapture::Format() const {
+    if (!m_waveFormat) {
+        return AudioFormat();
+    }
+    return m_converter.OutputFormat();
+}
+
+bool AudioStreamCapture::WaitForPacket(uint32_t timeout_ms) {
+    if (!m_captureEvent) {
+        throw std::runtime_error("Audio capture event not initialized.");
+    }
+    return WaitForSingleObject(m_captureEvent, timeout_ms) == WAIT_OBJECT_0;
+}
 
+size_t AudioStreamCapture::ReadPackets(SpscRingBuffer<uint8_t>* ring, SpscRingBuffer<AudioTimestampAnchor>* anchors) {
     if (!m_captureClient || !m_waveFormat) {
         throw std::runtime_error("Audio capture client or wave format not initialized.");
     }
@@ -180,55 +273,46 @@ void AudioStreamCapture::CaptureAudio(std::vector<BYTE>& data,
         throw std::runtime_error("Audio stream not started.");
     }
 
-    *bits_per_sample = m_waveFormat->wBitsPerSample;
-    *number_of_channels = m_waveFormat->nChannels;
-    *sample_rate = m_waveFormat->nSamplesPerSec;
-
-    // WebRTC expects exactly 10ms frames
-    UINT32 neededFrames = *sample_rate / 100;  // 480 frames at 48kHz
-    UINT32 bytesPerFrame = (*bits_per_sample / 8) * (*number_of_channels);
-    UINT32 totalBytesNeeded = neededFrames * bytesPerFrame;
-
-    data.clear();
-    data.reserve(totalBytesNeeded);
-
-    BYTE* buffer;
-    DWORD flags;
+    const size_t bytesPerFrame = m_converter.OutputFormat().BytesPerFrame();
+    size_t writtenFrames = 0;
     UINT32 packetSize = 0;
     HRESULT hr = m_captureClient->GetNextPacketSize(&packetSize);
-
-    if (FAILED(hr) || packetSize == 0) {
-        *number_of_frames = 0;
-        return;
-    }
-
-    UINT32 collectedFrames = 0;
-    while (collectedFrames < neededFrames) {
+    while (SUCCEEDED(hr) && packetSize > 0) {
+        BYTE* buffer;
         UINT32 framesAvailable = 0;
-        hr = m_captureClient->GetBuffer(&buffer, &framesAvailable, &flags, nullptr, nullptr);
+        DWORD flags;
+        UINT64 qpcPosition = 0;
+        hr = m_captureClient->GetBuffer(&buffer, &framesAvailable, &flags, nullptr, &qpcPosition);
         if (FAILED(hr)) {
-            *number_of_frames = 0;
             std::cerr << "Failed to get buffer: " << std::hex << hr << std::endl;
-            return;
+            break;
         }
 
-        UINT32 framesToCopy = std::min(framesAvailable, neededFrames - collectedFrames);
-        UINT32 bytesToCopy = framesToCopy * bytesPerFrame;
-
-        data.insert(data.end(), buffer, buffer + bytesToCopy);
-        collectedFrames += framesToCopy;
+        // Only whole frames go into the ring so the consumer stays aligned.
+        const size_t frames = std::min<size_t>(framesAvailable, ring->WriteAvailable() / bytesPerFrame);
+        // qpcPosition is when the engine captured the packet's first frame,
+        // which is what the receiver should align against video.
+        if (anchors && frames > 0 && qpcPosition != 0 && !(flags & AUDCLNT_BUFFERFLAGS_TIMESTAMP_ERROR)) {
+            AudioTimestampAnchor anchor;
+            anchor.frame = ring->TotalWritten() / bytesPerFrame;
+            anchor.capture_time_us = CaptureClock::FromQpc100ns(static_cast<int64_t>(qpcPosition));
+            anchors->Write(&anchor, 1);
+        }
+        if (flags & AUDCLNT_BUFFERFLAGS_SILENT) {
+            writtenFrames += ring->Write(nullptr, frames * bytesPerFrame) / bytesPerFrame;
+        }
+        else {
+            const size_t converted = m_converter.Convert(buffer, frames, m_convertBuffer.data());
+            writtenFrames += ring->Write(reinterpret_cast<const uint8_t*>(m_convertBuffer.data()),
+                converted * bytesPerFrame) / bytesPerFrame;
+        }
 
         hr = m_captureClient->ReleaseBuffer(framesAvailable);
         if (FAILED(hr)) {
-            *number_of_frames = 0;
             std::cerr << "Failed to release buffer: " << std::hex << hr << std::endl;
-            return;
-        }
-        hr = m_captureClient->GetNextPacketSize(&packetSize);
-        if (FAILED(hr) || packetSize == 0) {
             break;
         }
+        hr = m_captureClient->GetNextPacketSize(&packetSize);
     }
-
-    *number_of_frames = collectedFrames;
+    return writtenFrames;
 }
@@ -8,9 +8,26 @@
 #include <iostream>
 #include <memory>
 #include "AudioData.h"
+#include "AudioCaptureBackend.h"
+#include "SpscRingBuffer.h"
+#include "AudioConverter.h"
+#include <vector>
+#include <string>
 using Microsoft::WRL::ComPtr;
 
-class AudioStreamCapture {
+// A WASAPI endpoint to capture from.
+struct AudioEndpoint {
+    enum class Kind {
+        kLoopback,    // What a render endpoint plays (system audio)
+        kMicrophone   // A capture endpoint
+    };
+    Kind kind = Kind::kLoopback;
+    std::wstring device_id;  // IMMDevice id; empty selects the default endpoint
+    float gain = 1.0f;       // Linear gain applied when mixed
+};
+
+// WASAPI capture backend for one endpoint.
+class AudioStreamCapture : public AudioCaptureBackend {
 private:
     AudioStreamCapture() {
 
@@ -18,21 +35,29 @@ private:
 
     static std::mutex inst_mtx;
     static AudioStreamCapture* instance;
-    static std::mutex started_mtx;
-    static bool started_;
-    static std::atomic<int> instance_count;
+    std::mutex started_mtx;
+    bool started_ = false;
+    std::atomic<int> instance_count = 0;
 
-    bool Initialize();
+    bool Initialize(const AudioEndpoint& endpoint);
 
     ComPtr<IMMDeviceEnumerator> m_deviceEnumerator = nullptr;
     ComPtr<IMMDevice> m_device = nullptr;
     ComPtr<IAudioClient> m_audioClient = nullptr;
     ComPtr<IAudioCaptureClient> m_captureClient = nullptr;
+    // Format the client was initialized with (the device side).
     WAVEFORMATEX* m_waveFormat = nullptr;
-    
+    // Device packets are converted to 16-bit PCM at kOutputChannels before
+    // they reach the ring.
+    static constexpr size_t kOutputChannels = 2;
+    AudioConverter m_converter;
+    std::vector<int16_t> m_convertBuffer;
+    // Signalled by the audio engine whenever a capture packet is ready.
+    HANDLE m_captureEvent = nullptr;
+
 
 public:
-    ~AudioStreamCapture();
+    ~AudioStreamCapture() override;
     AudioStreamCapture(const AudioStreamCapture&) = delete;
     AudioStreamCapture& operator=(const AudioStreamCapture&) = delete;
 
@@ -41,7 +66,7 @@ public:
             std::lock_guard<std::mutex> lock(AudioStreamCapture::inst_mtx);
             if (!instance) {
                 instance = new AudioStreamCapture();
-                if (!instance->Initialize()) {
+                if (!instance->Initialize(AudioEndpoint())) {
                     std::cerr << "Failed to initialize audio stream capture" << std::endl;
                     return nullptr;
                 }
@@ -50,15 +75,33 @@ public:
         return instance;
     }
 
-    void StopStream();
-    void StartStream();
-	static bool Started();
+    // Opens a further endpoint, e.g. a microphone to mix with the default
+    // loopback from GetInstance(). Returns null if it cannot be initialized.
+    static std::unique_ptr<AudioStreamCapture> Create(const AudioEndpoint& endpoint);
+
+    void StopStream() override;
+    void StartStream() override;
+	bool Started() override;
+
+    // Format of the samples ReadPackets() produces: 16-bit PCM, stereo, at
+    // the device sample rate.
+    AudioFormat Format() const override;
+
+    // Blocks until the device signals a new packet or `timeout_ms` passes.
+    // Returns false on timeout; callers should still drain, since loopback
+    // streams on older Windows builds never signal the event.
+    bool WaitForPacket(uint32_t timeout_ms) override;
+    // The auto-reset event behind WaitForPacket(), for callers that wait on
+    // several endpoints at once.
+    HANDLE PacketEvent() const override { return m_captureEvent; }
+
+    // Moves every packet the device has queued into `ring` (silent packets
+    // become zeros) and returns the number of frames written. Frames that do
+    // not fit in the ring are dropped. The ring is the only buffer involved,
+    // so this never allocates. When `anchors` is given, each packet with a
+    // valid device timestamp also pushes its capture instant there.
+    size_t ReadPackets(SpscRingBuffer<uint8_t>* ring, SpscRingBuffer<AudioTimestampAnchor>* anchors = nullptr) override;
 
-    void CaptureAudio(std::vector<BYTE>& data,
-        int* bits_per_sample,
-        int* sample_rate,
-        size_t* number_of_channels,
-        size_t* number_of_frames);
     HRESULT  ReleaseBuffer(UINT32 number_of_frames) {
         if (!m_captureClient ||!Started()) {
             throw std::runtime_error("Capture Client is not initialized or audio stream has not started.");
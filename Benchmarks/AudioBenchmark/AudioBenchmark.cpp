@@ -0,0 +1,405 @@
+// AudioBenchmark.cpp
+// Drives the capture-side audio path (SpscRingBuffer + AudioPump) with a
+// synthetic device that delivers jittery, oddly sized packets the way WASAPI
+// does. After a warm-up period every heap allocation in the process is
+// counted; the steady state must not allocate, so the run fails if any do.
+// Also reports block cadence (interval mean/p99/max), pump underruns, and
+// how the drift controller tracks a device clock that runs --drift-ppm fast.
+// Blocks carry capture timestamps derived from per-packet anchors; their
+// spacing must stay at 10 ms however jittery delivery is. With --sources N
+// the pump mixes N devices, each delivering --source-latency-ms later than
+// the previous one, and must bring their capture times into line.
+// The "convert" suite measures the sample-format/channel converters and the
+// "mix" suite the mixing kernels for 2-8 sources. The "backend" suite runs
+// the synthetic and file-replay capture backends (--replay picks the file).
+#include "BackendBenchmark.h"
+#include "ConverterBenchmark.h"
+#include "../../AudioPump.h"
+#include "../../SpscRingBuffer.h"
+#include <boost/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::atomic<bool> g_countAllocations = false;
+std::atomic<uint64_t> g_allocations = 0;
+std::atomic<uint64_t> g_allocatedBytes = 0;
+
+void* CountedAlloc(size_t size, size_t alignment) {
+    if (g_countAllocations.load(std::memory_order_relaxed)) {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+        g_allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    if (size == 0) {
+        size = 1;
+    }
+#ifdef _WIN32
+    void* p = alignment ? _aligned_malloc(size, alignment) : std::malloc(size);
+#else
+    void* p = alignment ? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment) : std::malloc(size);
+#endif
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void CountedFree(void* p, bool aligned) {
+#ifdef _WIN32
+    if (aligned) {
+        _aligned_free(p);
+        return;
+    }
+#endif
+    (void)aligned;
+    std::free(p);
+}
+
+} // namespace
+
+void* operator new(size_t size) { return CountedAlloc(size, 0); }
+void* operator new[](size_t size) { return CountedAlloc(size, 0); }
+void* operator new(size_t size, std::align_val_t align) { return CountedAlloc(size, static_cast<size_t>(align)); }
+void* operator new[](size_t size, std::align_val_t align) { return CountedAlloc(size, static_cast<size_t>(align)); }
+void operator delete(void* p) noexcept { CountedFree(p, false); }
+void operator delete[](void* p) noexcept { CountedFree(p, false); }
+void operator delete(void* p, size_t) noexcept { CountedFree(p, false); }
+void operator delete[](void* p, size_t) noexcept { CountedFree(p, false); }
+void operator delete(void* p, std::align_val_t) noexcept { CountedFree(p, true); }
+void operator delete[](void* p, std::align_val_t) noexcept { CountedFree(p, true); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { CountedFree(p, true); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { CountedFree(p, true); }
+
+namespace {
+
+const double kMaxTimestampStepErrorUs = 50.0;
+const double kMaxSourceOffsetMs = 2.0;
+
+struct BenchmarkOptions {
+    int seconds = 10;
+    int warmupSeconds = 1;
+    int sampleRate = 48000;
+    int channels = 2;
+    int packetJitterUs = 3000;
+    double deviceDriftPpm = 0.0;
+    int sources = 1;
+    int sourceLatencyMs = 5;
+    int convertIterations = 20000;
+    int backendSeconds = 3;
+    std::string replayFile;
+    std::vector<std::string> suites = { "capture", "convert", "mix", "backend" };
+    std::string output;
+};
+
+// Stand-in for the WASAPI loopback client: wakes roughly every 10 ms with
+// jitter and writes however many frames the (optionally skewed) device clock
+// produced since the last packet, as 16-bit interleaved PCM. Each packet
+// also gets an anchor with the device-clock instant of its first frame, in
+// steady_clock microseconds. `latencyUs` delays delivery without moving
+// those instants, like an endpoint with a deeper engine buffer.
+class SyntheticDevice {
+public:
+    SyntheticDevice(const AudioFormat& format, int jitterUs, double driftPpm, int latencyUs, unsigned seed)
+        : format_(format), jitterUs_(jitterUs), latencyUs_(latencyUs), clockScale_(1.0 + driftPpm * 1e-6), rng_(seed) {
+        packet_.resize(static_cast<size_t>(format.sample_rate / 10) * format.number_of_channels);
+    }
+
+    void Run(SpscRingBuffer<uint8_t>* ring, SpscRingBuffer<AudioTimestampAnchor>* anchors,
+        std::chrono::steady_clock::time_point until) {
+        const auto start = std::chrono::steady_clock::now();
+        uint64_t produced = 0;
+        std::uniform_int_distribution<int> jitter(0, std::max(jitterUs_, 0));
+        for (int tick = 1;; ++tick) {
+            const auto wake = start + std::chrono::milliseconds(10 * tick) + std::chrono::microseconds(jitter(rng_));
+            if (wake >= until) {
+                break;
+            }
+            std::this_thread::sleep_until(wake);
+            const auto elapsedUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count() - latencyUs_;
+            if (elapsedUs <= 0) {
+                continue;
+            }
+            const uint64_t due = static_cast<uint64_t>(elapsedUs * clockScale_ * format_.sample_rate / 1000000);
+            const size_t frames = std::min<size_t>(due - produced, packet_.size() / format_.number_of_channels);
+            AudioTimestampAnchor anchor;
+            anchor.frame = ring->TotalWritten() / format_.BytesPerFrame();
+            anchor.capture_time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                start.time_since_epoch()).count() +
+                static_cast<int64_t>(produced * 1e6 / (format_.sample_rate * clockScale_));
+            anchors->Write(&anchor, 1);
+            Fill(frames);
+            const size_t bytes = frames * format_.BytesPerFrame();
+            const size_t room = ring->WriteAvailable();
+            ring->Write(reinterpret_cast<const uint8_t*>(packet_.data()),
+                std::min(bytes, room - room % format_.BytesPerFrame()));
+            produced += frames;
+        }
+    }
+
+private:
+    void Fill(size_t frames) {
+        for (size_t i = 0; i < frames; ++i) {
+            const int16_t sample = static_cast<int16_t>(8000.0 * std::sin(phase_));
+            phase_ += 2.0 * 3.14159265358979 * 440.0 / format_.sample_rate;
+            for (size_t c = 0; c < format_.number_of_channels; ++c) {
+                packet_[i * format_.number_of_channels + c] = sample;
+            }
+        }
+    }
+
+    AudioFormat format_;
+    int jitterUs_;
+    int latencyUs_;
+    double clockScale_;
+    std::mt19937 rng_;
+    std::vector<int16_t> packet_;
+    double phase_ = 0.0;
+};
+
+std::vector<std::string> Split(const std::string& list) {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) {
+            comma = list.size();
+        }
+        if (comma > start) {
+            parts.push_back(list.substr(start, comma - start));
+        }
+        start = comma + 1;
+    }
+    return parts;
+}
+
+bool ParseOptions(int argc, char** argv, BenchmarkOptions* options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--seconds") options->seconds = std::stoi(value);
+        else if (arg == "--warmup") options->warmupSeconds = std::stoi(value);
+        else if (arg == "--rate") options->sampleRate = std::stoi(value);
+        else if (arg == "--channels") options->channels = std::stoi(value);
+        else if (arg == "--jitter-us") options->packetJitterUs = std::stoi(value);
+        else if (arg == "--drift-ppm") options->deviceDriftPpm = std::stod(value);
+        else if (arg == "--sources") options->sources = std::stoi(value);
+        else if (arg == "--source-latency-ms") options->sourceLatencyMs = std::stoi(value);
+        else if (arg == "--iterations") options->convertIterations = std::stoi(value);
+        else if (arg == "--backend-seconds") options->backendSeconds = std::stoi(value);
+        else if (arg == "--replay") options->replayFile = value;
+        else if (arg == "--suites") options->suites = Split(value);
+        else if (arg == "--output") options->output = value;
+        else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+    }
+    return options->seconds > 0 && options->sampleRate >= 100 && options->channels > 0 && options->sources > 0 &&
+        options->backendSeconds > 0;
+}
+
+boost::json::object RunCaptureBenchmark(const BenchmarkOptions& options, bool* ok) {
+    AudioFormat format;
+    format.bits_per_sample = 16;
+    format.sample_rate = options.sampleRate;
+    format.number_of_channels = options.channels;
+
+    // Everything the hot path touches is sized up front, including the
+    // interval log written from the pump thread.
+    const size_t totalSeconds = options.warmupSeconds + options.seconds;
+    std::vector<int64_t> intervalsUs(totalSeconds * 100 + 100);
+    std::atomic<size_t> intervalCount = 0;
+    std::atomic<bool> measuring = false;
+    std::atomic<uint64_t> measuredBlocks = 0;
+    std::atomic<uint64_t> wrongSizedBlocks = 0;
+    auto lastBlock = std::chrono::steady_clock::time_point();
+    int64_t lastCaptureUs = 0;
+    double maxStepErrorUs = 0.0;
+    double delaySumUs = 0.0;
+    uint64_t untimedBlocks = 0;
+
+    AudioPump pump([&](const void*, const AudioFormat& blockFormat, size_t frames, int64_t captureUs) {
+        const auto now = std::chrono::steady_clock::now();
+        if (measuring) {
+            if (captureUs == 0) {
+                ++untimedBlocks;
+            }
+            else {
+                delaySumUs += static_cast<double>(
+                    std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count() - captureUs);
+                if (lastCaptureUs != 0) {
+                    maxStepErrorUs = std::max(maxStepErrorUs, std::abs(captureUs - lastCaptureUs - 10000.0));
+                }
+            }
+            if (lastBlock != std::chrono::steady_clock::time_point()) {
+                const size_t index = intervalCount.fetch_add(1);
+                if (index < intervalsUs.size()) {
+                    intervalsUs[index] = std::chrono::duration_cast<std::chrono::microseconds>(now - lastBlock).count();
+                }
+            }
+            ++measuredBlocks;
+            if (frames != blockFormat.FramesPer10Ms()) {
+                ++wrongSizedBlocks;
+            }
+        }
+        lastBlock = now;
+        lastCaptureUs = captureUs;
+    });
+
+    // Only source 0 drifts; the others follow the nominal clock.
+    std::vector<std::unique_ptr<SpscRingBuffer<uint8_t>>> rings;
+    std::vector<std::unique_ptr<SpscRingBuffer<AudioTimestampAnchor>>> anchors;
+    std::vector<std::unique_ptr<SyntheticDevice>> devices;
+    for (int i = 0; i < options.sources; ++i) {
+        rings.push_back(std::make_unique<SpscRingBuffer<uint8_t>>(format.FramesPer10Ms() * 20 * format.BytesPerFrame()));
+        anchors.push_back(std::make_unique<SpscRingBuffer<AudioTimestampAnchor>>(256));
+        devices.push_back(std::make_unique<SyntheticDevice>(format, options.packetJitterUs,
+            i == 0 ? options.deviceDriftPpm : 0.0, i * options.sourceLatencyMs * 1000, 42 + i));
+        pump.AddInput(rings[i].get(), format, anchors[i].get(), 1.0f / options.sources);
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto measureFrom = start + std::chrono::seconds(options.warmupSeconds);
+    const auto until = measureFrom + std::chrono::seconds(options.seconds);
+    pump.Start();
+    std::vector<std::thread> producers;
+    for (int i = 0; i < options.sources; ++i) {
+        producers.emplace_back([&, i] { devices[i]->Run(rings[i].get(), anchors[i].get(), until); });
+    }
+
+    std::this_thread::sleep_until(measureFrom);
+    const AudioPump::Stats warmupStats = pump.GetStats();
+    g_allocations = 0;
+    g_allocatedBytes = 0;
+    measuring = true;
+    g_countAllocations = true;
+
+    for (std::thread& producer : producers) {
+        producer.join();
+    }
+    g_countAllocations = false;
+    measuring = false;
+    pump.Stop();
+
+    const AudioPump::Stats stats = pump.GetStats();
+    const size_t intervals = std::min(intervalCount.load(), intervalsUs.size());
+    std::vector<int64_t> sorted(intervalsUs.begin(), intervalsUs.begin() + intervals);
+    std::sort(sorted.begin(), sorted.end());
+    double meanUs = 0.0;
+    for (int64_t us : sorted) {
+        meanUs += static_cast<double>(us);
+    }
+    meanUs = sorted.empty() ? 0.0 : meanUs / sorted.size();
+
+    boost::json::object report;
+    report["sample_rate"] = options.sampleRate;
+    report["channels"] = options.channels;
+    report["seconds"] = options.seconds;
+    report["packet_jitter_us"] = options.packetJitterUs;
+    report["device_drift_ppm"] = options.deviceDriftPpm;
+    report["estimated_drift_ppm"] = stats.drift.drift_ppm;
+    report["correction_ppm"] = stats.drift.correction_ppm;
+    report["fill_ms"] = stats.drift.fill_ms;
+    report["target_fill_ms"] = stats.drift.target_ms;
+    report["steady_state_allocations"] = g_allocations.load();
+    report["steady_state_allocated_bytes"] = g_allocatedBytes.load();
+    report["blocks"] = measuredBlocks.load();
+    report["wrong_sized_blocks"] = wrongSizedBlocks.load();
+    report["underruns"] = stats.underruns - warmupStats.underruns;
+    report["dropped_frames"] = stats.dropped_frames - warmupStats.dropped_frames;
+    report["interval_us_mean"] = meanUs;
+    report["interval_us_p99"] = sorted.empty() ? 0 : sorted[std::min(sorted.size() * 99 / 100, sorted.size() - 1)];
+    report["interval_us_max"] = sorted.empty() ? 0 : sorted.back();
+    report["untimed_blocks"] = untimedBlocks;
+    report["capture_delay_us_mean"] = measuredBlocks > untimedBlocks ? delaySumUs / (measuredBlocks - untimedBlocks) : 0.0;
+    report["timestamp_step_error_us_max"] = maxStepErrorUs;
+    report["sources"] = options.sources;
+    boost::json::array offsets;
+    double maxOffsetMs = 0.0;
+    for (size_t i = 1; i < pump.InputCount(); ++i) {
+        const AudioPump::InputStats input = pump.GetInputStats(i);
+        offsets.push_back(input.offset_ms);
+        maxOffsetMs = std::max(maxOffsetMs, std::abs(input.offset_ms));
+    }
+    report["source_offsets_ms"] = offsets;
+
+    if (g_allocations != 0 || wrongSizedBlocks != 0 || measuredBlocks == 0) {
+        std::cerr << "FAILED: " << g_allocations << " allocations, " << wrongSizedBlocks
+            << " wrong-sized blocks in steady state" << std::endl;
+        *ok = false;
+    }
+    // Consecutive blocks are 480 output frames apart; only the ratio
+    // correction (at most 0.1%) may stretch that.
+    if (untimedBlocks != 0 || maxStepErrorUs > kMaxTimestampStepErrorUs) {
+        std::cerr << "FAILED: " << untimedBlocks << " untimed blocks, timestamp step error "
+            << maxStepErrorUs << " us" << std::endl;
+        *ok = false;
+    }
+    if (maxOffsetMs > kMaxSourceOffsetMs) {
+        std::cerr << "FAILED: sources " << maxOffsetMs << " ms out of alignment" << std::endl;
+        *ok = false;
+    }
+    return report;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    BenchmarkOptions options;
+    if (!ParseOptions(argc, argv, &options)) {
+        std::cerr << "Usage: AudioBenchmark [--suites capture,convert,mix,backend] [--seconds N] [--warmup N]"
+            " [--rate Hz] [--channels N] [--jitter-us N] [--drift-ppm N] [--sources N] [--source-latency-ms N]"
+            " [--iterations N] [--backend-seconds N] [--replay file.wav] [--output file.json]" << std::endl;
+        return 2;
+    }
+
+    boost::json::object report;
+    report["benchmark"] = "audio";
+    bool ok = true;
+    for (const std::string& suite : options.suites) {
+        if (suite == "capture") {
+            report["capture"] = RunCaptureBenchmark(options, &ok);
+        }
+        else if (suite == "convert") {
+            report["convert"] = RunConverterBenchmark(options.convertIterations, &ok);
+        }
+        else if (suite == "mix") {
+            report["mix"] = RunMixBenchmark(options.convertIterations, &ok);
+        }
+        else if (suite == "backend") {
+            report["backend"] = RunBackendBenchmark(options.backendSeconds, options.replayFile, &ok);
+        }
+        else {
+            std::cerr << "Unknown suite: " << suite << std::endl;
+            return 2;
+        }
+    }
+
+    const std::string json = boost::json::serialize(report);
+    if (options.output.empty()) {
+        std::cout << json << std::endl;
+    }
+    else {
+        std::ofstream(options.output) << json << std::endl;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,220 @@
+// BackendBenchmark.cpp
+#include "BackendBenchmark.h"
+#include "../../AudioPump.h"
+#include "../../FileAudioCapture.h"
+#include "../../SyntheticAudioCapture.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr int kReplaySeconds = 10;
+constexpr int kWarmupBlocks = 50;
+// Same wait as AudioCaptureSource's capture loop.
+constexpr uint32_t kPacketWaitTimeoutMs = 20;
+
+SyntheticAudioCapture::Config SpeechConfig(bool realtime) {
+    SyntheticAudioCapture::Config config;
+    config.signal = SyntheticAudioCapture::Signal::kSpeech;
+    config.seed = 7;
+    config.pacing.realtime = realtime;
+    return config;
+}
+
+// Drains `backend` as fast as it produces into `out` until it ends or
+// `frames` frames have arrived.
+void DrainAll(PacedAudioCapture* backend, size_t frames, std::vector<int16_t>* out) {
+    const AudioFormat format = backend->Format();
+    SpscRingBuffer<uint8_t> ring(format.FramesPer10Ms() * 20 * format.BytesPerFrame());
+    out->assign(frames * format.number_of_channels, 0);
+    uint8_t* dst = reinterpret_cast<uint8_t*>(out->data());
+    const size_t total_bytes = out->size() * sizeof(int16_t);
+    size_t read_bytes = 0;
+    backend->StartStream();
+    while (read_bytes < total_bytes) {
+        backend->ReadPackets(&ring);
+        const size_t got = ring.Read(dst + read_bytes, std::min(ring.ReadAvailable(), total_bytes - read_bytes));
+        read_bytes += got;
+        if (got == 0 && backend->Ended()) {
+            break;
+        }
+    }
+    backend->StopStream();
+    out->resize(read_bytes / sizeof(int16_t));
+}
+
+void WriteLe(std::ofstream& file, uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        file.put(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+// 32-bit float stereo WAV of `samples`, the format shared-mode endpoints
+// usually deliver.
+bool WriteFloatWav(const std::string& path, const std::vector<int16_t>& samples, int sample_rate) {
+    std::ofstream file(path, std::ios::binary);
+    const uint32_t data_bytes = static_cast<uint32_t>(samples.size() * sizeof(float));
+    file.write("RIFF", 4);
+    WriteLe(file, 36 + data_bytes, 4);
+    file.write("WAVEfmt ", 8);
+    WriteLe(file, 16, 4);
+    WriteLe(file, 3, 2);  // WAVE_FORMAT_IEEE_FLOAT
+    WriteLe(file, 2, 2);
+    WriteLe(file, static_cast<uint32_t>(sample_rate), 4);
+    WriteLe(file, static_cast<uint32_t>(sample_rate) * 8, 4);
+    WriteLe(file, 8, 2);
+    WriteLe(file, 32, 2);
+    file.write("data", 4);
+    WriteLe(file, data_bytes, 4);
+    for (int16_t sample : samples) {
+        const float value = sample / 32768.0f;
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        WriteLe(file, bits, 4);
+    }
+    return static_cast<bool>(file);
+}
+
+boost::json::object RunRealtime(int seconds, bool* ok) {
+    SyntheticAudioCapture backend(SpeechConfig(true));
+    const AudioFormat format = backend.Format();
+    SpscRingBuffer<uint8_t> ring(format.FramesPer10Ms() * 20 * format.BytesPerFrame());
+    SpscRingBuffer<AudioTimestampAnchor> anchors(256);
+
+    std::vector<int64_t> latencies_us;
+    latencies_us.reserve(static_cast<size_t>(seconds) * 100 + 100);
+    uint64_t blocks = 0;
+    uint64_t untimed = 0;
+    AudioPump pump([&](const void*, const AudioFormat&, size_t, int64_t capture_us) {
+        if (++blocks <= kWarmupBlocks) {
+            return;
+        }
+        if (capture_us == 0) {
+            ++untimed;
+        }
+        else if (latencies_us.size() < latencies_us.capacity()) {
+            latencies_us.push_back(PacedAudioCapture::SteadyMicros() - capture_us);
+        }
+    });
+    pump.AddInput(&ring, format, &anchors);
+
+    std::atomic<bool> running = true;
+    backend.StartStream();
+    pump.Start();
+    std::thread capture([&] {
+        while (running) {
+            backend.WaitForPacket(kPacketWaitTimeoutMs);
+            backend.ReadPackets(&ring, &anchors);
+        }
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(kWarmupBlocks * 10));
+    const AudioPump::Stats warmup = pump.GetStats();
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    pump.Stop();
+    running = false;
+    capture.join();
+    backend.StopStream();
+
+    const AudioPump::Stats stats = pump.GetStats();
+    std::sort(latencies_us.begin(), latencies_us.end());
+    double mean_us = 0.0;
+    for (int64_t us : latencies_us) {
+        mean_us += static_cast<double>(us);
+    }
+    mean_us = latencies_us.empty() ? 0.0 : mean_us / latencies_us.size();
+
+    boost::json::object report;
+    report["seconds"] = seconds;
+    report["blocks"] = blocks > kWarmupBlocks ? blocks - kWarmupBlocks : 0;
+    report["underruns"] = stats.underruns - warmup.underruns;
+    report["untimed_blocks"] = untimed;
+    report["latency_us_mean"] = mean_us;
+    report["latency_us_p99"] = latencies_us.empty() ? 0
+        : latencies_us[std::min(latencies_us.size() * 99 / 100, latencies_us.size() - 1)];
+    std::cerr << "synthetic realtime: " << latencies_us.size() << " blocks, latency " << mean_us / 1000.0
+        << " ms mean" << std::endl;
+    if (latencies_us.empty() || untimed != 0 || stats.underruns != warmup.underruns) {
+        std::cerr << "FAILED: synthetic backend delivered " << latencies_us.size() << " timed blocks with "
+            << untimed << " untimed and " << stats.underruns - warmup.underruns << " underruns" << std::endl;
+        *ok = false;
+    }
+    return report;
+}
+
+boost::json::object RunReplay(const std::string& replay_file, bool* ok) {
+    boost::json::object report;
+    std::string path = replay_file;
+    std::vector<int16_t> expected;
+    if (path.empty()) {
+        SyntheticAudioCapture generator(SpeechConfig(false));
+        DrainAll(&generator, static_cast<size_t>(generator.Format().sample_rate) * kReplaySeconds, &expected);
+        std::vector<int16_t> again;
+        SyntheticAudioCapture twin(SpeechConfig(false));
+        DrainAll(&twin, expected.size() / 2, &again);
+        const bool deterministic = std::equal(again.begin(), again.end(), expected.begin());
+        report["deterministic"] = deterministic;
+        if (!deterministic) {
+            std::cerr << "FAILED: synthetic backend is not deterministic" << std::endl;
+            *ok = false;
+        }
+        path = (std::filesystem::temp_directory_path() / "audio_benchmark_replay.wav").string();
+        if (!WriteFloatWav(path, expected, generator.Format().sample_rate)) {
+            std::cerr << "FAILED: could not write " << path << std::endl;
+            *ok = false;
+            return report;
+        }
+    }
+
+    FileAudioCapture::Config config;
+    config.path = path;
+    config.loop = false;
+    config.pacing.realtime = false;
+    std::unique_ptr<FileAudioCapture> file = FileAudioCapture::Open(config);
+    if (!file) {
+        std::cerr << "FAILED: could not open " << path << std::endl;
+        *ok = false;
+        return report;
+    }
+    std::vector<int16_t> replayed;
+    const auto start = std::chrono::steady_clock::now();
+    DrainAll(file.get(), file->FileFrames(), &replayed);
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const double audio_seconds = static_cast<double>(replayed.size() / 2) / file->Format().sample_rate;
+
+    report["file_frames"] = file->FileFrames();
+    report["replayed_frames"] = replayed.size() / 2;
+    report["realtime_factor"] = elapsed > 0.0 ? audio_seconds / elapsed : 0.0;
+    std::cerr << "file replay: " << audio_seconds << " s of audio in " << elapsed * 1000.0 << " ms" << std::endl;
+    if (replayed.size() != file->FileFrames() * 2) {
+        std::cerr << "FAILED: replayed " << replayed.size() / 2 << " of " << file->FileFrames() << " frames" << std::endl;
+        *ok = false;
+    }
+    if (!expected.empty()) {
+        const bool matches = replayed == expected;
+        report["matches_source"] = matches;
+        if (!matches) {
+            std::cerr << "FAILED: replayed samples differ from the generated file" << std::endl;
+            *ok = false;
+        }
+        std::filesystem::remove(path);
+    }
+    return report;
+}
+
+} // namespace
+
+boost::json::object RunBackendBenchmark(int seconds, const std::string& replay_file, bool* ok) {
+    boost::json::object report;
+    report["synthetic_realtime"] = RunRealtime(seconds, ok);
+    report["file_replay"] = RunReplay(replay_file, ok);
+    return report;
+}
@@ -0,0 +1,14 @@
+// BackendBenchmark.h
+#pragma once
+#include <boost/json.hpp>
+#include <string>
+
+// Runs the capture pipeline on the headless backends. A real-time synthetic
+// speech source feeds an AudioPump through the same wait/drain loop
+// AudioCaptureSource uses, for `seconds`; capture-to-delivery latency and
+// underruns are reported. The generator must be deterministic, and a WAV
+// file replayed as fast as possible must come back sample for sample at
+// its replay rate. That is `replay_file` if given, else a float WAV the
+// generator writes to the temp directory. `ok` is cleared on underruns,
+// untimed blocks or any mismatch.
+boost::json::object RunBackendBenchmark(int seconds, const std::string& replay_file, bool* ok);
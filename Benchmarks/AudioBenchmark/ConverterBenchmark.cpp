@@ -0,0 +1,156 @@
+// ConverterBenchmark.cpp
+#include "ConverterBenchmark.h"
+#include "../../AudioConverter.h"
+#include "../../AudioLevel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr size_t kFrames = 480;    // 10 ms at 48 kHz
+constexpr size_t kChannels = 2;
+constexpr size_t kSamples = kFrames * kChannels;
+
+// Runs `kernel` `iterations` times and returns processed samples per second.
+double Throughput(const std::function<void()>& kernel, int iterations, size_t samples_per_call) {
+    kernel();  // Warm caches
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        kernel();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return seconds > 0.0 ? static_cast<double>(samples_per_call) * iterations / seconds : 0.0;
+}
+
+boost::json::object Result(const std::string& name, double scalar, double simd, bool matches) {
+    boost::json::object json;
+    json["converter"] = name;
+    json["scalar_msamples_per_s"] = scalar / 1e6;
+    json["simd_msamples_per_s"] = simd / 1e6;
+    json["speedup"] = scalar > 0.0 ? simd / scalar : 0.0;
+    json["matches_scalar"] = matches;
+    std::cerr << name << ": scalar " << scalar / 1e6 << " Msamples/s, simd " << simd / 1e6
+        << " Msamples/s" << (matches ? "" : " (MISMATCH)") << std::endl;
+    return json;
+}
+
+} // namespace
+
+boost::json::array RunConverterBenchmark(int iterations, bool* ok) {
+    std::mt19937 rng(7);
+    // Slightly beyond full scale so the saturation path is exercised.
+    std::uniform_real_distribution<float> floats(-1.2f, 1.2f);
+    std::vector<float> floatIn(kSamples);
+    for (float& sample : floatIn) {
+        sample = floats(rng);
+    }
+    std::vector<int32_t> s32In(kSamples);
+    for (int32_t& sample : s32In) {
+        sample = static_cast<int32_t>(rng()) & ~0xff;  // 24 valid bits
+    }
+    std::vector<int16_t> s16In(kSamples);
+    for (int16_t& sample : s16In) {
+        sample = static_cast<int16_t>(rng());
+    }
+    std::vector<int16_t> multichannelIn(kFrames * 6);
+    for (int16_t& sample : multichannelIn) {
+        sample = static_cast<int16_t>(rng());
+    }
+    std::vector<int16_t> scalarOut(kSamples);
+    std::vector<int16_t> simdOut(kSamples);
+
+    boost::json::array results;
+    auto compare = [&](size_t samples) {
+        const bool matches = std::equal(scalarOut.begin(), scalarOut.begin() + samples, simdOut.begin());
+        *ok = *ok && matches;
+        return matches;
+    };
+
+    {
+        double scalar = Throughput([&] { audio_convert::FloatToS16Scalar(floatIn.data(), scalarOut.data(), kSamples); }, iterations, kSamples);
+        double simd = Throughput([&] { audio_convert::FloatToS16(floatIn.data(), simdOut.data(), kSamples); }, iterations, kSamples);
+        results.push_back(Result("float32_to_s16", scalar, simd, compare(kSamples)));
+    }
+    {
+        double scalar = Throughput([&] { audio_convert::S32ToS16Scalar(s32In.data(), scalarOut.data(), kSamples); }, iterations, kSamples);
+        double simd = Throughput([&] { audio_convert::S32ToS16(s32In.data(), simdOut.data(), kSamples); }, iterations, kSamples);
+        results.push_back(Result("s24in32_to_s16", scalar, simd, compare(kSamples)));
+    }
+    {
+        double scalar = Throughput([&] { audio_convert::MonoToStereoScalar(s16In.data(), scalarOut.data(), kFrames); }, iterations, kSamples);
+        double simd = Throughput([&] { audio_convert::MonoToStereo(s16In.data(), simdOut.data(), kFrames); }, iterations, kSamples);
+        results.push_back(Result("mono_to_stereo", scalar, simd, compare(kSamples)));
+    }
+    {
+        double scalar = Throughput([&] { audio_convert::StereoToMonoScalar(s16In.data(), scalarOut.data(), kFrames); }, iterations, kSamples);
+        double simd = Throughput([&] { audio_convert::StereoToMono(s16In.data(), simdOut.data(), kFrames); }, iterations, kSamples);
+        results.push_back(Result("stereo_to_mono", scalar, simd, compare(kFrames)));
+    }
+    {
+        // Scalar only; reported in both columns so the table stays uniform.
+        double rate = Throughput([&] { audio_convert::DownmixToStereo(multichannelIn.data(), 6, scalarOut.data(), kFrames); }, iterations, kFrames * 6);
+        results.push_back(Result("5.1_to_stereo", rate, rate, true));
+    }
+    {
+        // Include full-scale negative samples, which the SIMD peak has to
+        // special-case.
+        s16In[kSamples / 3] = -32768;
+        BlockLevel scalarLevel;
+        BlockLevel simdLevel;
+        double scalar = Throughput([&] { audio_level::MeasureScalar(s16In.data(), kSamples, &scalarLevel); }, iterations, kSamples);
+        double simd = Throughput([&] { audio_level::Measure(s16In.data(), kSamples, &simdLevel); }, iterations, kSamples);
+        const bool matches = scalarLevel.peak == simdLevel.peak && scalarLevel.sum_squares == simdLevel.sum_squares;
+        *ok = *ok && matches;
+        results.push_back(Result("peak_rms", scalar, simd, matches));
+    }
+    return results;
+}
+
+boost::json::array RunMixBenchmark(int iterations, bool* ok) {
+    const size_t kMaxSources = 8;
+    std::mt19937 rng(11);
+    std::vector<std::vector<int16_t>> sources(kMaxSources, std::vector<int16_t>(kSamples));
+    for (auto& source : sources) {
+        for (int16_t& sample : source) {
+            sample = static_cast<int16_t>(rng());
+        }
+    }
+    std::vector<float> acc(kSamples);
+    std::vector<int16_t> scalarOut(kSamples);
+    std::vector<int16_t> simdOut(kSamples);
+
+    boost::json::array results;
+    for (size_t count : { size_t(2), size_t(4), size_t(8) }) {
+        // Unity gains on full-scale noise make the clamp do real work.
+        auto mix = [&](bool simd, int16_t* out) {
+            std::fill(acc.begin(), acc.end(), 0.0f);
+            for (size_t s = 0; s < count; ++s) {
+                if (simd) {
+                    audio_convert::AccumulateS16(sources[s].data(), 1.0f, acc.data(), kSamples);
+                }
+                else {
+                    audio_convert::AccumulateS16Scalar(sources[s].data(), 1.0f, acc.data(), kSamples);
+                }
+            }
+            if (simd) {
+                audio_convert::FloatToS16(acc.data(), out, kSamples);
+            }
+            else {
+                audio_convert::FloatToS16Scalar(acc.data(), out, kSamples);
+            }
+        };
+        double scalar = Throughput([&] { mix(false, scalarOut.data()); }, iterations, kSamples);
+        double simd = Throughput([&] { mix(true, simdOut.data()); }, iterations, kSamples);
+        const bool matches = scalarOut == simdOut;
+        *ok = *ok && matches;
+        results.push_back(Result("mix_" + std::to_string(count) + "_sources", scalar, simd, matches));
+    }
+    return results;
+}
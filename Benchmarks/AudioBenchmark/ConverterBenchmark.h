@@ -0,0 +1,14 @@
+// ConverterBenchmark.h
+#pragma once
+#include <boost/json.hpp>
+
+// Measures throughput of every audio_convert kernel and the audio_level
+// meter, scalar and SIMD, on 10 ms stereo blocks at 48 kHz. Returns one JSON
+// object per kernel variant with samples/s and the speed-up over scalar;
+// `ok` is cleared if a SIMD kernel's output differs from its scalar reference.
+boost::json::array RunConverterBenchmark(int iterations, bool* ok);
+
+// Measures mixing 2, 4 and 8 sources of 10 ms stereo blocks into one, scalar
+// and SIMD, the way AudioPump does: accumulate each source with its gain,
+// then clamp to int16. Rates count output samples.
+boost::json::array RunMixBenchmark(int iterations, bool* ok);
@@ -0,0 +1,514 @@
+// EncoderBenchmark.cpp
+// Runs the WebRTC encoders registered in main.cpp (VP8, VP9, OpenH264) and
+// libx264 through FrameEncoder over the synthetic screen scenarios at several
+// bitrates. Prints one JSON document with per-frame encode time (mean/p99),
+// bitrate accuracy and PSNR/SSIM so results can be diffed between builds.
+#include "ScreenScenarios.h"
+#include "../../Encoder.h"
+
+#include <api/environment/environment_factory.h>
+#include <api/video/video_frame.h>
+#include <api/video_codecs/sdp_video_format.h>
+#include <api/video_codecs/video_codec.h>
+#include <api/video_codecs/video_decoder.h>
+#include <api/video_codecs/video_encoder.h>
+#include "api/video_codecs/video_encoder_factory_template.h"
+#include "api/video_codecs/video_decoder_factory_template.h"
+#include "api/video_codecs/video_encoder_factory_template_libvpx_vp8_adapter.h"
+#include "api/video_codecs/video_encoder_factory_template_libvpx_vp9_adapter.h"
+#include "api/video_codecs/video_encoder_factory_template_open_h264_adapter.h"
+#include "api/video_codecs/video_decoder_factory_template_libvpx_vp8_adapter.h"
+#include "api/video_codecs/video_decoder_factory_template_libvpx_vp9_adapter.h"
+#include "api/video_codecs/video_decoder_factory_template_open_h264_adapter.h"
+#include <third_party/libyuv/include/libyuv/compare.h>
+#include <boost/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+}
+
+namespace {
+
+struct BenchmarkOptions {
+    int width = 1280;
+    int height = 720;
+    int frameRate = 30;
+    int frames = 300;
+    std::vector<int> bitratesKbps = { 300, 1000, 2500 };
+    std::vector<std::string> encoders = { "vp8", "vp9", "h264", "x264" };
+    std::vector<ScreenScenario> scenarios = { ScreenScenario::kTextTyping, ScreenScenario::kScrolling,
+        ScreenScenario::kVideoRegion, ScreenScenario::kSlides };
+    std::string output;
+};
+
+struct RunResult {
+    std::string encoder;
+    std::string scenario;
+    int targetKbps = 0;
+    int inputFrames = 0;
+    int encodedFrames = 0;
+    double meanEncodeMs = 0.0;
+    double p99EncodeMs = 0.0;
+    double actualKbps = 0.0;
+    double bitrateErrorPct = 0.0;
+    double psnr = 0.0;
+    double ssim = 0.0;
+    bool ok = false;
+};
+
+// Collects per-frame encode times, sizes and decoded quality for one run.
+class RunStats {
+public:
+    void AddEncodeTime(double ms) { encodeMs_.push_back(ms); }
+    void AddEncodedBytes(size_t bytes) { bytes_ += bytes; ++encodedFrames_; }
+
+    void AddQuality(const webrtc::I420BufferInterface& reference, const webrtc::I420BufferInterface& decoded) {
+        if (reference.width() != decoded.width() || reference.height() != decoded.height()) {
+            return;
+        }
+        psnrSum_ += libyuv::I420Psnr(reference.DataY(), reference.StrideY(), reference.DataU(), reference.StrideU(),
+            reference.DataV(), reference.StrideV(), decoded.DataY(), decoded.StrideY(), decoded.DataU(),
+            decoded.StrideU(), decoded.DataV(), decoded.StrideV(), reference.width(), reference.height());
+        ssimSum_ += libyuv::I420Ssim(reference.DataY(), reference.StrideY(), reference.DataU(), reference.StrideU(),
+            reference.DataV(), reference.StrideV(), decoded.DataY(), decoded.StrideY(), decoded.DataU(),
+            decoded.StrideU(), decoded.DataV(), decoded.StrideV(), reference.width(), reference.height());
+        ++qualitySamples_;
+    }
+
+    void Fill(const BenchmarkOptions& options, int targetKbps, RunResult* result) {
+        result->targetKbps = targetKbps;
+        result->inputFrames = options.frames;
+        result->encodedFrames = encodedFrames_;
+        if (!encodeMs_.empty()) {
+            double sum = 0.0;
+            for (double ms : encodeMs_) {
+                sum += ms;
+            }
+            result->meanEncodeMs = sum / encodeMs_.size();
+            std::sort(encodeMs_.begin(), encodeMs_.end());
+            size_t index = static_cast<size_t>(std::ceil(0.99 * encodeMs_.size())) - 1;
+            result->p99EncodeMs = encodeMs_[std::min(index, encodeMs_.size() - 1)];
+        }
+        const double seconds = static_cast<double>(options.frames) / options.frameRate;
+        result->actualKbps = bytes_ * 8.0 / seconds / 1000.0;
+        result->bitrateErrorPct = 100.0 * (result->actualKbps - targetKbps) / targetKbps;
+        if (qualitySamples_) {
+            result->psnr = psnrSum_ / qualitySamples_;
+            result->ssim = ssimSum_ / qualitySamples_;
+        }
+    }
+
+private:
+    std::vector<double> encodeMs_;
+    size_t bytes_ = 0;
+    int encodedFrames_ = 0;
+    double psnrSum_ = 0.0;
+    double ssimSum_ = 0.0;
+    int qualitySamples_ = 0;
+};
+
+double ElapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Encoders from the same factory template main.cpp hands to WebRTC. Every
+// encoded image is decoded after its frame's encode time is taken, to
+// measure quality.
+class WebRtcEncoderRun : public webrtc::EncodedImageCallback, public webrtc::DecodedImageCallback {
+public:
+    WebRtcEncoderRun(const BenchmarkOptions& options, const std::string& sdpName, webrtc::VideoCodecType type)
+        : options_(options), sdpName_(sdpName), type_(type) {
+    }
+
+    bool Run(ScreenScenario scenario, int targetKbps, RunResult* result) {
+        const webrtc::Environment env = webrtc::CreateEnvironment();
+        webrtc::VideoEncoderFactoryTemplate<
+            webrtc::LibvpxVp9EncoderTemplateAdapter,
+            webrtc::OpenH264EncoderTemplateAdapter,
+            webrtc::LibvpxVp8EncoderTemplateAdapter> encoderFactory;
+        webrtc::VideoDecoderFactoryTemplate<
+            webrtc::LibvpxVp9DecoderTemplateAdapter,
+            webrtc::OpenH264DecoderTemplateAdapter,
+            webrtc::LibvpxVp8DecoderTemplateAdapter> decoderFactory;
+
+        std::unique_ptr<webrtc::VideoEncoder> encoder = encoderFactory.Create(env, webrtc::SdpVideoFormat(sdpName_));
+        std::unique_ptr<webrtc::VideoDecoder> decoder = decoderFactory.Create(env, webrtc::SdpVideoFormat(sdpName_));
+        if (!encoder || !decoder) {
+            std::cerr << "Codec " << sdpName_ << " not available" << std::endl;
+            return false;
+        }
+
+        webrtc::VideoCodec codec = CodecSettings(targetKbps);
+        webrtc::VideoEncoder::Settings settings(webrtc::VideoEncoder::Capabilities(false), 1, 1200);
+        if (encoder->InitEncode(&codec, settings) != WEBRTC_VIDEO_CODEC_OK) {
+            std::cerr << "InitEncode failed for " << sdpName_ << std::endl;
+            return false;
+        }
+        encoder->RegisterEncodeCompleteCallback(this);
+
+        webrtc::VideoBitrateAllocation allocation;
+        allocation.SetBitrate(0, 0, targetKbps * 1000);
+        encoder->SetRates(webrtc::VideoEncoder::RateControlParameters(allocation, options_.frameRate));
+
+        webrtc::VideoDecoder::Settings decoderSettings;
+        decoderSettings.set_codec_type(type_);
+        decoderSettings.set_max_render_resolution({ options_.width, options_.height });
+        decoderSettings.set_number_of_cores(1);
+        if (!decoder->Configure(decoderSettings)) {
+            std::cerr << "Decoder configuration failed for " << sdpName_ << std::endl;
+            return false;
+        }
+        decoder->RegisterDecodeCompleteCallback(this);
+        decoder_ = decoder.get();
+
+        ScenarioGenerator generator(scenario, options_.width, options_.height, options_.frameRate);
+        const uint32_t rtpPerFrame = 90000 / options_.frameRate;
+        for (int i = 0; i < options_.frames; ++i) {
+            source_ = generator.Frame(i);
+            webrtc::VideoFrame frame = webrtc::VideoFrame::Builder()
+                .set_video_frame_buffer(source_)
+                .set_rtp_timestamp(i * rtpPerFrame)
+                .set_timestamp_us(static_cast<int64_t>(i) * 1000000 / options_.frameRate)
+                .build();
+            std::vector<webrtc::VideoFrameType> types = {
+                i == 0 ? webrtc::VideoFrameType::kVideoFrameKey : webrtc::VideoFrameType::kVideoFrameDelta };
+
+            auto start = std::chrono::steady_clock::now();
+            encoder->Encode(frame, &types);
+            stats_.AddEncodeTime(ElapsedMs(start));
+            DecodePending();
+        }
+        encoder->Release();
+        decoder->Release();
+        decoder_ = nullptr;
+
+        stats_.Fill(options_, targetKbps, result);
+        return true;
+    }
+
+    Result OnEncodedImage(const webrtc::EncodedImage& image, const webrtc::CodecSpecificInfo*) override {
+        // Runs inside Encode(), i.e. inside the timed region: only keep a
+        // copy and leave decoding and scoring to DecodePending().
+        stats_.AddEncodedBytes(image.size());
+        PendingImage pending{ image, source_ };
+        pending.image.SetEncodedData(webrtc::EncodedImageBuffer::Create(image.data(), image.size()));
+        pending_.push_back(std::move(pending));
+        return Result(Result::OK, image.RtpTimestamp());
+    }
+
+    int32_t Decoded(webrtc::VideoFrame& decodedImage) override {
+        // libvpx and OpenH264 decode synchronously, so the source of the
+        // image being decoded is the reference.
+        webrtc::scoped_refptr<webrtc::I420BufferInterface> decoded = decodedImage.video_frame_buffer()->ToI420();
+        if (decoded && reference_) {
+            stats_.AddQuality(*reference_, *decoded);
+        }
+        return WEBRTC_VIDEO_CODEC_OK;
+    }
+
+private:
+    struct PendingImage {
+        webrtc::EncodedImage image;
+        webrtc::scoped_refptr<webrtc::I420Buffer> source;
+    };
+
+    void DecodePending() {
+        for (PendingImage& pending : pending_) {
+            reference_ = pending.source;
+            if (decoder_) {
+                decoder_->Decode(pending.image, 0);
+            }
+        }
+        pending_.clear();
+        reference_ = nullptr;
+    }
+
+    webrtc::VideoCodec CodecSettings(int targetKbps) const {
+        webrtc::VideoCodec codec;
+        codec.codecType = type_;
+        codec.width = options_.width;
+        codec.height = options_.height;
+        codec.startBitrate = targetKbps;
+        codec.maxBitrate = targetKbps * 2;
+        codec.minBitrate = std::min(30, targetKbps);
+        codec.maxFramerate = options_.frameRate;
+        codec.qpMax = 56;
+        codec.mode = webrtc::VideoCodecMode::kScreensharing;
+        codec.SetScalabilityMode(webrtc::ScalabilityMode::kL1T1);
+        switch (type_) {
+        case webrtc::kVideoCodecVP8:
+            *codec.VP8() = webrtc::VideoEncoder::GetDefaultVp8Settings();
+            break;
+        case webrtc::kVideoCodecVP9:
+            *codec.VP9() = webrtc::VideoEncoder::GetDefaultVp9Settings();
+            codec.VP9()->numberOfSpatialLayers = 1;
+            codec.spatialLayers[0].width = options_.width;
+            codec.spatialLayers[0].height = options_.height;
+            codec.spatialLayers[0].maxFramerate = options_.frameRate;
+            codec.spatialLayers[0].numberOfTemporalLayers = 1;
+            codec.spatialLayers[0].minBitrate = codec.minBitrate;
+            codec.spatialLayers[0].targetBitrate = targetKbps;
+            codec.spatialLayers[0].maxBitrate = codec.maxBitrate;
+            codec.spatialLayers[0].active = true;
+            break;
+        case webrtc::kVideoCodecH264:
+            *codec.H264() = webrtc::VideoEncoder::GetDefaultH264Settings();
+            break;
+        default:
+            break;
+        }
+        return codec;
+    }
+
+    const BenchmarkOptions& options_;
+    std::string sdpName_;
+    webrtc::VideoCodecType type_;
+    webrtc::VideoDecoder* decoder_ = nullptr;
+    webrtc::scoped_refptr<webrtc::I420Buffer> source_;
+    webrtc::scoped_refptr<webrtc::I420Buffer> reference_;
+    std::deque<PendingImage> pending_;
+    RunStats stats_;
+};
+
+// libx264 through our own FrameEncoder, decoded with FFmpeg's H.264 decoder.
+class X264EncoderRun {
+public:
+    explicit X264EncoderRun(const BenchmarkOptions& options) : options_(options) {}
+
+    bool Run(ScreenScenario scenario, int targetKbps, RunResult* result) {
+        FrameEncoder encoder;
+        encoder.SetWidth(options_.width);
+        encoder.SetHeight(options_.height);
+        encoder.SetFrameRate(options_.frameRate);
+        encoder.SetBitRate(targetKbps * 1000);
+
+        // Open() starts text-tuned; a motion scenario switches on its first
+        // frame. Warm both contexts so neither open lands in the timed loop.
+        EncoderConfig config = encoder.Config();
+        EncoderPool::GetInstance().Warm(config, 1);
+        config.contentMode = scenario == ScreenScenario::kVideoRegion ? ContentType::kMotion : ContentType::kText;
+        EncoderPool::GetInstance().Warm(config, 1);
+
+        encoder.SetContentMode(config.contentMode);
+        if (!encoder.Open()) {
+            return false;
+        }
+
+        const AVCodec* h264 = avcodec_find_decoder(AV_CODEC_ID_H264);
+        AVCodecContext* decoder = h264 ? avcodec_alloc_context3(h264) : nullptr;
+        if (!decoder) {
+            std::cerr << "H.264 decoder not available" << std::endl;
+            return false;
+        }
+        decoder->flags |= AV_CODEC_FLAG_LOW_DELAY;
+        if (avcodec_open2(decoder, h264, nullptr) < 0) {
+            avcodec_free_context(&decoder);
+            return false;
+        }
+
+        AVFrame* input = av_frame_alloc();
+        AVFrame* decoded = av_frame_alloc();
+        AVPacket* packet = av_packet_alloc();
+        ScenarioGenerator generator(scenario, options_.width, options_.height, options_.frameRate);
+
+        // FrameEncoder tunes x264 for zero latency, so every input frame
+        // yields its packet immediately and no flush pass is needed.
+        for (int i = 0; i < options_.frames; ++i) {
+            webrtc::scoped_refptr<webrtc::I420Buffer> source = generator.Frame(i);
+            sources_[i] = source;
+            // Wrap the I420 planes; FrameEncoder only reads them.
+            input->format = AV_PIX_FMT_YUV420P;
+            input->width = options_.width;
+            input->height = options_.height;
+            input->data[0] = source->MutableDataY();
+            input->data[1] = source->MutableDataU();
+            input->data[2] = source->MutableDataV();
+            input->linesize[0] = source->StrideY();
+            input->linesize[1] = source->StrideU();
+            input->linesize[2] = source->StrideV();
+            input->pts = i;
+
+            auto start = std::chrono::steady_clock::now();
+            bool gotPacket = encoder.EncodeFrame(input, packet);
+            stats_.AddEncodeTime(ElapsedMs(start));
+            if (gotPacket) {
+                stats_.AddEncodedBytes(packet->size);
+                Decode(decoder, packet, decoded);
+                av_packet_unref(packet);
+            }
+        }
+
+        av_packet_free(&packet);
+        av_frame_free(&decoded);
+        av_frame_free(&input);
+        avcodec_free_context(&decoder);
+        sources_.clear();
+
+        stats_.Fill(options_, targetKbps, result);
+        return true;
+    }
+
+private:
+    void Decode(AVCodecContext* decoder, const AVPacket* packet, AVFrame* decoded) {
+        if (avcodec_send_packet(decoder, packet) < 0) {
+            return;
+        }
+        while (avcodec_receive_frame(decoder, decoded) == 0) {
+            auto it = sources_.find(decoded->pts);
+            if (it != sources_.end()) {
+                webrtc::scoped_refptr<webrtc::I420Buffer> copy = webrtc::I420Buffer::Copy(
+                    decoded->width, decoded->height, decoded->data[0], decoded->linesize[0],
+                    decoded->data[1], decoded->linesize[1], decoded->data[2], decoded->linesize[2]);
+                stats_.AddQuality(*it->second, *copy);
+                sources_.erase(sources_.begin(), std::next(it));
+            }
+            av_frame_unref(decoded);
+        }
+    }
+
+    const BenchmarkOptions& options_;
+    std::map<int64_t, webrtc::scoped_refptr<webrtc::I420Buffer>> sources_;
+    RunStats stats_;
+};
+
+std::vector<std::string> Split(const std::string& value) {
+    std::vector<std::string> parts;
+    std::stringstream stream(value);
+    std::string part;
+    while (std::getline(stream, part, ',')) {
+        if (!part.empty()) {
+            parts.push_back(part);
+        }
+    }
+    return parts;
+}
+
+bool ParseOptions(int argc, char** argv, BenchmarkOptions* options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--width") options->width = std::stoi(value);
+        else if (arg == "--height") options->height = std::stoi(value);
+        else if (arg == "--fps") options->frameRate = std::stoi(value);
+        else if (arg == "--frames") options->frames = std::stoi(value);
+        else if (arg == "--output") options->output = value;
+        else if (arg == "--encoders") options->encoders = Split(value);
+        else if (arg == "--bitrates") {
+            options->bitratesKbps.clear();
+            for (const std::string& kbps : Split(value)) {
+                options->bitratesKbps.push_back(std::stoi(kbps));
+            }
+        }
+        else if (arg == "--scenarios") {
+            options->scenarios.clear();
+            for (const std::string& name : Split(value)) {
+                ScreenScenario scenario;
+                if (!ParseScenario(name, &scenario)) {
+                    std::cerr << "Unknown scenario: " << name << std::endl;
+                    return false;
+                }
+                options->scenarios.push_back(scenario);
+            }
+        }
+        else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+boost::json::object ToJson(const RunResult& result) {
+    boost::json::object json;
+    json["encoder"] = result.encoder;
+    json["scenario"] = result.scenario;
+    json["ok"] = result.ok;
+    json["target_kbps"] = result.targetKbps;
+    json["input_frames"] = result.inputFrames;
+    json["encoded_frames"] = result.encodedFrames;
+    json["encode_ms_mean"] = result.meanEncodeMs;
+    json["encode_ms_p99"] = result.p99EncodeMs;
+    json["actual_kbps"] = result.actualKbps;
+    json["bitrate_error_pct"] = result.bitrateErrorPct;
+    json["psnr_db"] = result.psnr;
+    json["ssim"] = result.ssim;
+    return json;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    BenchmarkOptions options;
+    if (!ParseOptions(argc, argv, &options)) {
+        std::cerr << "Usage: EncoderBenchmark [--width W] [--height H] [--fps N] [--frames N]"
+            " [--bitrates kbps,...] [--encoders vp8,vp9,h264,x264]"
+            " [--scenarios text_typing,scrolling,video_region,slides] [--output file.json]" << std::endl;
+        return 2;
+    }
+
+    boost::json::array results;
+    bool allOk = true;
+    for (const std::string& encoderName : options.encoders) {
+        for (ScreenScenario scenario : options.scenarios) {
+            for (int kbps : options.bitratesKbps) {
+                RunResult result;
+                result.encoder = encoderName;
+                result.scenario = ScenarioName(scenario);
+                if (encoderName == "vp8") {
+                    result.ok = WebRtcEncoderRun(options, "VP8", webrtc::kVideoCodecVP8).Run(scenario, kbps, &result);
+                }
+                else if (encoderName == "vp9") {
+                    result.ok = WebRtcEncoderRun(options, "VP9", webrtc::kVideoCodecVP9).Run(scenario, kbps, &result);
+                }
+                else if (encoderName == "h264") {
+                    result.ok = WebRtcEncoderRun(options, "H264", webrtc::kVideoCodecH264).Run(scenario, kbps, &result);
+                }
+                else if (encoderName == "x264") {
+                    result.ok = X264EncoderRun(options).Run(scenario, kbps, &result);
+                }
+                else {
+                    std::cerr << "Unknown encoder: " << encoderName << std::endl;
+                }
+                allOk = allOk && result.ok;
+                std::cerr << result.encoder << " " << result.scenario << " " << kbps << " kbps: "
+                    << result.meanEncodeMs << " ms/frame, " << result.actualKbps << " kbps, "
+                    << result.psnr << " dB" << std::endl;
+                results.push_back(ToJson(result));
+            }
+        }
+    }
+
+    boost::json::object report;
+    report["benchmark"] = "encoder";
+    report["width"] = options.width;
+    report["height"] = options.height;
+    report["frame_rate"] = options.frameRate;
+    report["frames"] = options.frames;
+    report["results"] = std::move(results);
+
+    const std::string json = boost::json::serialize(report);
+    if (options.output.empty()) {
+        std::cout << json << std::endl;
+    }
+    else {
+        std::ofstream(options.output) << json << std::endl;
+    }
+    return allOk ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+// ScreenScenarios.cpp
+#include "ScreenScenarios.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+uint32_t Hash(uint32_t a, uint32_t b, uint32_t c) {
+    uint32_t h = a * 0x9E3779B1u ^ (b + 0x7F4A7C15u) * 0x85EBCA77u ^ (c + 0x165667B1u) * 0xC2B2AE3Du;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return h;
+}
+}
+
+const char* ScenarioName(ScreenScenario scenario) {
+    switch (scenario) {
+    case ScreenScenario::kTextTyping: return "text_typing";
+    case ScreenScenario::kScrolling: return "scrolling";
+    case ScreenScenario::kVideoRegion: return "video_region";
+    case ScreenScenario::kSlides: return "slides";
+    default: return "unknown";
+    }
+}
+
+bool ParseScenario(const std::string& name, ScreenScenario* scenario) {
+    for (ScreenScenario candidate : { ScreenScenario::kTextTyping, ScreenScenario::kScrolling,
+        ScreenScenario::kVideoRegion, ScreenScenario::kSlides }) {
+        if (name == ScenarioName(candidate)) {
+            *scenario = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+ScenarioGenerator::ScenarioGenerator(ScreenScenario scenario, int width, int height, int frame_rate)
+    : scenario_(scenario), width_(width), height_(height), frame_rate_(frame_rate) {
+}
+
+webrtc::scoped_refptr<webrtc::I420Buffer> ScenarioGenerator::Frame(int index) {
+    webrtc::scoped_refptr<webrtc::I420Buffer> buffer = webrtc::I420Buffer::Create(width_, height_);
+    Clear(buffer.get());
+
+    const int64_t full_page = static_cast<int64_t>(width_ / kGlyphWidth) * (height_ / kGlyphHeight);
+    switch (scenario_) {
+    case ScreenScenario::kTextTyping:
+        // Start with a partly filled page so there is something to keep sharp.
+        DrawPage(buffer.get(), 1, 0, full_page / 3 + index);
+        break;
+    case ScreenScenario::kScrolling:
+        DrawPage(buffer.get(), 2, index * 4, full_page * 4);
+        break;
+    case ScreenScenario::kVideoRegion:
+        DrawPage(buffer.get(), 3, 0, full_page);
+        DrawVideoRegion(buffer.get(), index);
+        break;
+    case ScreenScenario::kSlides:
+        DrawPage(buffer.get(), 100 + index / (2 * frame_rate_), 0, full_page / 2);
+        break;
+    }
+    return buffer;
+}
+
+void ScenarioGenerator::Clear(webrtc::I420Buffer* buffer) {
+    for (int y = 0; y < height_; ++y) {
+        std::memset(buffer->MutableDataY() + y * buffer->StrideY(), kBackgroundY, width_);
+    }
+    for (int y = 0; y < buffer->ChromaHeight(); ++y) {
+        std::memset(buffer->MutableDataU() + y * buffer->StrideU(), 128, buffer->ChromaWidth());
+        std::memset(buffer->MutableDataV() + y * buffer->StrideV(), 128, buffer->ChromaWidth());
+    }
+}
+
+void ScenarioGenerator::DrawPage(webrtc::I420Buffer* buffer, uint32_t seed, int scroll_px, int64_t visible_glyphs) {
+    const int columns = width_ / kGlyphWidth;
+    for (int y = 0; y < height_; ++y) {
+        const int page_y = y + scroll_px;
+        const int line = page_y / kGlyphHeight;
+        const int glyph_row = page_y % kGlyphHeight;
+        // 5x7 glyph cell with padding: rows 4..11 hold ink.
+        if (glyph_row < 4 || glyph_row >= 11) {
+            continue;
+        }
+        uint8_t* row = buffer->MutableDataY() + y * buffer->StrideY();
+        for (int column = 0; column < columns; ++column) {
+            if (static_cast<int64_t>(line) * columns + column >= visible_glyphs) {
+                break;
+            }
+            const uint32_t glyph = Hash(seed, line, column);
+            // Short lines and word gaps, like real text.
+            const int line_length = 20 + static_cast<int>(Hash(seed, line, 0) % std::max(1, columns - 20));
+            if (column > line_length || glyph % 6 == 0) {
+                continue;
+            }
+            const uint32_t bits = Hash(glyph % 96, 0, 0);
+            const int bit_row = glyph_row - 4;
+            for (int bit = 0; bit < 5; ++bit) {
+                if (bits & (1u << (bit_row * 5 + bit) % 32)) {
+                    row[column * kGlyphWidth + 1 + bit] = kInkY;
+                }
+            }
+        }
+    }
+}
+
+void ScenarioGenerator::DrawVideoRegion(webrtc::I420Buffer* buffer, int index) {
+    const int region_x = width_ / 4 & ~1;
+    const int region_y = height_ / 4 & ~1;
+    const int region_w = width_ / 2 & ~1;
+    const int region_h = height_ / 2 & ~1;
+    const double t = static_cast<double>(index);
+    for (int y = 0; y < region_h; ++y) {
+        uint8_t* row = buffer->MutableDataY() + (region_y + y) * buffer->StrideY() + region_x;
+        for (int x = 0; x < region_w; ++x) {
+            const double wave = std::sin(x * 0.05 + t * 0.3) * std::cos(y * 0.04 - t * 0.2);
+            const int noise = static_cast<int>(Hash(index, x, y) % 9) - 4;
+            row[x] = static_cast<uint8_t>(std::lround(128 + 90 * wave) + noise);
+        }
+    }
+    for (int y = 0; y < region_h / 2; ++y) {
+        uint8_t* u = buffer->MutableDataU() + (region_y / 2 + y) * buffer->StrideU() + region_x / 2;
+        uint8_t* v = buffer->MutableDataV() + (region_y / 2 + y) * buffer->StrideV() + region_x / 2;
+        for (int x = 0; x < region_w / 2; ++x) {
+            u[x] = static_cast<uint8_t>(128 + 40 * std::sin(x * 0.07 + t * 0.1));
+            v[x] = static_cast<uint8_t>(128 + 40 * std::cos(y * 0.09 - t * 0.15));
+        }
+    }
+}
@@ -0,0 +1,41 @@
+// ScreenScenarios.h
+#pragma once
+#include <api/video/i420_buffer.h>
+#include <cstdint>
+#include <string>
+
+// Synthetic screen content used to compare encoders on our workload. All
+// scenarios are deterministic so results are comparable across builds.
+enum class ScreenScenario {
+    kTextTyping,   // Static page, one glyph appears per frame
+    kScrolling,    // Text page scrolling by a few pixels per frame
+    kVideoRegion,  // Static page with a full-motion region in the middle
+    kSlides        // Static slides that switch every two seconds
+};
+
+const char* ScenarioName(ScreenScenario scenario);
+bool ParseScenario(const std::string& name, ScreenScenario* scenario);
+
+class ScenarioGenerator {
+public:
+    ScenarioGenerator(ScreenScenario scenario, int width, int height, int frame_rate);
+
+    // Renders frame `index` of the scenario.
+    webrtc::scoped_refptr<webrtc::I420Buffer> Frame(int index);
+
+private:
+    static constexpr int kGlyphWidth = 8;
+    static constexpr int kGlyphHeight = 16;
+    static constexpr uint8_t kBackgroundY = 235;
+    static constexpr uint8_t kInkY = 16;
+
+    void Clear(webrtc::I420Buffer* buffer);
+    // Draws a text page; glyphs past `visible_glyphs` are left blank.
+    void DrawPage(webrtc::I420Buffer* buffer, uint32_t seed, int scroll_px, int64_t visible_glyphs);
+    void DrawVideoRegion(webrtc::I420Buffer* buffer, int index);
+
+    ScreenScenario scenario_;
+    int width_;
+    int height_;
+    int frame_rate_;
+};
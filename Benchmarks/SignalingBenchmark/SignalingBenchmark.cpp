@@ -0,0 +1,537 @@
+// SignalingBenchmark.cpp
+// Drives the signaling path against StandInServer, a local Boost.Beast
+// server, so no signaling server or network is needed.
+// The "send" suite has --producers threads queue --messages messages of
+// --message-bytes each (ICE candidates are ~300 bytes) as fast as they can,
+// like the WebRTC signaling thread does while candidates are gathered for
+// many consumers. It reports throughput, how the client coalesced the
+// burst into write batches, and heap allocations per message. The run
+// fails if a message is lost, fails or arrives out of order.
+// The "parse" suite feeds the message mix of --iterations subscribe
+// cycles through SignalingMessageParser and the field reads the handlers
+// do, next to the old copy-and-parse path for reference. After a warm-up
+// cycle the parser path must not allocate.
+// The "registry" suite has --threads threads run consumer lifecycles
+// (insert, lookups per message, erase) against the sharded consumer
+// registry and against a single-lock one, and compares throughput.
+#include "StandInServer.h"
+#include "../../ShardedRegistry.h"
+#include "../../SignalingMessage.h"
+#include "../../WebSocketClient.h"
+#include <boost/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::atomic<bool> g_countAllocations = false;
+std::atomic<uint64_t> g_allocations = 0;
+std::atomic<uint64_t> g_allocatedBytes = 0;
+
+void* CountedAlloc(size_t size, size_t alignment) {
+    if (g_countAllocations.load(std::memory_order_relaxed)) {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+        g_allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    if (size == 0) {
+        size = 1;
+    }
+#ifdef _WIN32
+    void* p = alignment ? _aligned_malloc(size, alignment) : std::malloc(size);
+#else
+    void* p = alignment ? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment) : std::malloc(size);
+#endif
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void CountedFree(void* p, bool aligned) {
+#ifdef _WIN32
+    if (aligned) {
+        _aligned_free(p);
+        return;
+    }
+#endif
+    (void)aligned;
+    std::free(p);
+}
+
+} // namespace
+
+void* operator new(size_t size) { return CountedAlloc(size, 0); }
+void* operator new[](size_t size) { return CountedAlloc(size, 0); }
+void* operator new(size_t size, std::align_val_t align) { return CountedAlloc(size, static_cast<size_t>(align)); }
+void* operator new[](size_t size, std::align_val_t align) { return CountedAlloc(size, static_cast<size_t>(align)); }
+void operator delete(void* p) noexcept { CountedFree(p, false); }
+void operator delete[](void* p) noexcept { CountedFree(p, false); }
+void operator delete(void* p, size_t) noexcept { CountedFree(p, false); }
+void operator delete[](void* p, size_t) noexcept { CountedFree(p, false); }
+void operator delete(void* p, std::align_val_t) noexcept { CountedFree(p, true); }
+void operator delete[](void* p, std::align_val_t) noexcept { CountedFree(p, true); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { CountedFree(p, true); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { CountedFree(p, true); }
+
+namespace {
+
+const auto kConnectTimeout = std::chrono::seconds(5);
+const auto kDeliveryTimeout = std::chrono::seconds(30);
+
+const double kMaxParseAllocationsPerMessage = 0.01;
+const int kCandidatesPerConsumer = 8;
+
+struct BenchmarkOptions {
+    int messages = 20000;
+    int messageBytes = 300;
+    int producers = 1;
+    int parseIterations = 5000;
+    int threads = 8;
+    int registryCycles = 20000;
+    std::vector<std::string> suites = { "send", "parse", "registry" };
+    std::string output;
+};
+
+std::vector<std::string> Split(const std::string& list) {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) {
+            comma = list.size();
+        }
+        if (comma > start) {
+            parts.push_back(list.substr(start, comma - start));
+        }
+        start = comma + 1;
+    }
+    return parts;
+}
+
+bool ParseOptions(int argc, char** argv, BenchmarkOptions* options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--messages") options->messages = std::stoi(value);
+        else if (arg == "--message-bytes") options->messageBytes = std::stoi(value);
+        else if (arg == "--producers") options->producers = std::stoi(value);
+        else if (arg == "--iterations") options->parseIterations = std::stoi(value);
+        else if (arg == "--threads") options->threads = std::stoi(value);
+        else if (arg == "--registry-cycles") options->registryCycles = std::stoi(value);
+        else if (arg == "--suites") options->suites = Split(value);
+        else if (arg == "--output") options->output = value;
+        else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+    }
+    return options->messages > 0 && options->messageBytes >= 64 && options->producers > 0 &&
+        options->parseIterations > 0 && options->threads > 0 && options->registryCycles > 0;
+}
+
+// Reads the unsigned number following `key` in a message built by
+// MakeMessage().
+uint64_t FieldValue(std::string_view message, std::string_view key) {
+    const size_t at = message.find(key);
+    uint64_t value = 0;
+    for (size_t i = at == std::string_view::npos ? message.size() : at + key.size();
+        i < message.size() && message[i] >= '0' && message[i] <= '9'; ++i) {
+        value = value * 10 + (message[i] - '0');
+    }
+    return value;
+}
+
+// An ice-candidate message padded to `bytes`, tagged with its producer and
+// sequence number so the server can check ordering.
+std::string MakeMessage(int producer, int seq, int bytes) {
+    std::string message = "{\"type\":\"ice-candidate\",\"target\":" + std::to_string(producer) +
+        ",\"seq\":" + std::to_string(seq) + ",\"candidate\":{\"candidate\":\"";
+    const size_t tail = 3;
+    message.append(std::max<size_t>(bytes, message.size() + tail) - message.size() - tail, 'x');
+    message += "\"}}";
+    return message;
+}
+
+boost::json::object RunSendBenchmark(const BenchmarkOptions& options, bool* ok) {
+    // Only the server thread touches the sequence state.
+    std::vector<uint64_t> nextSeq(options.producers, 0);
+    uint64_t outOfOrder = 0;
+    StandInServer server([&](size_t, std::string_view message) {
+        const uint64_t producer = FieldValue(message, "\"target\":");
+        const uint64_t seq = FieldValue(message, "\"seq\":");
+        if (producer >= nextSeq.size() || seq != nextSeq[producer]++) {
+            ++outOfOrder;
+        }
+    });
+
+    net::io_context ioc;
+    auto work = net::make_work_guard(ioc);
+    std::thread ioThread([&] { ioc.run(); });
+
+    std::promise<void> connected;
+    std::promise<void> disconnected;
+    auto client = std::make_shared<WebSocketClient>(ioc, "127.0.0.1", std::to_string(server.Port()), "/");
+    client->Connect([](std::string_view) {}, [&](WebSocketClient::ConnectionState state) {
+        if (state == WebSocketClient::ConnectionState::CONNECTED) {
+            connected.set_value();
+        }
+        else if (state == WebSocketClient::ConnectionState::DISCONNECTED) {
+            disconnected.set_value();
+        }
+    });
+
+    boost::json::object report;
+    if (connected.get_future().wait_for(kConnectTimeout) != std::future_status::ready) {
+        std::cerr << "FAILED: could not connect to the stand-in server" << std::endl;
+        *ok = false;
+        work.reset();
+        ioc.stop();
+        ioThread.join();
+        return report;
+    }
+
+    std::atomic<uint64_t> failed = 0;
+    const auto onStatus = [&failed](const std::string&, WebSocketClient::MessageStatus status) {
+        if (status == WebSocketClient::MessageStatus::FAILED || status == WebSocketClient::MessageStatus::CANCELLED) {
+            ++failed;
+        }
+    };
+
+    const WebSocketClient::Stats before = client->GetStats();
+    g_allocations = 0;
+    g_allocatedBytes = 0;
+    g_countAllocations = true;
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> producers;
+    for (int p = 0; p < options.producers; ++p) {
+        const int count = options.messages / options.producers + (p < options.messages % options.producers);
+        producers.emplace_back([&, p, count] {
+            for (int i = 0; i < count; ++i) {
+                client->Send(MakeMessage(p, i, options.messageBytes), onStatus);
+            }
+        });
+    }
+    for (std::thread& producer : producers) {
+        producer.join();
+    }
+    const auto queued = std::chrono::steady_clock::now();
+    const bool delivered = server.WaitForMessages(options.messages, kDeliveryTimeout);
+    const auto end = std::chrono::steady_clock::now();
+    g_countAllocations = false;
+    const WebSocketClient::Stats stats = client->GetStats();
+
+    client->Disconnect();
+    disconnected.get_future().wait_for(kConnectTimeout);
+    work.reset();
+    ioThread.join();
+
+    const double seconds = std::chrono::duration<double>(end - start).count();
+    const uint64_t batches = stats.write_batches - before.write_batches;
+    report["messages"] = options.messages;
+    report["message_bytes"] = options.messageBytes;
+    report["producers"] = options.producers;
+    report["queue_ms"] = std::chrono::duration<double, std::milli>(queued - start).count();
+    report["seconds"] = seconds;
+    report["messages_per_second"] = options.messages / seconds;
+    report["megabytes_per_second"] = server.BytesReceived() / seconds / 1e6;
+    report["write_batches"] = batches;
+    report["mean_batch"] = batches ? double(stats.messages_sent - before.messages_sent) / batches : 0.0;
+    report["largest_batch"] = stats.largest_batch;
+    report["allocations_per_message"] = double(g_allocations.load()) / options.messages;
+    report["allocated_bytes_per_message"] = double(g_allocatedBytes.load()) / options.messages;
+    report["received"] = server.MessagesReceived();
+    report["failed"] = failed.load();
+    report["out_of_order"] = outOfOrder;
+
+    if (!delivered || failed != 0 || outOfOrder != 0) {
+        std::cerr << "FAILED: " << server.MessagesReceived() << " of " << options.messages << " delivered, "
+            << failed << " failed, " << outOfOrder << " out of order" << std::endl;
+        *ok = false;
+    }
+    return report;
+}
+
+// What one consumer's setup looks like from the streamer's side: subscribe,
+// an answer carrying a typical two-section SDP, a handful of candidates and
+// the disconnect. JSON escapes the SDP's CRLFs, so parsing has to unescape.
+std::vector<std::string> MakeConsumerMessages(int consumer) {
+    std::string sdp = "v=0\\r\\no=- 4611731400430051336 2 IN IP4 127.0.0.1\\r\\ns=-\\r\\nt=0 0\\r\\n"
+        "a=group:BUNDLE 0 1\\r\\na=msid-semantic: WMS\\r\\n";
+    for (const char* media : { "video 9 UDP/TLS/RTP/SAVPF 96 97 98 99", "audio 9 UDP/TLS/RTP/SAVPF 111 63 9 0 8" }) {
+        sdp += std::string("m=") + media + "\\r\\nc=IN IP4 0.0.0.0\\r\\na=rtcp:9 IN IP4 0.0.0.0\\r\\n"
+            "a=ice-ufrag:Zq3b\\r\\na=ice-pwd:v3Kf9WmPq0cZr8TnYhL2sXeB\\r\\na=ice-options:trickle\\r\\n"
+            "a=fingerprint:sha-256 6B:8B:F0:65:5F:78:E2:51:3B:AC:6F:F3:3F:46:1B:35:DC:B8:5F:64:1A:24:C2:43:F0:A1:58:D0:A1:2C:19:08\\r\\n"
+            "a=setup:active\\r\\na=recvonly\\r\\na=rtcp-mux\\r\\n";
+        for (int pt = 0; pt < 8; ++pt) {
+            sdp += "a=rtpmap:" + std::to_string(96 + pt) + " VP8/90000\\r\\na=rtcp-fb:" + std::to_string(96 + pt) +
+                " transport-cc\\r\\na=fmtp:" + std::to_string(96 + pt) + " apt=96;x-google-start-bitrate=1000\\r\\n";
+        }
+    }
+    const std::string sender = std::to_string(consumer);
+    std::vector<std::string> messages;
+    messages.push_back("{\"type\":\"subscribe\",\"sender\":" + sender + "}");
+    messages.push_back("{\"type\":\"answer\",\"sender\":" + sender + ",\"sdp\":\"" + sdp + "\"}");
+    for (int i = 0; i < kCandidatesPerConsumer; ++i) {
+        messages.push_back("{\"type\":\"ice-candidate\",\"sender\":" + sender +
+            ",\"candidate\":{\"candidate\":\"candidate:842163049 1 udp 1677729535 203.0.113." + std::to_string(i) +
+            " 500" + std::to_string(10 + i) + " typ srflx raddr 192.168.1.20 rport 50012 generation 0 ufrag Zq3b"
+            " network-cost 999\",\"sdpMid\":\"" + std::to_string(i % 2) + "\",\"sdpMLineIndex\":" +
+            std::to_string(i % 2) + "}}");
+    }
+    messages.push_back("{\"type\":\"consumer-disconnected\",\"consumer_id\":" + sender + "}");
+    return messages;
+}
+
+// Reads what SignalingClient's handlers read, without WebRTC.
+uint64_t ReadFields(SignalingMessageType type, const boost::json::object& message) {
+    switch (type) {
+    case SignalingMessageType::kConnect:
+        return message.at("id").as_int64();
+    case SignalingMessageType::kSubscribe:
+        return message.at("sender").as_int64();
+    case SignalingMessageType::kAnswer:
+        return message.at("sender").as_int64() + JsonStringView(message.at("sdp")).size();
+    case SignalingMessageType::kIceCandidate: {
+        const boost::json::value& candidate = message.at("candidate");
+        return message.at("sender").as_int64() + JsonStringView(candidate.at("candidate")).size() +
+            JsonStringView(candidate.at("sdpMid")).size() + candidate.at("sdpMLineIndex").as_int64();
+    }
+    case SignalingMessageType::kConsumerDisconnected:
+        return message.at("consumer_id").as_int64();
+    default:
+        return 0;
+    }
+}
+
+// The path this replaced: the frame copied into a string, a fresh parse
+// into the default heap, the type and fields copied into std::strings.
+uint64_t ReadFieldsCopying(std::string_view frame, uint64_t* unknown) {
+    const std::string message(frame);
+    const boost::json::value value = boost::json::parse(message);
+    const boost::json::object& obj = value.as_object();
+    const std::string type = obj.at("type").as_string().c_str();
+    if (type == "connect") {
+        return obj.at("id").as_int64();
+    }
+    if (type == "subscribe") {
+        return obj.at("sender").as_int64();
+    }
+    if (type == "answer") {
+        const std::string sdp = obj.at("sdp").as_string().c_str();
+        return obj.at("sender").as_int64() + sdp.size();
+    }
+    if (type == "consumer-disconnected") {
+        return obj.at("consumer_id").as_int64();
+    }
+    if (type == "ice-candidate") {
+        const boost::json::value candidate = obj.at("candidate");
+        const std::string sdpMid = candidate.at("sdpMid").as_string().c_str();
+        const std::string sdp = candidate.at("candidate").as_string().c_str();
+        return obj.at("sender").as_int64() + sdp.size() + sdpMid.size() + candidate.at("sdpMLineIndex").as_int64();
+    }
+    ++*unknown;
+    return 0;
+}
+
+boost::json::object RunParseBenchmark(const BenchmarkOptions& options, bool* ok) {
+    // A pool of consumers cycled through, so the parser sees varying ids
+    // and sizes rather than one message over and over.
+    std::vector<std::string> frames = { "{\"type\":\"connect\",\"id\":17}" };
+    for (int consumer = 1; consumer <= 16; ++consumer) {
+        for (std::string& message : MakeConsumerMessages(consumer)) {
+            frames.push_back(std::move(message));
+        }
+    }
+    uint64_t frameBytes = 0;
+    for (const std::string& frame : frames) {
+        frameBytes += frame.size();
+    }
+
+    SignalingMessageParser parser;
+    uint64_t checksum = 0;
+    uint64_t unknown = 0;
+    uint64_t malformed = 0;
+    const auto parseAll = [&] {
+        for (const std::string& frame : frames) {
+            SignalingMessageType type;
+            const boost::json::object* message = parser.Parse(frame, &type);
+            if (!message || type == SignalingMessageType::kUnknown) {
+                ++malformed;
+                continue;
+            }
+            checksum += ReadFields(type, *message);
+        }
+    };
+    const int passes = std::max(1, options.parseIterations / 16);
+    // Warm-up: grows the parser's stack to the largest message.
+    parseAll();
+    const uint64_t expected = checksum;
+
+    checksum = 0;
+    g_allocations = 0;
+    g_allocatedBytes = 0;
+    g_countAllocations = true;
+    auto start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; ++pass) {
+        parseAll();
+    }
+    const double parserSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    g_countAllocations = false;
+    const uint64_t parserAllocations = g_allocations;
+    const bool checksumMatches = checksum == expected * passes;
+
+    uint64_t copyingChecksum = 0;
+    g_allocations = 0;
+    g_countAllocations = true;
+    start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; ++pass) {
+        for (const std::string& frame : frames) {
+            copyingChecksum += ReadFieldsCopying(frame, &unknown);
+        }
+    }
+    const double copyingSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    g_countAllocations = false;
+    const uint64_t copyingAllocations = g_allocations;
+
+    const double messages = double(frames.size()) * passes;
+    boost::json::object report;
+    report["messages"] = messages;
+    report["mean_message_bytes"] = double(frameBytes) / frames.size();
+    report["parser_messages_per_second"] = messages / parserSeconds;
+    report["parser_megabytes_per_second"] = frameBytes * passes / parserSeconds / 1e6;
+    report["parser_allocations_per_message"] = parserAllocations / messages;
+    report["copying_messages_per_second"] = messages / copyingSeconds;
+    report["copying_allocations_per_message"] = copyingAllocations / messages;
+    report["malformed"] = malformed;
+
+    if (parserAllocations / messages > kMaxParseAllocationsPerMessage || malformed != 0 || unknown != 0 ||
+        !checksumMatches || copyingChecksum != checksum) {
+        std::cerr << "FAILED: " << parserAllocations / messages << " allocations per message, " << malformed
+            << " malformed, " << unknown << " unknown, fields " << (checksumMatches && copyingChecksum == checksum
+                ? "match" : "differ") << std::endl;
+        *ok = false;
+    }
+    return report;
+}
+
+// Each thread cycles through its own consumers like the signaling client
+// does: insert on subscribe, a lookup per answer and candidate, another
+// thread's consumer looked up now and then (the renegotiation path), erase
+// on disconnect. Values are shared_ptrs, refcounted like scoped_refptr.
+// Returns the lookups that missed, which must be none.
+template <typename Registry>
+uint64_t RunRegistryCycles(Registry* registry, int threads, int cycles, double* seconds) {
+    std::atomic<uint64_t> misses = 0;
+    std::atomic<bool> go = false;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            while (!go) {
+                std::this_thread::yield();
+            }
+            auto handle = std::make_shared<int>(t);
+            uint64_t missed = 0;
+            for (int cycle = 0; cycle < cycles; ++cycle) {
+                // Ids interleave across threads the way the server hands them out.
+                const uint64_t id = uint64_t(cycle) * threads + t;
+                registry->Insert(id, handle);
+                for (int lookup = 0; lookup < 2 + kCandidatesPerConsumer; ++lookup) {
+                    missed += !registry->Find(id);
+                }
+                if (cycle > 0) {
+                    registry->Find((uint64_t(cycle) - 1) * threads + (t + 1) % threads);
+                }
+                registry->Erase(id);
+            }
+            misses += missed;
+        });
+    }
+    const auto start = std::chrono::steady_clock::now();
+    go = true;
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    *seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return misses;
+}
+
+boost::json::object RunRegistryBenchmark(const BenchmarkOptions& options, bool* ok) {
+    using Handle = std::shared_ptr<int>;
+    ShardedRegistry<uint64_t, Handle> sharded;
+    ShardedRegistry<uint64_t, Handle, 1> singleLock;
+    double shardedSeconds = 0.0;
+    double singleLockSeconds = 0.0;
+    const uint64_t misses = RunRegistryCycles(&sharded, options.threads, options.registryCycles, &shardedSeconds) +
+        RunRegistryCycles(&singleLock, options.threads, options.registryCycles, &singleLockSeconds);
+
+    // Insert + lookups + cross lookup + erase.
+    const double operations = double(options.threads) * options.registryCycles * (4 + kCandidatesPerConsumer);
+    boost::json::object report;
+    report["threads"] = options.threads;
+    report["cycles_per_thread"] = options.registryCycles;
+    report["sharded_ops_per_second"] = operations / shardedSeconds;
+    report["single_lock_ops_per_second"] = operations / singleLockSeconds;
+    report["speedup"] = singleLockSeconds / shardedSeconds;
+    report["misses"] = misses;
+
+    if (misses != 0 || sharded.Size() != 0 || singleLock.Size() != 0) {
+        std::cerr << "FAILED: " << misses << " lookups missed, " << sharded.Size() + singleLock.Size()
+            << " entries left" << std::endl;
+        *ok = false;
+    }
+    return report;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    BenchmarkOptions options;
+    if (!ParseOptions(argc, argv, &options)) {
+        std::cerr << "Usage: SignalingBenchmark [--suites send,parse,registry] [--messages N] [--message-bytes N]"
+            " [--producers N] [--iterations N] [--threads N] [--registry-cycles N] [--output file.json]" << std::endl;
+        return 2;
+    }
+
+    boost::json::object report;
+    report["benchmark"] = "signaling";
+    bool ok = true;
+    for (const std::string& suite : options.suites) {
+        if (suite == "send") {
+            report["send"] = RunSendBenchmark(options, &ok);
+        }
+        else if (suite == "parse") {
+            report["parse"] = RunParseBenchmark(options, &ok);
+        }
+        else if (suite == "registry") {
+            report["registry"] = RunRegistryBenchmark(options, &ok);
+        }
+        else {
+            std::cerr << "Unknown suite: " << suite << std::endl;
+            return 2;
+        }
+    }
+
+    const std::string json = boost::json::serialize(report);
+    if (options.output.empty()) {
+        std::cout << json << std::endl;
+    }
+    else {
+        std::ofstream(options.output) << json << std::endl;
+    }
+    return ok ? 0 : 1;
+}
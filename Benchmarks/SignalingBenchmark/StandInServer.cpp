@@ -0,0 +1,127 @@
+// StandInServer.cpp
+#include "StandInServer.h"
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <deque>
+#include <iostream>
+#include <memory>
+
+namespace beast = boost::beast;
+namespace websocket = beast::websocket;
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+
+class StandInServer::Session : public std::enable_shared_from_this<Session> {
+public:
+    Session(StandInServer* server, size_t id, tcp::socket socket)
+        : m_server(server), m_id(id), m_ws(std::move(socket)) {
+    }
+
+    void Start() {
+        m_ws.async_accept([self = shared_from_this()](beast::error_code ec) {
+            if (ec) {
+                std::cerr << "Stand-in accept failed: " << ec.message() << std::endl;
+                return;
+            }
+            self->m_server->m_open[self->m_id] = self;
+            if (self->m_server->m_onSession) {
+                self->m_server->m_onSession(self->m_id);
+            }
+            self->Read();
+        });
+    }
+
+    // Server thread only.
+    void Send(std::string message) {
+        m_outbox.push_back(std::move(message));
+        if (m_outbox.size() == 1) {
+            Write();
+        }
+    }
+
+private:
+    void Write() {
+        m_ws.async_write(net::buffer(m_outbox.front()), [self = shared_from_this()](beast::error_code ec, std::size_t) {
+            if (ec) {
+                self->m_outbox.clear();
+                return;
+            }
+            ++self->m_server->m_sent;
+            self->m_outbox.pop_front();
+            if (!self->m_outbox.empty()) {
+                self->Write();
+            }
+        });
+    }
+
+    void Read() {
+        m_ws.async_read(m_buffer, [self = shared_from_this()](beast::error_code ec, std::size_t bytes) {
+            if (ec) {
+                self->m_server->m_open.erase(self->m_id);
+                return;
+            }
+            if (self->m_server->m_onMessage) {
+                const auto data = self->m_buffer.cdata();
+                self->m_server->m_onMessage(self->m_id,
+                    std::string_view(static_cast<const char*>(data.data()), data.size()));
+            }
+            self->m_buffer.consume(self->m_buffer.size());
+            self->m_server->m_bytes += bytes;
+            ++self->m_server->m_messages;
+            self->Read();
+        });
+    }
+
+    StandInServer* m_server;
+    size_t m_id;
+    websocket::stream<tcp::socket> m_ws;
+    beast::flat_buffer m_buffer;
+    std::deque<std::string> m_outbox;
+};
+
+StandInServer::StandInServer(MessageHandler onMessage, SessionHandler onSession)
+    : m_acceptor(m_ioc, tcp::endpoint(net::ip::make_address("127.0.0.1"), 0)),
+    m_onMessage(std::move(onMessage)),
+    m_onSession(std::move(onSession)) {
+    m_port = m_acceptor.local_endpoint().port();
+    Accept();
+    m_thread = std::thread([this] { m_ioc.run(); });
+}
+
+StandInServer::~StandInServer() {
+    m_ioc.stop();
+    m_thread.join();
+}
+
+bool StandInServer::WaitForMessages(uint64_t count, std::chrono::milliseconds timeout) const {
+    const auto until = std::chrono::steady_clock::now() + timeout;
+    while (m_messages < count) {
+        if (std::chrono::steady_clock::now() >= until) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+void StandInServer::Send(size_t session, std::string message) {
+    net::post(m_ioc, [this, session, message = std::move(message)]() mutable {
+        auto it = m_open.find(session);
+        if (it == m_open.end()) {
+            return;
+        }
+        if (auto open = it->second.lock()) {
+            open->Send(std::move(message));
+        }
+    });
+}
+
+void StandInServer::Accept() {
+    m_acceptor.async_accept([this](beast::error_code ec, tcp::socket socket) {
+        if (ec) {
+            return;
+        }
+        std::make_shared<Session>(this, m_sessions++, std::move(socket))->Start();
+        Accept();
+    });
+}
@@ -0,0 +1,59 @@
+// StandInServer.h
+#pragma once
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+// Local stand-in for the signaling server: accepts WebSocket clients on an
+// ephemeral 127.0.0.1 port and hands every message to a handler, one
+// thread for all sessions, so the benchmarks need no network or Node.js.
+// Scripts that play the server's side of the protocol answer through
+// Send().
+class StandInServer {
+public:
+    // `session` numbers connections in accept order. Runs on the server
+    // thread; `message` is only valid during the call.
+    using MessageHandler = std::function<void(size_t session, std::string_view message)>;
+    // Runs on the server thread once a session's handshake is done.
+    using SessionHandler = std::function<void(size_t session)>;
+
+    explicit StandInServer(MessageHandler onMessage = nullptr, SessionHandler onSession = nullptr);
+    ~StandInServer();
+
+    unsigned short Port() const { return m_port; }
+    uint64_t MessagesReceived() const { return m_messages; }
+    uint64_t BytesReceived() const { return m_bytes; }
+    uint64_t MessagesSent() const { return m_sent; }
+
+    // Queues `message` to `session`; dropped if it is not open. Thread-safe.
+    void Send(size_t session, std::string message);
+
+    // Returns false if fewer than `count` messages arrived in time.
+    bool WaitForMessages(uint64_t count, std::chrono::milliseconds timeout) const;
+
+private:
+    class Session;
+
+    void Accept();
+
+    boost::asio::io_context m_ioc;
+    boost::asio::ip::tcp::acceptor m_acceptor;
+    unsigned short m_port = 0;
+    MessageHandler m_onMessage;
+    SessionHandler m_onSession;
+    // Server thread only.
+    size_t m_sessions = 0;
+    std::unordered_map<size_t, std::weak_ptr<Session>> m_open;
+    std::atomic<uint64_t> m_messages = 0;
+    std::atomic<uint64_t> m_bytes = 0;
+    std::atomic<uint64_t> m_sent = 0;
+    std::thread m_thread;
+};
@@ -0,0 +1,314 @@
+// SignalingLoad.cpp
+// Load tool for the streamer's signaling path. The real SignalingClient and
+// PeerConnectionFactory run against VirtualConsumers, a local stand-in
+// server that scripts the consumers. The tool then ramps the number of
+// simultaneous subscribers: each stage subscribes --step more consumers at
+// once, on top of those already connected. Each stage reports
+// subscribe-to-offer latency (p50/p95/p99/max), signaling messages per
+// second and process memory per consumer. The ramp stops at
+// --max-consumers or at the first stage that breaks the service level:
+// p95 over --slo-p95-ms, or an offer still missing after
+// --offer-timeout-ms. The largest count that held is reported as
+// max_consumers_within_slo. Each stage also reports how the streamer's
+// candidates travelled: candidates and messages per consumer, the time from
+// subscribe to the last one, and remote candidates that came before the
+// answer had been applied. --candidate-batch-ms 0 sends each candidate on
+// its own, for comparison. Pool hits and misses show how many subscribes
+// found a PeerConnection ready; --pool-max 0 creates each on subscribe.
+// The streamer's own join timeline for every consumer is exported under
+// time_to_first_frame. Virtual consumers do not run ICE, so it ends at
+// answer_applied here. Audio comes from the synthetic speech backend,
+// so no device is needed; video captures the screen as the app does.
+#include "VirtualConsumers.h"
+#include "../../CaptureSource.h"
+#include "../../SharedAudioEncoder.h"
+#include "../../SignalingClient.h"
+#include "../../SyntheticAudioCapture.h"
+#include <boost/json.hpp>
+
+#include <api/create_peerconnection_factory.h>
+#include "api/audio_codecs/builtin_audio_decoder_factory.h"
+#include "api/audio_codecs/builtin_audio_encoder_factory.h"
+#include "api/video_codecs/video_encoder_factory_template.h"
+#include "api/video_codecs/video_decoder_factory_template.h"
+#include "api/video_codecs/video_encoder_factory_template_libvpx_vp8_adapter.h"
+#include "api/video_codecs/video_encoder_factory_template_libvpx_vp9_adapter.h"
+#include "api/video_codecs/video_encoder_factory_template_open_h264_adapter.h"
+#include "api/video_codecs/video_decoder_factory_template_libvpx_vp8_adapter.h"
+#include "api/video_codecs/video_decoder_factory_template_libvpx_vp9_adapter.h"
+#include "api/video_codecs/video_decoder_factory_template_open_h264_adapter.h"
+#include <rtc_base/thread.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+struct LoadOptions {
+    int step = 4;
+    int maxConsumers = 128;
+    int candidates = 4;
+    int sloP95Ms = 500;
+    int offerTimeoutMs = 5000;
+    int settleMs = 500;
+    int candidateBatchMs = 20;
+    int poolMin = 1;
+    int poolMax = 4;
+    std::string output;
+};
+
+bool ParseOptions(int argc, char** argv, LoadOptions* options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--step") options->step = std::stoi(value);
+        else if (arg == "--max-consumers") options->maxConsumers = std::stoi(value);
+        else if (arg == "--candidates") options->candidates = std::stoi(value);
+        else if (arg == "--slo-p95-ms") options->sloP95Ms = std::stoi(value);
+        else if (arg == "--offer-timeout-ms") options->offerTimeoutMs = std::stoi(value);
+        else if (arg == "--settle-ms") options->settleMs = std::stoi(value);
+        else if (arg == "--candidate-batch-ms") options->candidateBatchMs = std::stoi(value);
+        else if (arg == "--pool-min") options->poolMin = std::stoi(value);
+        else if (arg == "--pool-max") options->poolMax = std::stoi(value);
+        else if (arg == "--output") options->output = value;
+        else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+    }
+    return options->step > 0 && options->maxConsumers >= options->step && options->candidates >= 0 &&
+        options->sloP95Ms > 0 && options->offerTimeoutMs > 0 && options->settleMs >= 0 && options->candidateBatchMs >= 0 &&
+        options->poolMin >= 0 && options->poolMax >= 0;
+}
+
+// Private bytes of this process: committed memory a consumer actually
+// costs, whether or not it is resident.
+uint64_t ProcessMemoryBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS_EX counters = {};
+    GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters),
+        sizeof(counters));
+    return counters.PrivateUsage;
+#else
+    uint64_t size = 0;
+    uint64_t resident = 0;
+    std::ifstream("/proc/self/statm") >> size >> resident;
+    return resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+double Percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    const size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> CreateFactory() {
+    rtc::Thread* network_thread = rtc::Thread::CreateWithSocketServer().release();
+    network_thread->Start();
+    rtc::Thread* worker_thread = rtc::Thread::Create().release();
+    worker_thread->Start();
+    rtc::Thread* signaling_thread = rtc::Thread::Create().release();
+    signaling_thread->Start();
+
+    return webrtc::CreatePeerConnectionFactory(
+        network_thread,
+        worker_thread,
+        signaling_thread,
+        nullptr,
+        rtc::scoped_refptr<webrtc::AudioEncoderFactory>(new rtc::RefCountedObject<SharedAudioEncoderFactory>(
+            webrtc::CreateBuiltinAudioEncoderFactory())),
+        webrtc::CreateBuiltinAudioDecoderFactory(),
+        std::make_unique<webrtc::VideoEncoderFactoryTemplate<
+            webrtc::LibvpxVp9EncoderTemplateAdapter,
+            webrtc::OpenH264EncoderTemplateAdapter,
+            webrtc::LibvpxVp8EncoderTemplateAdapter>>(),
+        std::make_unique<webrtc::VideoDecoderFactoryTemplate<
+            webrtc::LibvpxVp9DecoderTemplateAdapter,
+            webrtc::OpenH264DecoderTemplateAdapter,
+            webrtc::LibvpxVp8DecoderTemplateAdapter>>(),
+        nullptr,
+        nullptr);
+}
+
+// Subscribes one stage's worth of consumers and measures it. `ok` is
+// cleared if the stage breaks the service level.
+boost::json::object RunStage(VirtualConsumers& consumers, const SignalingClient& client,
+    const LoadOptions& options, int total, uint64_t baselineMemory, bool* ok) {
+    const SignalingClient::Stats statsBefore = client.GetStats();
+    const uint64_t receivedBefore = consumers.MessagesReceived();
+    const uint64_t sentBefore = consumers.MessagesSent();
+    const auto start = std::chrono::steady_clock::now();
+
+    const std::vector<uint64_t> ids = consumers.Subscribe(options.step);
+    const bool allOffered = consumers.WaitForOffers(ids, std::chrono::milliseconds(options.offerTimeoutMs));
+    // Let answers and candidate trickle finish before counting messages and
+    // memory.
+    std::this_thread::sleep_for(std::chrono::milliseconds(options.settleMs));
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<double> latencies;
+    std::vector<double> trickleDone;
+    int timeouts = 0;
+    uint64_t localCandidates = 0;
+    uint64_t candidateMessages = 0;
+    for (const VirtualConsumers::Consumer& consumer : consumers.Snapshot(ids)) {
+        if (consumer.offered == VirtualConsumers::Clock::time_point()) {
+            ++timeouts;
+            continue;
+        }
+        latencies.push_back(std::chrono::duration<double, std::milli>(consumer.offered - consumer.subscribed).count());
+        if (consumer.local_candidates > 0) {
+            trickleDone.push_back(
+                std::chrono::duration<double, std::milli>(consumer.last_candidate - consumer.subscribed).count());
+        }
+        localCandidates += consumer.local_candidates;
+        candidateMessages += consumer.local_candidate_messages;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    std::sort(trickleDone.begin(), trickleDone.end());
+    const SignalingClient::Stats stats = client.GetStats();
+
+    boost::json::object stage;
+    stage["consumers"] = total;
+    stage["p50_ms"] = Percentile(latencies, 0.50);
+    stage["p95_ms"] = Percentile(latencies, 0.95);
+    stage["p99_ms"] = Percentile(latencies, 0.99);
+    stage["max_ms"] = latencies.empty() ? 0.0 : latencies.back();
+    stage["timeouts"] = timeouts;
+    stage["messages_in_per_second"] = (consumers.MessagesReceived() - receivedBefore) / seconds;
+    stage["messages_out_per_second"] = (consumers.MessagesSent() - sentBefore) / seconds;
+    stage["streamer_candidates_per_consumer"] =
+        latencies.empty() ? 0.0 : static_cast<double>(localCandidates) / latencies.size();
+    stage["streamer_candidate_messages_per_consumer"] =
+        latencies.empty() ? 0.0 : static_cast<double>(candidateMessages) / latencies.size();
+    stage["last_candidate_p50_ms"] = Percentile(trickleDone, 0.50);
+    stage["last_candidate_p95_ms"] = Percentile(trickleDone, 0.95);
+    stage["remote_candidates_deferred"] = stats.remote_candidates_deferred - statsBefore.remote_candidates_deferred;
+    stage["remote_candidates_failed"] = stats.remote_candidates_failed - statsBefore.remote_candidates_failed;
+    stage["pool_hits"] = stats.pool_hits - statsBefore.pool_hits;
+    stage["pool_misses"] = stats.pool_misses - statsBefore.pool_misses;
+    stage["pool_target"] = stats.pool_target;
+    const uint64_t memory = ProcessMemoryBytes();
+    stage["memory_mb"] = memory / (1024.0 * 1024.0);
+    stage["memory_per_consumer_kb"] =
+        memory > baselineMemory ? (memory - baselineMemory) / 1024.0 / total : 0.0;
+
+    *ok = allOffered && timeouts == 0 && Percentile(latencies, 0.95) <= options.sloP95Ms;
+    std::cerr << total << " consumers: p95 " << Percentile(latencies, 0.95) << " ms, " << timeouts
+        << " timeouts" << (*ok ? "" : " (over SLO)") << std::endl;
+    return stage;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    LoadOptions options;
+    if (!ParseOptions(argc, argv, &options)) {
+        std::cerr << "Usage: SignalingLoad [--step N] [--max-consumers N] [--candidates N] [--slo-p95-ms N]"
+            " [--offer-timeout-ms N] [--settle-ms N] [--candidate-batch-ms N] [--pool-min N] [--pool-max N]"
+            " [--output file.json]" << std::endl;
+        return 2;
+    }
+
+    AudioCaptureSource::SetSharedBackend([] {
+        SyntheticAudioCapture::Config config;
+        config.signal = SyntheticAudioCapture::Signal::kSpeech;
+        return std::unique_ptr<AudioCaptureBackend>(new SyntheticAudioCapture(config));
+    });
+    rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> factory = CreateFactory();
+    if (!factory) {
+        std::cerr << "Failed to create PeerConnectionFactory" << std::endl;
+        return 1;
+    }
+
+    VirtualConsumers::Options consumerOptions;
+    consumerOptions.candidates = options.candidates;
+    VirtualConsumers consumers(consumerOptions);
+
+    net::io_context ioc;
+    auto work = net::make_work_guard(ioc);
+    webrtc::scoped_refptr<SignalingClient> client(new webrtc::RefCountedObject<SignalingClient>(
+        ioc, "127.0.0.1", std::to_string(consumers.Port()), "/?role=streamer"));
+    client->SetPeerConnectionFactory(factory);
+    client->SetCandidateBatchWindow(std::chrono::milliseconds(options.candidateBatchMs));
+    client->SetPeerConnectionPoolSize(options.poolMin, options.poolMax);
+    client->Connect();
+    const unsigned io_threads = std::clamp(std::thread::hardware_concurrency(), 2u, 8u);
+    std::vector<std::thread> io_pool;
+    for (unsigned i = 0; i < io_threads; ++i) {
+        io_pool.emplace_back([&ioc] { ioc.run(); });
+    }
+
+    boost::json::object report;
+    report["benchmark"] = "signaling_load";
+    boost::json::array stages;
+    int withinSlo = 0;
+    std::string limit = "max_consumers";
+    if (!consumers.WaitForStreamer(std::chrono::seconds(10))) {
+        std::cerr << "The streamer never connected to the stand-in server" << std::endl;
+        limit = "no_streamer";
+    }
+    else {
+        const uint64_t baselineMemory = ProcessMemoryBytes();
+        for (int total = options.step; total <= options.maxConsumers; total += options.step) {
+            bool ok = true;
+            stages.push_back(RunStage(consumers, *client, options, total, baselineMemory, &ok));
+            if (!ok) {
+                limit = "slo";
+                break;
+            }
+            withinSlo = total;
+        }
+    }
+    report["step"] = options.step;
+    report["slo_p95_ms"] = options.sloP95Ms;
+    report["offer_timeout_ms"] = options.offerTimeoutMs;
+    report["candidate_batch_ms"] = options.candidateBatchMs;
+    report["pool_min"] = options.poolMin;
+    report["pool_max"] = options.poolMax;
+    report["stages"] = std::move(stages);
+    report["max_consumers_within_slo"] = withinSlo;
+    report["limit"] = limit;
+    report["time_to_first_frame"] = client->ExportJoinTimings();
+
+    consumers.DisconnectAll();
+    std::this_thread::sleep_for(std::chrono::milliseconds(options.settleMs));
+    client->Disconnect();
+    work.reset();
+    ioc.stop();
+    for (std::thread& thread : io_pool) {
+        thread.join();
+    }
+
+    const std::string json = boost::json::serialize(report);
+    if (options.output.empty()) {
+        std::cout << json << std::endl;
+    }
+    else {
+        std::ofstream(options.output) << json << std::endl;
+    }
+    // Breaking the SLO at some stage is the expected outcome; only a run
+    // that could not hold even the first stage fails.
+    return withinSlo > 0 ? 0 : 1;
+}
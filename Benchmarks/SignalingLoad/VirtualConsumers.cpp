@@ -0,0 +1,190 @@
+// VirtualConsumers.cpp
+#include "VirtualConsumers.h"
+#include <boost/json.hpp>
+#include <iostream>
+
+namespace {
+constexpr uint64_t kStreamerId = 1;
+}
+
+VirtualConsumers::VirtualConsumers(const Options& options)
+    : m_options(options),
+    m_server([this](size_t session, std::string_view message) { OnMessage(session, message); },
+        [this](size_t session) { OnSession(session); }) {
+}
+
+bool VirtualConsumers::WaitForStreamer(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_changed.wait_for(lock, timeout, [this] { return m_streamerConnected; });
+}
+
+std::vector<uint64_t> VirtualConsumers::Subscribe(int count) {
+    std::vector<uint64_t> ids;
+    size_t session;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        session = m_streamerSession;
+        const auto now = Clock::now();
+        for (int i = 0; i < count; ++i) {
+            Consumer consumer;
+            consumer.id = m_nextId++;
+            consumer.subscribed = now;
+            m_consumers.emplace(consumer.id, consumer);
+            ids.push_back(consumer.id);
+        }
+    }
+    for (uint64_t id : ids) {
+        boost::json::object subscribe;
+        subscribe["type"] = "subscribe";
+        subscribe["sender"] = id;
+        m_server.Send(session, boost::json::serialize(subscribe));
+    }
+    return ids;
+}
+
+bool VirtualConsumers::WaitForOffers(const std::vector<uint64_t>& ids, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_changed.wait_for(lock, timeout, [&] {
+        for (uint64_t id : ids) {
+            if (m_consumers.at(id).offered == Clock::time_point()) {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+std::vector<VirtualConsumers::Consumer> VirtualConsumers::Snapshot(const std::vector<uint64_t>& ids) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<Consumer> consumers;
+    for (uint64_t id : ids) {
+        consumers.push_back(m_consumers.at(id));
+    }
+    return consumers;
+}
+
+void VirtualConsumers::DisconnectAll() {
+    std::vector<uint64_t> ids;
+    size_t session;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        session = m_streamerSession;
+        for (const auto& [id, consumer] : m_consumers) {
+            ids.push_back(id);
+        }
+        m_consumers.clear();
+    }
+    for (uint64_t id : ids) {
+        boost::json::object disconnected;
+        disconnected["type"] = "consumer-disconnected";
+        disconnected["consumer_id"] = id;
+        m_server.Send(session, boost::json::serialize(disconnected));
+    }
+}
+
+void VirtualConsumers::OnSession(size_t session) {
+    boost::json::object connect;
+    connect["type"] = "connect";
+    connect["id"] = kStreamerId;
+    m_server.Send(session, boost::json::serialize(connect));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_streamerSession = session;
+    m_streamerConnected = true;
+    m_changed.notify_all();
+}
+
+void VirtualConsumers::OnMessage(size_t session, std::string_view message) {
+    boost::system::error_code ec;
+    const boost::json::value value = boost::json::parse(message, ec);
+    const boost::json::object* obj = ec ? nullptr : value.if_object();
+    if (!obj || !obj->contains("type") || !obj->contains("target")) {
+        std::cerr << "Stand-in got an unexpected message: " << message.substr(0, 80) << std::endl;
+        return;
+    }
+    const boost::json::string& type = obj->at("type").as_string();
+    const uint64_t id = static_cast<uint64_t>(obj->at("target").as_int64());
+
+    std::string sdp;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_consumers.find(id);
+        if (it == m_consumers.end()) {
+            return;
+        }
+        if (type == "ice-candidate") {
+            // The streamer batches candidates gathered close together.
+            const boost::json::value* batch = obj->if_contains("candidates");
+            it->second.local_candidates += batch ? static_cast<int>(batch->as_array().size()) : 1;
+            ++it->second.local_candidate_messages;
+            it->second.last_candidate = Clock::now();
+            return;
+        }
+        if (type != "offer" || it->second.offered != Clock::time_point()) {
+            return;
+        }
+        it->second.offered = Clock::now();
+        m_changed.notify_all();
+    }
+
+    const boost::json::string& offer = obj->at("sdp").as_string();
+    boost::json::object answer;
+    answer["type"] = "answer";
+    answer["sender"] = id;
+    answer["sdp"] = MakeAnswer(std::string_view(offer.data(), offer.size()), id);
+    m_server.Send(session, boost::json::serialize(answer));
+
+    for (int i = 0; i < m_options.candidates; ++i) {
+        boost::json::object candidate;
+        candidate["candidate"] = "candidate:" + std::to_string(i + 1) + " 1 udp 2122260223 127.0.0.1 " +
+            std::to_string(40000 + i) + " typ host generation 0";
+        candidate["sdpMid"] = "0";
+        candidate["sdpMLineIndex"] = 0;
+        boost::json::object trickle;
+        trickle["type"] = "ice-candidate";
+        trickle["sender"] = id;
+        trickle["candidate"] = candidate;
+        m_server.Send(session, boost::json::serialize(trickle));
+    }
+}
+
+std::string VirtualConsumers::MakeAnswer(std::string_view offer, uint64_t id) {
+    const std::string tag = std::to_string(id);
+    std::string answer;
+    size_t start = 0;
+    while (start < offer.size()) {
+        size_t end = offer.find("\r\n", start);
+        if (end == std::string_view::npos) {
+            end = offer.size();
+        }
+        const std::string_view line = offer.substr(start, end - start);
+        start = end + 2;
+
+        std::string out;
+        if (line.rfind("o=", 0) == 0) {
+            out = "o=- " + tag + " 2 IN IP4 127.0.0.1";
+        }
+        else if (line.rfind("a=setup:", 0) == 0) {
+            out = "a=setup:active";
+        }
+        else if (line == "a=sendrecv" || line == "a=sendonly") {
+            out = "a=recvonly";
+        }
+        else if (line.rfind("a=ice-ufrag:", 0) == 0) {
+            out = "a=ice-ufrag:vc" + tag;
+        }
+        else if (line.rfind("a=ice-pwd:", 0) == 0) {
+            out = "a=ice-pwd:virtualconsumer" + std::string(16 - std::min<size_t>(tag.size(), 16), '0') + tag;
+        }
+        else if (line.rfind("a=ssrc", 0) == 0 || line.rfind("a=msid:", 0) == 0) {
+            // A receive-only answer carries no sources of its own.
+            continue;
+        }
+        else {
+            out = line;
+        }
+        answer += out;
+        answer += "\r\n";
+    }
+    return answer;
+}
@@ -0,0 +1,68 @@
+// VirtualConsumers.h
+#pragma once
+#include "../SignalingBenchmark/StandInServer.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Plays the signaling server and a crowd of scripted consumers against one
+// streamer, over the same protocol as the real server. The streamer gets
+// connect, subscribe, answer, ice-candidate and consumer-disconnected, and
+// sends offer and ice-candidate back. Each consumer answers its offer with
+// an SDP derived from it, then trickles host candidates.
+class VirtualConsumers {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        int candidates = 4;  // Trickled by each consumer after its answer
+    };
+
+    struct Consumer {
+        uint64_t id = 0;
+        Clock::time_point subscribed;
+        Clock::time_point offered;   // Epoch until the offer arrives
+        Clock::time_point last_candidate;
+        int local_candidates = 0;    // Trickled by the streamer
+        int local_candidate_messages = 0;
+    };
+
+    explicit VirtualConsumers(const Options& options);
+
+    unsigned short Port() const { return m_server.Port(); }
+    uint64_t MessagesReceived() const { return m_server.MessagesReceived(); }
+    uint64_t MessagesSent() const { return m_server.MessagesSent(); }
+
+    // Blocks until a streamer has connected and been given its id.
+    bool WaitForStreamer(std::chrono::milliseconds timeout);
+    // Subscribes `count` new consumers at once and returns their ids.
+    std::vector<uint64_t> Subscribe(int count);
+    // Returns false if some consumer in `ids` has no offer in time.
+    bool WaitForOffers(const std::vector<uint64_t>& ids, std::chrono::milliseconds timeout);
+    std::vector<Consumer> Snapshot(const std::vector<uint64_t>& ids) const;
+    // Tells the streamer every consumer has left.
+    void DisconnectAll();
+
+private:
+    void OnSession(size_t session);
+    void OnMessage(size_t session, std::string_view message);
+    // An answer the streamer will accept: the offer's codecs and
+    // extensions, with our own ICE credentials, as the active DTLS side,
+    // receive-only.
+    static std::string MakeAnswer(std::string_view offer, uint64_t id);
+
+    const Options m_options;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_changed;
+    bool m_streamerConnected = false;
+    size_t m_streamerSession = 0;
+    uint64_t m_nextId = 1000;
+    std::unordered_map<uint64_t, Consumer> m_consumers;
+    // Last, so its thread stops before the state above goes away.
+    StandInServer m_server;
+};
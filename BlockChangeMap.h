@@ -0,0 +1,90 @@
+// BlockChangeMap.h
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Per-macroblock (16x16) change/importance map for one captured frame,
+// relative to the frame captured before it.
+struct BlockChangeMap {
+    enum Level : uint8_t {
+        kUnchanged = 0,  // Identical to the previous frame
+        kMoved = 1,      // Content moved (scroll, window drag); cheap to predict
+        kChanged = 2     // Newly drawn content
+    };
+    static constexpr int kBlockSize = 16;
+
+    int width = 0;
+    int height = 0;
+    int blocks_wide = 0;
+    int blocks_high = 0;
+    std::vector<uint8_t> levels;
+
+    // Sizes the map for a frame and clears it. Reuses the existing storage.
+    void Reset(int frame_width, int frame_height) {
+        width = frame_width;
+        height = frame_height;
+        blocks_wide = (frame_width + kBlockSize - 1) / kBlockSize;
+        blocks_high = (frame_height + kBlockSize - 1) / kBlockSize;
+        levels.assign(static_cast<size_t>(blocks_wide) * blocks_high, kUnchanged);
+    }
+
+    // Raises every block touched by the pixel rect [left, right) x [top, bottom)
+    // to at least `level`.
+    void MarkRect(int left, int top, int right, int bottom, Level level) {
+        left = std::clamp(left, 0, width);
+        right = std::clamp(right, 0, width);
+        top = std::clamp(top, 0, height);
+        bottom = std::clamp(bottom, 0, height);
+        if (left >= right || top >= bottom) {
+            return;
+        }
+        const int bx0 = left / kBlockSize;
+        const int bx1 = (right - 1) / kBlockSize;
+        const int by0 = top / kBlockSize;
+        const int by1 = (bottom - 1) / kBlockSize;
+        for (int by = by0; by <= by1; ++by) {
+            uint8_t* row = &levels[static_cast<size_t>(by) * blocks_wide];
+            for (int bx = bx0; bx <= bx1; ++bx) {
+                row[bx] = std::max<uint8_t>(row[bx], level);
+            }
+        }
+    }
+
+    void MarkAll(Level level) {
+        std::fill(levels.begin(), levels.end(), static_cast<uint8_t>(level));
+    }
+
+    uint8_t At(int bx, int by) const {
+        return levels[static_cast<size_t>(by) * blocks_wide + bx];
+    }
+
+    bool Empty() const {
+        return std::all_of(levels.begin(), levels.end(),
+            [](uint8_t level) { return level == kUnchanged; });
+    }
+
+    // Pixel bounding box of all blocks that are not kUnchanged. Returns false
+    // when nothing changed.
+    bool BoundingBox(int* x, int* y, int* w, int* h) const {
+        int min_bx = blocks_wide, min_by = blocks_high, max_bx = -1, max_by = -1;
+        for (int by = 0; by < blocks_high; ++by) {
+            for (int bx = 0; bx < blocks_wide; ++bx) {
+                if (At(bx, by) != kUnchanged) {
+                    min_bx = std::min(min_bx, bx);
+                    max_bx = std::max(max_bx, bx);
+                    min_by = std::min(min_by, by);
+                    max_by = std::max(max_by, by);
+                }
+            }
+        }
+        if (max_bx < 0) {
+            return false;
+        }
+        *x = min_bx * kBlockSize;
+        *y = min_by * kBlockSize;
+        *w = std::min((max_bx + 1) * kBlockSize, width) - *x;
+        *h = std::min((max_by + 1) * kBlockSize, height) - *y;
+        return true;
+    }
+};
@@ -0,0 +1,101 @@
+// CaptureClock.cpp
+#include "CaptureClock.h"
+#include <Windows.h>
+#include <rtc_base/time_utils.h>
+
+std::atomic<int64_t> CaptureClock::offset_us_ = 0;
+std::atomic<int64_t> CaptureClock::last_sync_qpc_us_ = INT64_MIN;
+
+namespace {
+int64_t QpcFrequency() {
+    static const int64_t frequency = [] {
+        LARGE_INTEGER f;
+        QueryPerformanceFrequency(&f);
+        return static_cast<int64_t>(f.QuadPart);
+    }();
+    return frequency;
+}
+
+int64_t QpcNowTicks() {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
+}
+
+int64_t CaptureClock::QpcMicros(int64_t ticks) {
+    const int64_t frequency = QpcFrequency();
+    // Split to avoid overflowing ticks * 1e6 on long uptimes.
+    return (ticks / frequency) * 1000000 + (ticks % frequency) * 1000000 / frequency;
+}
+
+int64_t CaptureClock::OffsetUs(int64_t qpc_us) {
+    const int64_t last_sync = last_sync_qpc_us_.load(std::memory_order_relaxed);
+    if (last_sync != INT64_MIN && qpc_us - last_sync < kResyncIntervalUs) {
+        return offset_us_.load(std::memory_order_relaxed);
+    }
+    // Bracket an rtc::TimeMicros() read between two QPC reads and keep the
+    // tightest bracket; its midpoint is the best estimate of the offset.
+    int64_t best_width = INT64_MAX;
+    int64_t best_offset = 0;
+    for (int i = 0; i < kResyncSamples; ++i) {
+        const int64_t before = QpcMicros(QpcNowTicks());
+        const int64_t rtc_us = rtc::TimeMicros();
+        const int64_t after = QpcMicros(QpcNowTicks());
+        if (after - before < best_width) {
+            best_width = after - before;
+            best_offset = rtc_us - (before + after) / 2;
+        }
+    }
+    // Racing threads compute nearly the same value; last writer wins.
+    offset_us_.store(best_offset, std::memory_order_relaxed);
+    last_sync_qpc_us_.store(qpc_us, std::memory_order_relaxed);
+    return best_offset;
+}
+
+int64_t CaptureClock::FromQpcTicks(int64_t ticks) {
+    const int64_t qpc_us = QpcMicros(ticks);
+    return qpc_us + OffsetUs(qpc_us);
+}
+
+int64_t CaptureClock::FromQpc100ns(int64_t units) {
+    const int64_t qpc_us = units / 10;
+    return qpc_us + OffsetUs(qpc_us);
+}
+
+AvSyncMonitor& AvSyncMonitor::Instance() {
+    static AvSyncMonitor monitor;
+    return monitor;
+}
+
+void AvSyncMonitor::Record(std::atomic<double>* average, std::atomic<uint64_t>* samples, double delay_ms) {
+    // Nothing limits a path to one writer (every video source records, as
+    // may several audio sources), so fold the sample in with a CAS rather
+    // than a load/store pair.
+    if (samples->fetch_add(1) == 0) {
+        average->store(delay_ms, std::memory_order_relaxed);
+        return;
+    }
+    double previous = average->load(std::memory_order_relaxed);
+    while (!average->compare_exchange_weak(previous, previous + kSmoothing * (delay_ms - previous),
+        std::memory_order_relaxed)) {
+    }
+}
+
+void AvSyncMonitor::RecordAudio(int64_t capture_time_us, int64_t delivery_time_us) {
+    Record(&audio_delay_ms_, &audio_samples_, (delivery_time_us - capture_time_us) / 1000.0);
+}
+
+void AvSyncMonitor::RecordVideo(int64_t capture_time_us, int64_t delivery_time_us) {
+    Record(&video_delay_ms_, &video_samples_, (delivery_time_us - capture_time_us) / 1000.0);
+}
+
+AvSyncMonitor::Stats AvSyncMonitor::GetStats() const {
+    Stats stats;
+    stats.audio_delay_ms = audio_delay_ms_;
+    stats.video_delay_ms = video_delay_ms_;
+    stats.audio_samples = audio_samples_;
+    stats.video_samples = video_samples_;
+    stats.av_offset_ms = stats.video_delay_ms - stats.audio_delay_ms;
+    return stats;
+}
@@ -0,0 +1,59 @@
+// CaptureClock.h
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Maps device capture instants onto the rtc::TimeMicros() clock that
+// VideoFrame and AudioTrackSinkInterface timestamps use. Both WASAPI packet
+// positions and DXGI present times are QueryPerformanceCounter readings; the
+// QPC-to-rtc offset is measured with a tight bracket and refreshed
+// periodically so the two clocks may even run on different bases.
+class CaptureClock {
+public:
+    // QPC ticks (e.g. DXGI_OUTDUPL_FRAME_INFO::LastPresentTime) to rtc micros.
+    static int64_t FromQpcTicks(int64_t ticks);
+    // QPC time in 100 ns units (WASAPI's qpcPosition) to rtc micros.
+    static int64_t FromQpc100ns(int64_t units);
+
+private:
+    static constexpr int64_t kResyncIntervalUs = 10 * 1000 * 1000;
+    static constexpr int kResyncSamples = 5;
+
+    static int64_t QpcMicros(int64_t ticks);
+    static int64_t OffsetUs(int64_t qpc_us);
+
+    static std::atomic<int64_t> offset_us_;
+    static std::atomic<int64_t> last_sync_qpc_us_;
+};
+
+// Running statistic of the audio/video sync error our own pipeline adds:
+// for each path, the delay between the capture instant and the moment the
+// data is handed to WebRTC. With capture-instant timestamps the receiver
+// sees the true alignment; this measures how far delivery-time stamping
+// would have been off.
+class AvSyncMonitor {
+public:
+    struct Stats {
+        double audio_delay_ms = 0.0;  // Smoothed capture-to-delivery delay
+        double video_delay_ms = 0.0;
+        double av_offset_ms = 0.0;    // video_delay_ms - audio_delay_ms
+        uint64_t audio_samples = 0;
+        uint64_t video_samples = 0;
+    };
+
+    static AvSyncMonitor& Instance();
+
+    void RecordAudio(int64_t capture_time_us, int64_t delivery_time_us);
+    void RecordVideo(int64_t capture_time_us, int64_t delivery_time_us);
+    Stats GetStats() const;
+
+private:
+    static constexpr double kSmoothing = 0.02;
+
+    static void Record(std::atomic<double>* average, std::atomic<uint64_t>* samples, double delay_ms);
+
+    std::atomic<double> audio_delay_ms_ = 0.0;
+    std::atomic<double> video_delay_ms_ = 0.0;
+    std::atomic<uint64_t> audio_samples_ = 0;
+    std::atomic<uint64_t> video_samples_ = 0;
+};
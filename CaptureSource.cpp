@@ -1,5 +1,6 @@
 // CaptureSource.h
 #include "CaptureSource.h"
+#include "CaptureClock.h"
 
 #include <api/video/i420_buffer.h>
 #include <api/video/video_frame.h>
@@ -35,67 +36,233 @@ stats_(new Stats){
     
     stats_->input_width = 1920;  // Default or actual values
     stats_->input_height = 1080; // Default or actual values
-
-    StartCapture();
 } 
 VideoCaptureSource::~VideoCaptureSource() {
-    StopCapture();
+    webrtc::MutexLock lock(&capture_mutex_);
+    if (capturing_) {
+        capturing_ = false;
+        m_screen_capture->RemoveFrameSink(this);
+    }
+}
+
+void VideoCaptureSource::AddOrUpdateSink(rtc::VideoSinkInterface<webrtc::VideoFrame>* sink,
+    const rtc::VideoSinkWants& wants) {
+    webrtc::MutexLock lock(&capture_mutex_);
+    broadcaster_.AddOrUpdateSink(sink, wants);
+    UpdateCapture();
 }
 
-void VideoCaptureSource::CaptureLoop() {
-        if (!m_screen_capture) {
-            std::cerr << "No Screen Capturer available" << std::endl;
-            return;
+void VideoCaptureSource::RemoveSink(rtc::VideoSinkInterface<webrtc::VideoFrame>* sink) {
+    webrtc::MutexLock lock(&capture_mutex_);
+    broadcaster_.RemoveSink(sink);
+    UpdateCapture();
+}
+
+void VideoCaptureSource::UpdateCapture() {
+    const bool wanted = broadcaster_.frame_wanted();
+    if (wanted == capturing_) {
+        return;
+    }
+    if (!m_screen_capture) {
+        std::cerr << "No Screen Capturer available" << std::endl;
+        return;
+    }
+    capturing_ = wanted;
+    if (wanted) {
+        m_screen_capture->AddFrameSink(this);
+        return;
+    }
+    m_screen_capture->RemoveFrameSink(this);
+    // The loop no longer calls us; a restart begins from a fresh picture.
+    last_frame_buffer_ = nullptr;
+}
+
+void VideoCaptureSource::DeliverFrame(const webrtc::VideoFrame& frame) {
+    broadcaster_.OnFrame(frame);
+    if (!first_frame_pending_.load(std::memory_order_relaxed) || !broadcaster_.frame_wanted()) {
+        return;
+    }
+    FirstFrameCallback callback;
+    {
+        webrtc::MutexLock lock(&first_frame_mutex_);
+        callback = std::move(first_frame_callback_);
+        first_frame_callback_ = nullptr;
+        first_frame_pending_ = false;
+    }
+    if (callback) {
+        callback();
+    }
+}
+
+void VideoCaptureSource::OnCapturedFrame(const webrtc::scoped_refptr<webrtc::I420Buffer>& frame,
+    const CaptureFrameInfo& info) {
+    const int64_t now_us = rtc::TimeMicros();
+
+    // A timeout or a pointer-only update is a static tick. The first
+    // frame is always delivered so new sinks get a picture.
+    bool changed = frame && (!last_frame_buffer_ || !info.change_map.Empty());
+    RefinementScheduler::Action action = refinement_.OnTick(changed);
+    if (action == RefinementScheduler::Action::kSkip && last_frame_buffer_ &&
+        now_us - last_capture_time_us_ >= kIdleRefreshIntervalUs) {
+        // Keep a slow heartbeat while idle so key frame requests
+        // from receivers can still be served.
+        action = RefinementScheduler::Action::kRefine;
+    }
+    if (action == RefinementScheduler::Action::kSkip) {
+        return;
+    }
+    if (action == RefinementScheduler::Action::kRefine) {
+        if (last_frame_buffer_) {
+            // Same image, empty update rect: the encoder spends the
+            // bits on quality instead of new content.
+            last_timestamp_us_ = std::max(rtc::TimeMicros(), last_timestamp_us_ + 1);
+            DeliverFrame(webrtc::VideoFrame::Builder()
+                .set_video_frame_buffer(last_frame_buffer_)
+                .set_timestamp_us(last_timestamp_us_)
+                .set_update_rect(webrtc::VideoFrame::UpdateRect{ 0, 0, 0, 0 })
+                .build());
+            last_capture_time_us_ = now_us;
         }
-        int64_t last_capture_time_us_ = 0;
-        int64_t  target_fps=33333; // 60 FPS
-        const int kMaxConsecutiveFailures = 5;
-        const int kInitialBackoffMs = 10;
-        const int kMaxBackoffMs = 1000;
-        int consecutive_failures_ = 0;
-        int current_backoff_ms_ = kInitialBackoffMs;
-        while (running_) {
-			int64_t now_us = rtc::TimeMicros();
-			int64_t elapsed_us = now_us - last_capture_time_us_;
-
-            if (elapsed_us< target_fps) {
-				rtc::Thread::Current()->SleepMs((target_fps - elapsed_us) / 1000);
-            }
-            std::optional<rtc::scoped_refptr<webrtc::I420Buffer>> 
-                i420_buffer_opt = m_screen_capture->CaptureFrame();
-             
-            if (!i420_buffer_opt.has_value()) {
-                consecutive_failures_++;
-                if (consecutive_failures_ > kMaxConsecutiveFailures) {
-                    rtc::Thread::Current()->SleepMs(current_backoff_ms_);
-                    current_backoff_ms_ = std::min(current_backoff_ms_ * 2, kMaxBackoffMs);
-                }
-                continue;
-            }
-            else {
-				consecutive_failures_ = 0;
-				current_backoff_ms_ = kInitialBackoffMs;
-            }
-           stats_->input_width = i420_buffer_opt.value()->width();
+        return;
+    }
+
+    stats_->input_width = frame->width();
+    stats_->input_height = frame->height();
+
+    const webrtc::I420Buffer& buffer = *frame;
+    ContentType content_type = content_classifier_.Classify(
+        buffer.DataY(), buffer.StrideY(), buffer.width(), buffer.height());
+    if (content_type_.exchange(content_type) != content_type) {
+        webrtc::MutexLock lock(&content_callback_mutex_);
+        if (content_type_callback_) {
+            content_type_callback_(content_type);
+        }
+    }
+
+    // Tell the encoder which part of the frame actually changed so
+    // it can skip the rest.
+    webrtc::VideoFrame::UpdateRect update_rect{ 0, 0, 0, 0 };
+    if (!last_frame_buffer_ || !info.change_map.BoundingBox(&update_rect.offset_x,
+        &update_rect.offset_y, &update_rect.width, &update_rect.height)) {
+        update_rect = webrtc::VideoFrame::UpdateRect{ 0, 0, buffer.width(), buffer.height() };
+    }
 
-                stats_->input_height = i420_buffer_opt.value()->height();
+    // Stamp the present time, not the delivery time, so the
+    // receiver lines it up with audio stamped the same way.
+    // A refinement frame may already have used a later time.
+    const int64_t delivery_time_us = rtc::TimeMicros();
+    int64_t timestamp_us = delivery_time_us;
+    if (info.capture_time_us != 0) {
+        AvSyncMonitor::Instance().RecordVideo(info.capture_time_us, delivery_time_us);
+        timestamp_us = info.capture_time_us;
+    }
+    last_timestamp_us_ = std::max(timestamp_us, last_timestamp_us_ + 1);
+
+    webrtc::VideoFrame video_frame = webrtc::VideoFrame::Builder()
+        .set_video_frame_buffer(frame)
+        .set_timestamp_us(last_timestamp_us_)
+        .set_update_rect(update_rect)
+        .build();
 
-                webrtc::VideoFrame frame = webrtc::VideoFrame::Builder()
-                    .set_video_frame_buffer(i420_buffer_opt.value())
-                    .set_timestamp_us(rtc::TimeMicros())
-                    .build();
+    DeliverFrame(video_frame);
+    last_frame_buffer_ = frame;
+    last_capture_time_us_ = now_us;
+}
 
-                broadcaster_.OnFrame(frame);
-                last_capture_time_us_ = now_us;
+AudioCaptureSource::AudioCaptureSource(const SilenceGate::Config& silence_gate,
+    const std::vector<AudioEndpoint>& extra_endpoints) :
+    AudioCaptureSource(AudioStreamCapture::GetInstance(), silence_gate)
+{
+    if (m_audio_stream_capture) {
+        // Extra endpoints are mixed in; one that fails to open is skipped
+        // rather than taking system audio down with it.
+        for (const AudioEndpoint& endpoint : extra_endpoints) {
+            std::unique_ptr<AudioStreamCapture> capture = AudioStreamCapture::Create(endpoint);
+            if (capture) {
+                AudioCaptureBackend* raw = capture.get();
+                AddInput(raw, std::move(capture), endpoint.gain);
+            }
         }
+    }
+    StartCapture();
 }
 
-AudioCaptureSource::AudioCaptureSource() :	
-    m_audio_broadcaster (new AudioBroadcaster()),
-    m_audio_stream_capture(AudioStreamCapture::GetInstance())
+AudioCaptureSource::AudioCaptureSource(std::unique_ptr<AudioCaptureBackend> backend,
+    const SilenceGate::Config& silence_gate) :
+    AudioCaptureSource(backend.get(), silence_gate)
 {
+    if (!m_inputs.empty()) {
+        m_inputs.front().owned = std::move(backend);
+    }
     StartCapture();
 }
+
+AudioCaptureSource::AudioCaptureSource(AudioCaptureBackend* primary, const SilenceGate::Config& silence_gate) :
+    m_audio_broadcaster (new AudioBroadcaster()),
+    m_audio_stream_capture(primary),
+    m_silence_gate(silence_gate),
+    m_audio_pump([this](const void* data, const AudioFormat& format, size_t number_of_frames,
+        int64_t capture_time_us) {
+        const size_t samples = number_of_frames * format.number_of_channels;
+        const double rms_dbfs = m_level_meter.Process(static_cast<const int16_t*>(data), samples);
+        if (!m_silence_gate.Process(rms_dbfs) && samples <= m_silent_block.size()) {
+            data = m_silent_block.data();
+        }
+        const int64_t now_us = rtc::TimeMicros();
+        if (capture_time_us != 0) {
+            AvSyncMonitor::Instance().RecordAudio(capture_time_us, now_us);
+        }
+        // The sink contract's absolute_capture_timestamp_ms is in ms; the
+        // pump and broadcaster stay in rtc micros up to this point.
+        m_audio_broadcaster->OnData(data, format.bits_per_sample, format.sample_rate,
+            format.number_of_channels, number_of_frames, (capture_time_us != 0 ? capture_time_us : now_us) / 1000);
+    })
+{
+    if (m_audio_stream_capture) {
+        AddInput(m_audio_stream_capture, nullptr, 1.0f);
+        const AudioFormat format = m_audio_stream_capture->Format();
+        m_silent_block.assign(AudioPump::kOutputSampleRate / 100 * format.number_of_channels, 0);
+    }
+}
+
+std::mutex AudioCaptureSource::shared_mutex_;
+AudioCaptureSource* AudioCaptureSource::shared_ = nullptr;
+std::function<std::unique_ptr<AudioCaptureBackend>()> AudioCaptureSource::shared_backend_;
+
+void AudioCaptureSource::SetSharedBackend(std::function<std::unique_ptr<AudioCaptureBackend>()> factory) {
+    std::lock_guard<std::mutex> lock(shared_mutex_);
+    shared_backend_ = std::move(factory);
+}
+
+webrtc::scoped_refptr<AudioCaptureSource> AudioCaptureSource::GetShared() {
+    std::lock_guard<std::mutex> lock(shared_mutex_);
+    if (shared_) {
+        // Release drops the last reference under this lock and clears
+        // shared_ before unlocking, so a source seen here is still alive.
+        return webrtc::scoped_refptr<AudioCaptureSource>(shared_);
+    }
+    shared_ = shared_backend_ ? new AudioCaptureSource(shared_backend_()) : new AudioCaptureSource();
+    return webrtc::scoped_refptr<AudioCaptureSource>(shared_);
+}
+
+void AudioCaptureSource::AddInput(AudioCaptureBackend* capture, std::unique_ptr<AudioCaptureBackend> owned, float gain) {
+    const AudioFormat format = capture->Format();
+    CaptureInput input;
+    input.capture = capture;
+    input.owned = std::move(owned);
+    input.ring = std::make_unique<SpscRingBuffer<uint8_t>>(
+        format.FramesPer10Ms() * (kRingCapacityMs / 10) * format.BytesPerFrame());
+    input.anchors = std::make_unique<SpscRingBuffer<AudioTimestampAnchor>>(kAnchorCapacity);
+    input.gain = gain;
+    m_inputs.push_back(std::move(input));
+}
+
+void AudioCaptureSource::SetEndpointGain(size_t index, float gain) {
+    if (index < m_inputs.size()) {
+        m_inputs[index].gain = gain;
+        m_audio_pump.SetInputGain(index, gain);
+    }
+}
 AudioCaptureSource::~AudioCaptureSource() {
 	StopCapture();
 }
@@ -106,16 +273,19 @@ void AudioCaptureSource::StartCapture() {
 		return;
 	}
     webrtc::MutexLock lock(&mutex_);
-    m_audio_stream_capture->StartStream();
+    for (CaptureInput& input : m_inputs) {
+        input.capture->StartStream();
+    }
 
     CaptureSource::StartCapture();
 }
 
 void AudioCaptureSource::StopCapture() {
-	if (m_audio_stream_capture) {
-		m_audio_stream_capture->StopStream();
-	}
+    for (CaptureInput& input : m_inputs) {
+        input.capture->StopStream();
+    }
     CaptureSource::StopCapture();
+    m_audio_pump.Stop();
 
 }
 
@@ -124,26 +294,34 @@ void AudioCaptureSource::CaptureLoop() {
         throw std::runtime_error("No Audio Stream Capturer available");
         return;
     }
+    // One thread serves every endpoint; the pump aligns and mixes them.
+    m_audio_pump.ClearInputs();
+    std::vector<HANDLE> events;
+    bool wait_on_events = true;
+    for (CaptureInput& input : m_inputs) {
+        m_audio_pump.AddInput(input.ring.get(), input.capture->Format(), input.anchors.get(), input.gain);
+        events.push_back(input.capture->PacketEvent());
+        wait_on_events = wait_on_events && events.back();
+    }
+    m_audio_pump.Start();
     while (running_&& m_audio_stream_capture->Started()) {
         try {
-            std::vector<BYTE> bytes;
-            int bits_per_sample, sample_rate;
-            size_t number_of_channels, number_of_frames;
-
-            m_audio_stream_capture->CaptureAudio(
-                bytes, &bits_per_sample, &sample_rate,
-                &number_of_channels, &number_of_frames);
-
-            if (number_of_frames <= 0) {
-                continue;
+            // Sleep until any device has a packet, then move everything they
+            // queued into their rings. Block sizing and pacing are the pump's job.
+            // Backends without an event are paced by the primary one.
+            if (wait_on_events) {
+                WaitForMultipleObjects(static_cast<DWORD>(events.size()), events.data(), FALSE, kPacketWaitTimeoutMs);
+            }
+            else {
+                m_audio_stream_capture->WaitForPacket(kPacketWaitTimeoutMs);
+            }
+            for (CaptureInput& input : m_inputs) {
+                input.capture->ReadPackets(input.ring.get(), input.anchors.get());
             }
-
-            m_audio_broadcaster->OnData(bytes.data(),
-                bits_per_sample,
-                sample_rate, number_of_channels, number_of_frames, rtc::TimeMicros());
         }
         catch (const std::exception& e) {
             std::cerr << "Exception in audio capture loop: " << e.what() << std::endl;
         }
     }
+    m_audio_pump.Stop();
 }
\ No newline at end of file
@@ -5,10 +5,21 @@
 #include <absl/types/optional.h>
 #include "ScreenCapture.h"
 #include "AudioStreamCapture.h"
+#include "AudioCaptureBackend.h"
+#include "AudioPump.h"
+#include "AudioLevel.h"
+#include "SpscRingBuffer.h"
+#include "CopyOnWriteList.h"
+#include "ContentClassifier.h"
+#include "RefinementScheduler.h"
 #include <memory>
 #include <iostream>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <vector>
 #include <rtc_base/synchronization/mutex.h>
-#include <unordered_map>
+#include <rtc_base/thread.h>
 class CaptureSource {
 public:
     ~CaptureSource();
@@ -29,19 +40,19 @@ protected:
 // on the worker thread via a VideoTrack. A custom implementation of a source
 // can inherit AdaptedVideoTrackSource instead of directly implementing this
 // interface.
-class VideoCaptureSource :public CaptureSource,public webrtc::VideoTrackSourceInterface {
+// Frames come from the ScreenCapture loop shared by every source; each
+// source only keeps its own refinement, classification and sinks.
+class VideoCaptureSource :public ScreenCapture::FrameSink,public webrtc::VideoTrackSourceInterface {
 public:
     VideoCaptureSource();
     ~VideoCaptureSource();
 
+    // The source subscribes to the shared screen capture loop only while a
+    // sink is attached, so one built ahead of time (for a pooled
+    // PeerConnection) does no capture work until a consumer gets it.
     void AddOrUpdateSink(rtc::VideoSinkInterface<webrtc::VideoFrame>* sink,
-        const rtc::VideoSinkWants& wants) override {
-        broadcaster_.AddOrUpdateSink(sink, wants);
-    }
-
-    void RemoveSink(rtc::VideoSinkInterface<webrtc::VideoFrame>* sink) override {
-        broadcaster_.RemoveSink(sink);
-    }
+        const rtc::VideoSinkWants& wants) override;
+    void RemoveSink(rtc::VideoSinkInterface<webrtc::VideoFrame>* sink) override;
     // Indicates that parameters suitable for screencasts should be automatically
     // applied to RtpSenders.
     // TODO(perkj): Remove these once all known applications have moved to
@@ -122,15 +133,57 @@ public:
         }
         return webrtc::RefCountReleaseStatus::kOtherRefsRemained;
     }
+
+    using ContentTypeCallback = std::function<void(ContentType)>;
+
+    // Latest debounced classification of the captured content.
+    ContentType content_type() const { return content_type_; }
+
+    // Invoked on the capture thread whenever content_type() changes.
+    void SetContentTypeCallback(ContentTypeCallback callback) {
+        webrtc::MutexLock lock(&content_callback_mutex_);
+        content_type_callback_ = std::move(callback);
+    }
+
+    using FirstFrameCallback = std::function<void()>;
+
+    // Invoked once, on the capture thread, after the first frame that
+    // reached a sink.
+    void SetFirstFrameCallback(FirstFrameCallback callback) {
+        webrtc::MutexLock lock(&first_frame_mutex_);
+        first_frame_callback_ = std::move(callback);
+        first_frame_pending_ = static_cast<bool>(first_frame_callback_);
+    }
 protected:
-    void CaptureLoop() override;
+    void OnCapturedFrame(const webrtc::scoped_refptr<webrtc::I420Buffer>& frame,
+        const CaptureFrameInfo& info) override;
 private:
+    // Starts or stops capture to match the broadcaster's sinks. Called with
+    // capture_mutex_ held.
+    void UpdateCapture();
+    void DeliverFrame(const webrtc::VideoFrame& frame);
+
     rtc::VideoBroadcaster broadcaster_;
     mutable std::atomic<int> ref_count_ = 0;
     ScreenCapture* m_screen_capture;
+    webrtc::Mutex capture_mutex_;
+    bool capturing_ = false;
 
     Stats* stats_;
 
+    ContentClassifier content_classifier_;
+    RefinementScheduler refinement_;
+    webrtc::scoped_refptr<webrtc::I420Buffer> last_frame_buffer_;
+    int64_t last_capture_time_us_ = 0;
+    int64_t last_timestamp_us_ = 0;
+    static constexpr int64_t kIdleRefreshIntervalUs = 1000000;
+    std::atomic<ContentType> content_type_ = ContentType::kText;
+    webrtc::Mutex content_callback_mutex_;
+    ContentTypeCallback content_type_callback_;
+    std::atomic<bool> first_frame_pending_ = false;
+    webrtc::Mutex first_frame_mutex_;
+    FirstFrameCallback first_frame_callback_;
+
 
 };
 
@@ -141,9 +194,13 @@ public:
     VideoCaptureTrack(std::string track_id) :enabled_(true),track_id_(std::move(track_id)),
         video_track_source(new VideoCaptureSource){
         video_track_source->AddRef();
-        
+        video_track_source->SetContentTypeCallback([observers = observers_](ContentType) {
+            NotifyObservers(observers);
+        });
     };
     ~VideoCaptureTrack() noexcept override {
+        video_track_source->SetContentTypeCallback(nullptr);
+        video_track_source->SetFirstFrameCallback(nullptr);
 		video_track_source->Release();
     };
 
@@ -156,12 +213,29 @@ public:
     void RemoveSink(rtc::VideoSinkInterface<webrtc::VideoFrame>* sink) override {
         video_track_source->RemoveSink(sink);
     }
+
+    // Each track has its own source, so its first frame is this track's.
+    void SetFirstFrameCallback(VideoCaptureSource::FirstFrameCallback callback) {
+        video_track_source->SetFirstFrameCallback(std::move(callback));
+    }
     
+    // An explicitly set hint wins; otherwise follow the content classifier so
+    // WebRTC keeps resolution for text and frame rate for motion.
     ContentHint content_hint() const override {
-        return ContentHint::kNone;
+        ContentHint hint = content_hint_override_;
+        if (hint != ContentHint::kNone) {
+            return hint;
+        }
+        return video_track_source->content_type() == ContentType::kMotion
+            ? ContentHint::kFluid
+            : ContentHint::kText;
     }
     
-    void set_content_hint(ContentHint /* hint */) override {};
+    void set_content_hint(ContentHint hint) override {
+        if (content_hint_override_.exchange(hint) != hint) {
+            NotifyObservers(observers_);
+        }
+    };
 
     std::string kind() const override {
         return kVideoKind;
@@ -188,11 +262,19 @@ public:
     }
 
 
+    // Observers (the RtpSender) are registered from the signaling thread and
+    // expect OnChanged() there, so remember it for notifications raised on
+    // the capture thread.
     void RegisterObserver(webrtc::ObserverInterface* observer) override {
-        
+        webrtc::MutexLock lock(&observers_->mutex);
+        observers_->thread = rtc::Thread::Current();
+        observers_->list.push_back(observer);
     }
 
     void UnregisterObserver(webrtc::ObserverInterface* observer) override {
+        webrtc::MutexLock lock(&observers_->mutex);
+        auto& list = observers_->list;
+        list.erase(std::remove(list.begin(), list.end(), observer), list.end());
     }
 
     void AddRef() const override{ ++ref_count_; }
@@ -208,24 +290,61 @@ public:
 
 
 private:
+    // Shared with the source's content callback so a notification in flight
+    // never touches the track itself.
+    struct ObserverList {
+        webrtc::Mutex mutex;
+        rtc::Thread* thread = nullptr;
+        std::vector<webrtc::ObserverInterface*> list;
+    };
+
+    static void NotifyObservers(const std::shared_ptr<ObserverList>& observers) {
+        rtc::Thread* thread;
+        {
+            webrtc::MutexLock lock(&observers->mutex);
+            thread = observers->thread;
+        }
+        if (!thread) {
+            return;
+        }
+        if (!thread->IsCurrent()) {
+            thread->PostTask([observers]() { NotifyObservers(observers); });
+            return;
+        }
+        // Notify from a copy so an observer may unregister (or register)
+        // from inside OnChanged without deadlocking on the list lock.
+        std::vector<webrtc::ObserverInterface*> list;
+        {
+            webrtc::MutexLock lock(&observers->mutex);
+            list = observers->list;
+        }
+        for (webrtc::ObserverInterface* observer : list) {
+            observer->OnChanged();
+        }
+    }
+
     mutable std::atomic<int> ref_count_ = 0;
     bool enabled_;
 
     std::string track_id_;
     VideoCaptureSource* video_track_source;
+
+    std::atomic<ContentHint> content_hint_override_ = ContentHint::kNone;
+    std::shared_ptr<ObserverList> observers_ = std::make_shared<ObserverList>();
 };
 
 
+// Fans captured audio out to every sink. OnData runs on the audio pump
+// thread and never blocks on AddSink/RemoveSink from the signaling thread.
+// RemoveSink returns only once the sink can no longer be called.
 class AudioBroadcaster : public webrtc::AudioTrackSinkInterface,public webrtc::RefCountInterface {
 public:
     void AddSink(webrtc::AudioTrackSinkInterface* sink)  {
-        webrtc::MutexLock lock(&mutex_);
-        sinks_.insert({ sink,sink });
+        sinks_.Add(sink);
     }
 
     void RemoveSink(webrtc::AudioTrackSinkInterface* sink)  {
-        webrtc::MutexLock lock(&mutex_);
-        sinks_.erase(sink);
+        sinks_.Remove(sink);
     }
 
     void OnData(const void* audio_data,
@@ -235,11 +354,10 @@ public:
         size_t number_of_frames,
         std::optional<int64_t> timestamp) override{
 
-        webrtc::MutexLock lock(&mutex_);
-        for (const auto& [_, sink] : sinks_) {
+        sinks_.ForEach([&](webrtc::AudioTrackSinkInterface* sink) {
             sink->OnData(audio_data, bits_per_sample, 
                 sample_rate, number_of_channels, number_of_frames, timestamp);
-        }
+        });
     }
     void AddRef() const override { ++ref_count_; }
 
@@ -253,16 +371,17 @@ public:
     }
 
 private:
-    webrtc::Mutex mutex_;
-    std::unordered_map<webrtc::AudioTrackSinkInterface*, 
-       webrtc::AudioTrackSinkInterface*> sinks_;
+    CopyOnWriteList<webrtc::AudioTrackSinkInterface*> sinks_;
     mutable std::atomic<int> ref_count_ = 0;
 
 };
 
 
 // AudioSourceInterface is a reference counted source used for AudioTracks.
-// The same source can be used by multiple AudioTracks.
+// The same source can be used by multiple AudioTracks. Peers share the one
+// returned by GetShared(): a single capture thread and pump feed every
+// track's sinks through the broadcaster, so the audio work does not grow
+// with the number of viewers.
 class  AudioCaptureSource :public CaptureSource, public webrtc::AudioSourceInterface {
 public:
     // TODO(deadbeef): Makes all the interfaces pure virtual after they're
@@ -271,8 +390,24 @@ public:
     // Sets the volume of the source. `volume` is in  the range of [0, 10].
     // TODO(tommi): This method should be on the track and ideally volume should
     // be applied in the track in a way that does not affect clones of the track.
-    AudioCaptureSource();
+    // The default loopback endpoint is always captured; `extra_endpoints`
+    // (e.g. a microphone) are mixed into the same stream.
+    explicit AudioCaptureSource(const SilenceGate::Config& silence_gate = SilenceGate::Config(),
+        const std::vector<AudioEndpoint>& extra_endpoints = {});
+    // Captures from `backend` instead of WASAPI, e.g. a synthetic or file
+    // source for headless runs.
+    explicit AudioCaptureSource(std::unique_ptr<AudioCaptureBackend> backend,
+        const SilenceGate::Config& silence_gate = SilenceGate::Config());
     ~AudioCaptureSource();
+
+    // The process-wide source, created on first use. It stops capturing
+    // and is destroyed when the last reference goes away; the next call
+    // then starts a fresh one.
+    static webrtc::scoped_refptr<AudioCaptureSource> GetShared();
+    // Makes the next shared source capture from what `factory` returns
+    // instead of the default loopback endpoint. Null restores WASAPI.
+    static void SetSharedBackend(std::function<std::unique_ptr<AudioCaptureBackend>()> factory);
+
     void SetVolume(double /* volume */) override {}
 
     // Registers/unregisters observers to the audio source.
@@ -313,26 +448,83 @@ public:
     void AddRef() const override { ++ref_count_; }
 
     webrtc::RefCountReleaseStatus Release()const override {
-        int count = --ref_count_;
-        if (count == 0) {
-            delete this;
-            return webrtc::RefCountReleaseStatus::kDroppedLastRef;
+        // Only the last reference needs the lock; drop any other one without it.
+        int count = ref_count_.load();
+        while (count > 1 && !ref_count_.compare_exchange_weak(count, count - 1)) {
         }
-        return webrtc::RefCountReleaseStatus::kOtherRefsRemained;
+        if (count > 1) {
+            return webrtc::RefCountReleaseStatus::kOtherRefsRemained;
+        }
+        // The final decrement and the teardown both happen under the lock, so
+        // GetShared either revives this source or waits until it is gone and
+        // never opens the devices while this one still reads them.
+        std::lock_guard<std::mutex> lock(shared_mutex_);
+        if (--ref_count_ != 0) {
+            return webrtc::RefCountReleaseStatus::kOtherRefsRemained;
+        }
+        if (shared_ == this) {
+            shared_ = nullptr;
+        }
+        delete this;
+        return webrtc::RefCountReleaseStatus::kDroppedLastRef;
     }
     
     
     void StartCapture() override;
 	void StopCapture() override;
 
+    // Peak level (0..32767) of the delivered audio, refreshed every 100 ms.
+    int SignalLevel() const { return m_level_meter.Level(); }
+    // False while the silence gate is holding the stream at digital silence.
+    bool SignalActive() const { return m_silence_gate.Open(); }
+
+    // Mixing gain of endpoint `index`: 0 is the default loopback, then
+    // the extra endpoints that opened, in order.
+    void SetEndpointGain(size_t index, float gain);
+
 protected:
 	void CaptureLoop() override;
 private:
+    // Upper bound on how long the capture thread sleeps without an event.
+    static constexpr uint32_t kPacketWaitTimeoutMs = 20;
+    // Ring capacity; the pump keeps the fill level far below this.
+    static constexpr int kRingCapacityMs = 200;
+    // One anchor per device packet; packets are rarely shorter than 1 ms.
+    static constexpr size_t kAnchorCapacity = 256;
+
+    // The capture thread produces device packets into each endpoint's ring;
+    // the pump drains them in 10 ms blocks towards the broadcaster.
+    struct CaptureInput {
+        AudioCaptureBackend* capture = nullptr;
+        std::unique_ptr<AudioCaptureBackend> owned;  // Null for the shared default loopback
+        std::unique_ptr<SpscRingBuffer<uint8_t>> ring;
+        // Device capture instants for positions in `ring`.
+        std::unique_ptr<SpscRingBuffer<AudioTimestampAnchor>> anchors;
+        float gain = 1.0f;
+    };
+
+    // Sets up delivery with `primary` as input 0; the public constructors
+    // add any further inputs and start capturing.
+    AudioCaptureSource(AudioCaptureBackend* primary, const SilenceGate::Config& silence_gate);
+    void AddInput(AudioCaptureBackend* capture, std::unique_ptr<AudioCaptureBackend> owned, float gain);
 
     webrtc::scoped_refptr<AudioBroadcaster> m_audio_broadcaster;
-	AudioStreamCapture* m_audio_stream_capture;
+	AudioCaptureBackend* m_audio_stream_capture;
+    std::vector<CaptureInput> m_inputs;  // [0] is m_audio_stream_capture
+    // Both run on the pump thread, on each 10 ms block before delivery.
+    AudioLevelMeter m_level_meter;
+    SilenceGate m_silence_gate;
+    // Delivered in place of gated blocks. The cadence has to continue since
+    // WebRTC derives RTP timestamps from the samples it is given; zeros let
+    // Opus DTX suppress the packets instead.
+    std::vector<int16_t> m_silent_block;
+    AudioPump m_audio_pump;
     mutable std::atomic<int> ref_count_ = 0;
 
+    static std::mutex shared_mutex_;
+    static AudioCaptureSource* shared_;  // Not owned; guarded by shared_mutex_
+    static std::function<std::unique_ptr<AudioCaptureBackend>()> shared_backend_;
+
 };
 
 
@@ -340,8 +532,7 @@ class AudioCaptureTrack : public webrtc::AudioTrackInterface {
 public:
     AudioCaptureTrack(std::string track_id):
         enabled_(true), track_id_(std::move(track_id)), 
-        m_audio_source(new AudioCaptureSource){
-		m_audio_source->AddRef();
+        m_audio_source(AudioCaptureSource::GetShared().release()){
     }
     ~AudioCaptureTrack() noexcept override {
 		m_audio_source->Release();
@@ -365,7 +556,8 @@ public:
     // TODO(deadbeef): Change the interface to int GetSignalLevel() and pure
     // virtual after it's implemented in chromium.
     bool GetSignalLevel(int* level) override {
-        return false;
+        *level = m_audio_source->SignalLevel();
+        return true;
     };
 
     // Get the audio processor used by the audio track. Return null if the track
@@ -419,5 +611,5 @@ protected:
     bool enabled_;
 
     std::string track_id_;
-    webrtc::AudioSourceInterface* m_audio_source;
+    AudioCaptureSource* m_audio_source;
 };
\ No newline at end of file
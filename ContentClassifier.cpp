@@ -0,0 +1,109 @@
+// ContentClassifier.cpp
+#include "ContentClassifier.h"
+#include <algorithm>
+#include <cstdlib>
+
+void ContentClassifier::Reset() {
+    previous_.clear();
+    block_changed_.clear();
+    grid_width_ = 0;
+    grid_height_ = 0;
+    features_ = ContentFeatures();
+    current_ = ContentType::kText;
+    disagreeing_frames_ = 0;
+}
+
+ContentType ContentClassifier::Classify(const uint8_t* y_plane, int stride, int width, int height) {
+    if (!y_plane || width <= kSampleStep || height <= 0) {
+        return current_;
+    }
+
+    const int grid_width = (width - 1) / kSampleStep;  // Leave room for the edge neighbour
+    const int grid_height = (height + kSampleStep - 1) / kSampleStep;
+    const int blocks_w = (width + kBlockSize - 1) / kBlockSize;
+    const int blocks_h = (height + kBlockSize - 1) / kBlockSize;
+
+    // Resolution change: there is nothing to diff against, start over.
+    if (grid_width != grid_width_ || grid_height != grid_height_) {
+        grid_width_ = grid_width;
+        grid_height_ = grid_height;
+        previous_.assign(static_cast<size_t>(grid_width) * grid_height, 0);
+        block_changed_.assign(static_cast<size_t>(blocks_w) * blocks_h, 0);
+        for (int gy = 0; gy < grid_height; ++gy) {
+            const uint8_t* row = y_plane + static_cast<size_t>(gy) * kSampleStep * stride;
+            for (int gx = 0; gx < grid_width; ++gx) {
+                previous_[static_cast<size_t>(gy) * grid_width + gx] = row[gx * kSampleStep];
+            }
+        }
+        features_ = ContentFeatures();
+        return current_;
+    }
+
+    std::fill(block_changed_.begin(), block_changed_.end(), 0);
+
+    // First pass: diff against the previous frame and mark changed blocks.
+    size_t changed_samples = 0;
+    for (int gy = 0; gy < grid_height; ++gy) {
+        const uint8_t* row = y_plane + static_cast<size_t>(gy) * kSampleStep * stride;
+        uint8_t* prev = &previous_[static_cast<size_t>(gy) * grid_width];
+        uint8_t* blocks = &block_changed_[static_cast<size_t>(gy * kSampleStep / kBlockSize) * blocks_w];
+        for (int gx = 0; gx < grid_width; ++gx) {
+            const uint8_t value = row[gx * kSampleStep];
+            if (std::abs(value - prev[gx]) > kPixelChangeThreshold) {
+                ++changed_samples;
+                blocks[gx * kSampleStep / kBlockSize] = 1;
+            }
+            prev[gx] = value;
+        }
+    }
+
+    size_t changed_blocks = 0;
+    for (uint8_t changed : block_changed_) {
+        changed_blocks += changed;
+    }
+
+    // Second pass: edge density, restricted to the changed area when there is one.
+    size_t edge_samples = 0;
+    size_t considered_samples = 0;
+    for (int gy = 0; gy < grid_height; ++gy) {
+        const uint8_t* row = y_plane + static_cast<size_t>(gy) * kSampleStep * stride;
+        const uint8_t* blocks = &block_changed_[static_cast<size_t>(gy * kSampleStep / kBlockSize) * blocks_w];
+        for (int gx = 0; gx < grid_width; ++gx) {
+            if (changed_blocks && !blocks[gx * kSampleStep / kBlockSize]) {
+                continue;
+            }
+            const int x = gx * kSampleStep;
+            ++considered_samples;
+            if (std::abs(row[x] - row[x + 1]) > kEdgeThreshold) {
+                ++edge_samples;
+            }
+        }
+    }
+
+    const size_t samples_per_block = (kBlockSize / kSampleStep) * (kBlockSize / kSampleStep);
+    features_.change_area = static_cast<double>(changed_blocks) / block_changed_.size();
+    features_.motion_ratio = changed_blocks
+        ? static_cast<double>(changed_samples) / (changed_blocks * samples_per_block)
+        : 0.0;
+    features_.edge_density = considered_samples
+        ? static_cast<double>(edge_samples) / considered_samples
+        : 0.0;
+
+    if (RawDecision() == current_) {
+        disagreeing_frames_ = 0;
+    }
+    else if (++disagreeing_frames_ >= kHysteresisFrames) {
+        current_ = current_ == ContentType::kText ? ContentType::kMotion : ContentType::kText;
+        disagreeing_frames_ = 0;
+    }
+    return current_;
+}
+
+ContentType ContentClassifier::RawDecision() const {
+    if (features_.change_area >= kMotionMinChangeArea &&
+        features_.motion_ratio >= kMotionMinRatio &&
+        features_.edge_density <= kMotionMaxEdgeDensity) {
+        return ContentType::kMotion;
+    }
+    return ContentType::kText;
+}
@@ -0,0 +1,59 @@
+// ContentClassifier.h
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Broad class of what is currently on screen. Drives encoder tuning and the
+// content hint that WebRTC uses to pick its degradation preference.
+enum class ContentType {
+    kText,   // Mostly static, high-detail content (documents, code, UI)
+    kMotion  // Large, smoothly changing regions (video playback, games)
+};
+
+// Per-frame measurements taken on a subsampled luma grid.
+struct ContentFeatures {
+    double motion_ratio = 0.0;  // Share of samples inside changed blocks that changed
+    double edge_density = 0.0;  // Share of samples (in changed blocks, if any) on a sharp edge
+    double change_area = 0.0;   // Share of 16x16 blocks touched by any change
+};
+
+// Lightweight screen content classifier meant to run on the capture thread.
+// Only every kSampleStep-th pixel in each direction is inspected, so the cost
+// is a small fraction of the ARGB->I420 conversion that precedes it.
+class ContentClassifier {
+public:
+    ContentClassifier() = default;
+
+    // Analyzes the luma plane of a newly captured frame and returns the
+    // debounced classification. A switch only happens after the raw decision
+    // has been stable for kHysteresisFrames frames.
+    ContentType Classify(const uint8_t* y_plane, int stride, int width, int height);
+
+    ContentType Current() const { return current_; }
+    const ContentFeatures& LastFeatures() const { return features_; }
+    void Reset();
+
+private:
+    static constexpr int kSampleStep = 4;
+    static constexpr int kBlockSize = 16;
+    static constexpr int kPixelChangeThreshold = 12;
+    static constexpr int kEdgeThreshold = 48;
+    static constexpr int kHysteresisFrames = 10;
+
+    // A frame looks like motion when a sizeable area changes densely and the
+    // changed area carries few sharp edges (text scrolling has many).
+    static constexpr double kMotionMinChangeArea = 0.10;
+    static constexpr double kMotionMinRatio = 0.60;
+    static constexpr double kMotionMaxEdgeDensity = 0.10;
+
+    ContentType RawDecision() const;
+
+    std::vector<uint8_t> previous_;       // Subsampled luma of the previous frame
+    std::vector<uint8_t> block_changed_;  // Scratch, one entry per 16x16 block
+    int grid_width_ = 0;
+    int grid_height_ = 0;
+
+    ContentFeatures features_;
+    ContentType current_ = ContentType::kText;
+    int disagreeing_frames_ = 0;
+};
@@ -0,0 +1,95 @@
+// CopyOnWriteList.h
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// RCU-style list for fan-out on real-time threads. Readers iterate an
+// immutable snapshot without taking a lock; writers copy the snapshot, modify
+// the copy and publish it with one atomic pointer swap. The old snapshot is
+// deleted only after every reader that could still see it has finished (a
+// grace period), so once Remove() returns the removed item is no longer being
+// used by any ForEach().
+//
+// ForEach() callbacks must not call Add()/Remove() on the same list: the
+// grace period would wait for the calling reader and never end.
+template <typename T>
+class CopyOnWriteList {
+public:
+    CopyOnWriteList() : items_(new std::vector<T>()) {}
+    ~CopyOnWriteList() { delete items_.load(); }
+
+    CopyOnWriteList(const CopyOnWriteList&) = delete;
+    CopyOnWriteList& operator=(const CopyOnWriteList&) = delete;
+
+    // Adds `item` unless it is already present. Returns true if it was added.
+    bool Add(const T& item) {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        const std::vector<T>* current = items_.load();
+        if (std::find(current->begin(), current->end(), item) != current->end()) {
+            return false;
+        }
+        auto* next = new std::vector<T>(*current);
+        next->push_back(item);
+        Publish(next);
+        return true;
+    }
+
+    // Removes `item`. Returns true if it was present.
+    bool Remove(const T& item) {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        const std::vector<T>* current = items_.load();
+        auto it = std::find(current->begin(), current->end(), item);
+        if (it == current->end()) {
+            return false;
+        }
+        auto* next = new std::vector<T>(current->begin(), it);
+        next->insert(next->end(), it + 1, current->end());
+        Publish(next);
+        return true;
+    }
+
+    // Calls fn(item) for every item in the current snapshot. Lock-free.
+    template <typename Fn>
+    void ForEach(Fn&& fn) const {
+        const int epoch = epoch_.load() & 1;
+        readers_[epoch].fetch_add(1);
+        const std::vector<T>* snapshot = items_.load();
+        for (const T& item : *snapshot) {
+            fn(item);
+        }
+        readers_[epoch].fetch_sub(1);
+    }
+
+    size_t Size() const {
+        size_t size = 0;
+        ForEach([&size](const T&) { ++size; });
+        return size;
+    }
+
+    bool Empty() const { return Size() == 0; }
+
+private:
+    // Swaps in `next`, then waits out a grace period: the reader epoch is
+    // flipped and drained twice, so a reader that sampled the epoch just
+    // before a flip is still waited for. Readers arriving afterwards can only
+    // see `next`. Must hold writer_mutex_.
+    void Publish(std::vector<T>* next) {
+        const std::vector<T>* previous = items_.exchange(next);
+        for (int flip = 0; flip < 2; ++flip) {
+            const int old_epoch = epoch_.fetch_add(1) & 1;
+            while (readers_[old_epoch].load() != 0) {
+                std::this_thread::yield();
+            }
+        }
+        delete previous;
+    }
+
+    std::atomic<std::vector<T>*> items_;
+    std::atomic<int> epoch_ = 0;
+    mutable std::atomic<int> readers_[2] = { 0, 0 };
+    std::mutex writer_mutex_;
+};
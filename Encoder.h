@@ -1,12 +1,20 @@
 //Encoder.h
 #pragma once
 #include "FFmpegSystem.h"
+#include "ContentClassifier.h"
+#include "BlockChangeMap.h"
+#include "EncoderPool.h"
 #include <string>
 #include <memory>
+#include <vector>
+#include <functional>
 
 struct AVCodecContext;
 struct AVFrame;
 struct AVPacket;
+struct AVAudioFifo;
+struct AVBufferPool;
+struct SwrContext;
 
 class Encoder {
 protected:
@@ -33,17 +41,46 @@ public:
 };
 
 class AudioEncoder : public Encoder {
+public:
+	using PacketCallback = std::function<void(const AVPacket* packet)>;
 private:
 	int sampleRate;
 	int channels;
 	int sampleFormat;
+
+	// PCM accumulation: input blocks of any size are converted to the codec
+	// format, queued in the FIFO and cut into codec-sized frames. Everything
+	// is allocated in Open() (or when the input format changes), not per call.
+	static constexpr int kMaxInputChunkFrames = 4800;  // 100 ms at 48 kHz
+	SwrContext* resampler;
+	int resamplerInRate;
+	int resamplerInChannels;
+	int resamplerInFormat;
+	AVAudioFifo* fifo;
+	uint8_t** convertBuffer;
+	int convertCapacity;
+	AVFrame* codecFrame;
+	AVPacket* codecPacket;
+	AVBufferPool* packetPool;
+	int64_t nextPts;
+
+	bool ConfigureResampler(int inRate, int inChannels, int inFormat);
+	bool EncodeQueuedFrames(const PacketCallback& onPacket);
+	static int GetPacketBuffer(AVCodecContext* context, AVPacket* packet, int flags);
 public:
 	AudioEncoder();
 	~AudioEncoder() override;
 
 	bool Open() override;
+	bool Close() override;
 	bool EncodeFrame(const AVFrame* frame, AVPacket* packet) override;
 
+	// Accepts interleaved PCM blocks of any length, rate and channel count
+	// (16-bit integer or 32-bit float). Samples are resampled to the codec
+	// format and buffered; `onPacket` runs once per complete codec frame.
+	bool EncodePcm(const void* data, int bitsPerSample, int inputSampleRate,
+		size_t inputChannels, size_t frames, const PacketCallback& onPacket);
+
 	// AudioEncoder-Specific methods
 	void SetSampleRate(int sampleRate);
 	int SampleRate() const;
@@ -60,13 +97,45 @@ private:
 	int height;
 	int frameRate;
 	int pixelFormat;
+	ContentType contentMode;
+	ContentType pendingContentMode;
+	int64_t frameIndex;
+	// Caller pts of the session's first frame; the encoder sees pts from 0.
+	int64_t ptsBase;
+
+	// Region-of-interest state, built from the capture change map.
+	struct RoiRect {
+		int left, top, right, bottom;
+		uint8_t level;
+	};
+	BlockChangeMap changeMap;
+	bool hasChangeMap;
+	std::vector<RoiRect> roiRects;
+	AVFrame* roiFrame;
+	int refinementFrames;
+
+	// Configuration the current context was opened with.
+	EncoderConfig openConfig;
+
+	static void ApplyContentTuning(AVCodecContext* context, const EncoderConfig& config);
+	void BuildRoiRects();
+	const AVFrame* AttachRoi(const AVFrame* frame);
+	const AVFrame* StartSession(const AVFrame* input);
 public:
 	FrameEncoder();
 	~FrameEncoder() override;
 
 	bool Open() override;
+	bool Close() override;
 	bool EncodeFrame(const AVFrame* frame, AVPacket* packet) override;
 
+	// Configuration an Open() call would use with the current settings.
+	EncoderConfig Config() const;
+
+	// Finds and opens a codec context for `config`. Used by Open() on a pool
+	// miss and by EncoderPool::Warm().
+	static AVCodecContext* OpenContext(const EncoderConfig& config);
+
 	// FrameEncoder-Specific methods
 	void SetWidth(int width);
 	int Width() const;
@@ -76,4 +145,18 @@ public:
 	int FrameRate() const;
 	void SetPixelFormat(int pixelFormat);
 	int PixelFormat() const;
+
+	// Requests text- or motion-optimized tuning. The switch is deferred to
+	// the next GOP boundary so it coincides with a key frame.
+	void SetContentMode(ContentType mode);
+	ContentType ContentMode() const;
+
+	// Change map for the next frame passed to EncodeFrame(). It is turned
+	// into per-region quantizer offsets: unchanged blocks are pushed towards
+	// skip, changed blocks get extra bits. Only used with libx264.
+	void SetChangeMap(const BlockChangeMap& map);
+
+	// Encodes the next `frames` frames with a whole-frame negative quantizer
+	// offset, so static content converges to full quality quickly.
+	void RequestRefinement(int frames);
 };	
\ No newline at end of file
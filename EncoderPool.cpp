@@ -0,0 +1,89 @@
+// EncoderPool.cpp
+#include "EncoderPool.h"
+#include "Encoder.h"
+#include <iostream>
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+EncoderPool::EncoderPool()
+	: maxIdlePerConfig(4) {
+}
+
+EncoderPool::~EncoderPool() {
+	Clear();
+}
+
+EncoderPool& EncoderPool::GetInstance() {
+	static EncoderPool instance;
+	return instance;
+}
+
+size_t EncoderPool::Warm(const EncoderConfig& config, size_t count) {
+	size_t available = Available(config);
+	while (available < count) {
+		// Open outside the lock; this is the slow part.
+		AVCodecContext* context = FrameEncoder::OpenContext(config);
+		if (!context) {
+			std::cerr << "Failed to warm encoder '" << config.codecName << "'" << std::endl;
+			break;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		idle[config].push_back(context);
+		available = idle[config].size();
+	}
+	return available;
+}
+
+AVCodecContext* EncoderPool::Acquire(const EncoderConfig& config) {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = idle.find(config);
+	if (it == idle.end() || it->second.empty()) {
+		return nullptr;
+	}
+	AVCodecContext* context = it->second.back();
+	it->second.pop_back();
+	return context;
+}
+
+void EncoderPool::Recycle(const EncoderConfig& config, AVCodecContext* context) {
+	if (!context) {
+		return;
+	}
+	// Without flush support the encoder would carry state (reference frames,
+	// rate control history) into the next session.
+	if (!(context->codec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH)) {
+		avcodec_free_context(&context);
+		return;
+	}
+	avcodec_flush_buffers(context);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<AVCodecContext*>& contexts = idle[config];
+	if (contexts.size() >= maxIdlePerConfig) {
+		avcodec_free_context(&context);
+		return;
+	}
+	contexts.push_back(context);
+}
+
+size_t EncoderPool::Available(const EncoderConfig& config) {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = idle.find(config);
+	return it == idle.end() ? 0 : it->second.size();
+}
+
+void EncoderPool::SetMaxIdlePerConfig(size_t count) {
+	std::lock_guard<std::mutex> lock(mutex);
+	maxIdlePerConfig = count;
+}
+
+void EncoderPool::Clear() {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto& [config, contexts] : idle) {
+		for (AVCodecContext* context : contexts) {
+			avcodec_free_context(&context);
+		}
+	}
+	idle.clear();
+}
@@ -0,0 +1,65 @@
+// EncoderPool.h
+#pragma once
+#include "FFmpegSystem.h"
+#include "ContentClassifier.h"
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+struct AVCodecContext;
+
+// Everything that makes two opened encoder contexts interchangeable.
+struct EncoderConfig {
+	std::string codecName;
+	int width = 0;
+	int height = 0;
+	int frameRate = 0;
+	int bitrate = 0;
+	int pixelFormat = 0;
+	ContentType contentMode = ContentType::kText;
+
+	bool operator<(const EncoderConfig& other) const {
+		return std::tie(codecName, width, height, frameRate, bitrate, pixelFormat, contentMode) <
+			std::tie(other.codecName, other.width, other.height, other.frameRate, other.bitrate,
+				other.pixelFormat, other.contentMode);
+	}
+};
+
+// Process-wide pool of already opened video encoder contexts. Finding and
+// opening an encoder costs tens of milliseconds, so contexts are opened ahead
+// of time (Warm) and handed back when a session ends (Recycle) instead of
+// being freed.
+class EncoderPool {
+private:
+	// Holds FFmpeg initialized for as long as the pool exists.
+	FFmpegInitializer ffmpegInit;
+	std::mutex mutex;
+	std::map<EncoderConfig, std::vector<AVCodecContext*>> idle;
+	size_t maxIdlePerConfig;
+
+	EncoderPool();
+	~EncoderPool();
+
+public:
+	EncoderPool(const EncoderPool&) = delete;
+	EncoderPool& operator=(const EncoderPool&) = delete;
+
+	static EncoderPool& GetInstance();
+
+	// Opens contexts for `config` until `count` are idle. Returns the number
+	// of idle contexts for the configuration afterwards.
+	size_t Warm(const EncoderConfig& config, size_t count);
+
+	// Takes an idle context for `config`, or nullptr if none is pooled.
+	AVCodecContext* Acquire(const EncoderConfig& config);
+
+	// Returns a context once its session ends. It is flushed and kept when
+	// the codec supports encoder flushing, otherwise freed.
+	void Recycle(const EncoderConfig& config, AVCodecContext* context);
+
+	size_t Available(const EncoderConfig& config);
+	void SetMaxIdlePerConfig(size_t count);
+	void Clear();
+};
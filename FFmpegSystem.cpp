@@ -24,7 +24,11 @@ bool FFmpegSystem::Initialize() {
 
 void FFmpegSystem::Uninitialize() {
 	std::lock_guard<std::mutex> lock(initMutex);
-	if (refCount.fetch_sub(-1)==1) {
+	// Unbalanced call: never let the count go negative.
+	if (refCount.load() == 0) {
+		return;
+	}
+	if (refCount.fetch_sub(1) == 1) {
 		avformat_network_deinit();
 
 		isInitialized = false;
@@ -34,6 +34,12 @@ public:
         FFmpegSystem::Initialize();
     }
 
+    // Every copy holds its own reference, so destroying it stays balanced.
+    FFmpegInitializer(const FFmpegInitializer&) {
+        FFmpegSystem::Initialize();
+    }
+    FFmpegInitializer& operator=(const FFmpegInitializer&) = default;
+
     ~FFmpegInitializer() {
         FFmpegSystem::Uninitialize();
     }
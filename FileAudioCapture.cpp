@@ -0,0 +1,152 @@
+// FileAudioCapture.cpp
+#include "FileAudioCapture.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace {
+constexpr uint16_t kWaveFormatPcm = 0x0001;
+constexpr uint16_t kWaveFormatFloat = 0x0003;
+constexpr uint16_t kWaveFormatExtensible = 0xFFFE;
+// Frames converted per AudioConverter call while decoding.
+constexpr size_t kDecodeChunkFrames = 4800;
+
+template <typename T>
+T ReadLe(const uint8_t* p) {
+    T value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// Locates the PCM payload of a RIFF/WAVE file and describes it. 24-bit
+// samples are reported as kInt32 with `packed24` set; they are widened
+// before conversion.
+bool ParseWav(const std::vector<uint8_t>& file, DeviceFormat* format, bool* packed24, size_t* data_offset,
+    size_t* data_size) {
+    if (file.size() < 12 || std::memcmp(file.data(), "RIFF", 4) != 0 || std::memcmp(file.data() + 8, "WAVE", 4) != 0) {
+        std::cerr << "Not a RIFF/WAVE file" << std::endl;
+        return false;
+    }
+    bool have_format = false;
+    size_t offset = 12;
+    while (offset + 8 <= file.size()) {
+        const uint8_t* chunk = file.data() + offset;
+        const size_t size = ReadLe<uint32_t>(chunk + 4);
+        const size_t body = offset + 8;
+        if (std::memcmp(chunk, "fmt ", 4) == 0 && size >= 16 && body + size <= file.size()) {
+            uint16_t tag = ReadLe<uint16_t>(chunk + 8);
+            const uint16_t channels = ReadLe<uint16_t>(chunk + 10);
+            const uint32_t rate = ReadLe<uint32_t>(chunk + 12);
+            const uint16_t bits = ReadLe<uint16_t>(chunk + 22);
+            if (tag == kWaveFormatExtensible && size >= 40) {
+                // The sub-format GUID starts with the plain format tag.
+                tag = ReadLe<uint16_t>(chunk + 8 + 24);
+            }
+            *packed24 = false;
+            if (tag == kWaveFormatFloat && bits == 32) {
+                format->sample_type = SampleType::kFloat32;
+            }
+            else if (tag == kWaveFormatPcm && bits == 16) {
+                format->sample_type = SampleType::kInt16;
+            }
+            else if (tag == kWaveFormatPcm && (bits == 24 || bits == 32)) {
+                format->sample_type = SampleType::kInt32;
+                *packed24 = bits == 24;
+            }
+            else {
+                std::cerr << "Unsupported WAV sample format: tag " << tag << ", " << bits << " bits" << std::endl;
+                return false;
+            }
+            format->sample_rate = static_cast<int>(rate);
+            format->number_of_channels = channels;
+            have_format = true;
+        }
+        else if (std::memcmp(chunk, "data", 4) == 0) {
+            if (!have_format) {
+                std::cerr << "WAV data chunk before its format" << std::endl;
+                return false;
+            }
+            *data_offset = body;
+            // Recorders that were cut off leave a size past the end.
+            *data_size = std::min(size, file.size() - body);
+            return true;
+        }
+        // Chunks are padded to an even size.
+        offset = body + size + (size & 1);
+    }
+    std::cerr << "WAV file has no data chunk" << std::endl;
+    return false;
+}
+}
+
+std::unique_ptr<FileAudioCapture> FileAudioCapture::Open(const Config& config) {
+    std::ifstream stream(config.path, std::ios::binary);
+    if (!stream) {
+        std::cerr << "Failed to open audio file: " << config.path << std::endl;
+        return nullptr;
+    }
+    const std::vector<uint8_t> file((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+    DeviceFormat format = config.raw_format;
+    bool packed24 = false;
+    size_t data_offset = 0;
+    size_t data_size = file.size();
+    if (!config.raw && !ParseWav(file, &format, &packed24, &data_offset, &data_size)) {
+        return nullptr;
+    }
+    if (format.sample_rate <= 0 || format.number_of_channels == 0) {
+        std::cerr << "Invalid audio file format: " << config.path << std::endl;
+        return nullptr;
+    }
+
+    AudioConverter converter;
+    if (!converter.Configure(format, kOutputChannels, kDecodeChunkFrames)) {
+        std::cerr << "Unsupported channel layout in " << config.path << std::endl;
+        return nullptr;
+    }
+    const size_t in_frame_bytes = packed24 ? 3 * format.number_of_channels : format.BytesPerFrame();
+    const size_t frames = data_size / in_frame_bytes;
+    std::vector<int16_t> samples(frames * kOutputChannels);
+    std::vector<int32_t> widened(packed24 ? kDecodeChunkFrames * format.number_of_channels : 0);
+    for (size_t done = 0; done < frames;) {
+        const size_t chunk = std::min(kDecodeChunkFrames, frames - done);
+        const uint8_t* in = file.data() + data_offset + done * in_frame_bytes;
+        if (packed24) {
+            // Left-justify into 32 bits, which is what kInt32 expects.
+            for (size_t i = 0; i < chunk * format.number_of_channels; ++i) {
+                widened[i] = static_cast<int32_t>(static_cast<uint32_t>(in[3 * i]) << 8 |
+                    static_cast<uint32_t>(in[3 * i + 1]) << 16 | static_cast<uint32_t>(in[3 * i + 2]) << 24);
+            }
+            in = reinterpret_cast<const uint8_t*>(widened.data());
+        }
+        done += converter.Convert(in, chunk, samples.data() + done * kOutputChannels);
+    }
+
+    AudioFormat output = converter.OutputFormat();
+    return std::unique_ptr<FileAudioCapture>(new FileAudioCapture(config, output, std::move(samples)));
+}
+
+FileAudioCapture::FileAudioCapture(const Config& config, const AudioFormat& format, std::vector<int16_t> samples)
+    : PacedAudioCapture(format, config.pacing), loop_(config.loop), samples_(std::move(samples)) {
+}
+
+size_t FileAudioCapture::Produce(int16_t* out, size_t frames) {
+    const size_t total = FileFrames();
+    size_t written = 0;
+    while (written < frames && total > 0) {
+        if (position_ == total) {
+            if (!loop_) {
+                break;
+            }
+            position_ = 0;
+        }
+        const size_t count = std::min(frames - written, total - position_);
+        std::memcpy(out + written * kOutputChannels, samples_.data() + position_ * kOutputChannels,
+            count * kOutputChannels * sizeof(int16_t));
+        written += count;
+        position_ += count;
+    }
+    return written;
+}
@@ -0,0 +1,41 @@
+// FileAudioCapture.h
+#pragma once
+#include "AudioCaptureBackend.h"
+#include "AudioConverter.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+// Replays a WAV file (16/24/32-bit PCM or 32-bit float, any channel count)
+// or headerless PCM. The file is decoded to 16-bit stereo once at Open(),
+// the format the WASAPI backend produces, so replay is a plain copy.
+class FileAudioCapture : public PacedAudioCapture {
+public:
+    struct Config {
+        std::string path;
+        // Headerless input in `raw_format`; otherwise the WAV header decides.
+        bool raw = false;
+        DeviceFormat raw_format;
+        // Start over at the end instead of ending the stream.
+        bool loop = true;
+        Pacing pacing;
+    };
+
+    // Returns null if the file cannot be read or its format is unsupported.
+    static std::unique_ptr<FileAudioCapture> Open(const Config& config);
+
+    // Frames in the decoded file.
+    size_t FileFrames() const { return samples_.size() / kOutputChannels; }
+
+protected:
+    size_t Produce(int16_t* out, size_t frames) override;
+
+private:
+    static constexpr size_t kOutputChannels = 2;
+
+    FileAudioCapture(const Config& config, const AudioFormat& format, std::vector<int16_t> samples);
+
+    const bool loop_;
+    std::vector<int16_t> samples_;  // Interleaved stereo
+    size_t position_ = 0;           // In frames
+};
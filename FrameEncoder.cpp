@@ -1,13 +1,27 @@
 // FrameEncoder.cpp
 #include "Encoder.h"
 #include <iostream>
+#include <algorithm>
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavutil/opt.h>
+#include <libavutil/frame.h>
+}
+
+namespace {
+// Quantizer offsets in [-1, 1]; libx264 scales them to the QP range.
+const AVRational kUnchangedQOffset = { 3, 10 };
+const AVRational kMovedQOffset = { 0, 1 };
+const AVRational kChangedQOffset = { -1, 10 };
+const AVRational kRefinementQOffset = { -3, 10 };
+// Beyond this many regions a single bounding box is cheaper to apply.
+const size_t kMaxRoiRegions = 256;
 }
 
 FrameEncoder::FrameEncoder()
-    : width(1280), height(720), frameRate(30), pixelFormat(AV_PIX_FMT_YUV420P) {
+    : width(1280), height(720), frameRate(30), pixelFormat(AV_PIX_FMT_YUV420P),
+    contentMode(ContentType::kText), pendingContentMode(ContentType::kText), frameIndex(0), ptsBase(0),
+    hasChangeMap(false), roiFrame(av_frame_alloc()), refinementFrames(0) {
     // Default to H.264 codec
     SetCodecName("libx264");
     SetBitRate(2000000); // 2 Mbps default
@@ -15,61 +29,144 @@ FrameEncoder::FrameEncoder()
 
 FrameEncoder::~FrameEncoder() {
     Close();
+    av_frame_free(&roiFrame);
 }
 
-bool FrameEncoder::Open() {
-    // Already open?
-    if (isOpen) return true;
+EncoderConfig FrameEncoder::Config() const {
+    EncoderConfig config;
+    config.codecName = codecName;
+    config.width = width;
+    config.height = height;
+    config.frameRate = frameRate;
+    config.bitrate = bitrate;
+    config.pixelFormat = pixelFormat;
+    config.contentMode = contentMode;
+    return config;
+}
 
+AVCodecContext* FrameEncoder::OpenContext(const EncoderConfig& config) {
     // Find the encoder
-    const AVCodec* codec = avcodec_find_encoder_by_name(codecName.c_str());
+    const AVCodec* codec = avcodec_find_encoder_by_name(config.codecName.c_str());
     if (!codec) {
-        std::cerr << "Could not find encoder for '" << codecName << "'" << std::endl;
-        return false;
+        std::cerr << "Could not find encoder for '" << config.codecName << "'" << std::endl;
+        return nullptr;
     }
 
     // Create codec context
-    codecContext = avcodec_alloc_context3(codec);
-    if (!codecContext) {
+    AVCodecContext* context = avcodec_alloc_context3(codec);
+    if (!context) {
         std::cerr << "Could not allocate video codec context" << std::endl;
-        return false;
+        return nullptr;
     }
 
     // Set parameters
-    codecContext->bit_rate = bitrate;
-    codecContext->width = width;
-    codecContext->height = height;
-    codecContext->time_base = av_make_q(1, frameRate);
-    codecContext->framerate = av_make_q(frameRate,1);
-    codecContext->gop_size = 10;
-    codecContext->max_b_frames = 1;
-    codecContext->pix_fmt = static_cast<AVPixelFormat>(pixelFormat);
+    context->bit_rate = config.bitrate;
+    context->width = config.width;
+    context->height = config.height;
+    context->time_base = av_make_q(1, config.frameRate);
+    context->framerate = av_make_q(config.frameRate,1);
+    context->gop_size = 10;
+    context->max_b_frames = 1;
+    context->pix_fmt = static_cast<AVPixelFormat>(config.pixelFormat);
 
     // Set codec-specific options
-    if (codecName == "libx264") {
-        av_opt_set(codecContext->priv_data, "preset", "medium", 0);
-        av_opt_set(codecContext->priv_data, "tune", "zerolatency", 0);
-    }
+    ApplyContentTuning(context, config);
 
     // Open the codec
-    if (avcodec_open2(codecContext, codec, nullptr) < 0) {
+    if (avcodec_open2(context, codec, nullptr) < 0) {
         std::cerr << "Could not open codec" << std::endl;
-        avcodec_free_context(&codecContext);
+        avcodec_free_context(&context);
+        return nullptr;
+    }
+    return context;
+}
+
+bool FrameEncoder::Open() {
+    // Already open?
+    if (isOpen) return true;
+
+    // Prefer a context warmed up ahead of time; open one on a pool miss.
+    EncoderConfig config = Config();
+    codecContext = EncoderPool::GetInstance().Acquire(config);
+    if (!codecContext) {
+        codecContext = OpenContext(config);
+    }
+    if (!codecContext) {
         return false;
     }
 
+    openConfig = config;
     isOpen = true;
+    // The next frame starts the session: it is forced to a key frame and
+    // becomes pts 0 (see EncodeFrame).
+    frameIndex = 0;
+    ptsBase = 0;
+    return true;
+}
+
+bool FrameEncoder::Close() {
+    if (!codecContext) {
+        return false;
+    }
+    // Hand the context back for the next session instead of freeing it.
+    EncoderPool::GetInstance().Recycle(openConfig, codecContext);
+    codecContext = nullptr;
+    isOpen = false;
     return true;
 }
 
+void FrameEncoder::ApplyContentTuning(AVCodecContext* context, const EncoderConfig& config) {
+    if (config.codecName != "libx264") {
+        return;
+    }
+    // Make the key frame forced at the start of each session an IDR, so
+    // a recycled context never resumes mid-GOP without SPS/PPS.
+    av_opt_set_int(context->priv_data, "forced-idr", 1, 0);
+    if (config.contentMode == ContentType::kText) {
+        // Text: keep QP steady between frames so glyphs don't pump. A qcomp
+        // above the 0.6 default moves rate control towards constant QP, and
+        // qpstep caps the remaining frame-to-frame swing. Favour detail
+        // retention over motion handling.
+        av_opt_set(context->priv_data, "preset", "medium", 0);
+        av_opt_set(context->priv_data, "tune", "stillimage,zerolatency", 0);
+        av_opt_set(context->priv_data, "x264-params", "qcomp=0.85:qpstep=2:aq-mode=2", 0);
+    }
+    else {
+        // Motion: cheaper preset to keep up with full-frame changes, default
+        // rate-control curve so bits follow scene complexity.
+        av_opt_set(context->priv_data, "preset", "faster", 0);
+        av_opt_set(context->priv_data, "tune", "zerolatency", 0);
+        av_opt_set(context->priv_data, "x264-params", "qcomp=0.6:aq-mode=1", 0);
+    }
+}
+
 bool FrameEncoder::EncodeFrame(const AVFrame* frame, AVPacket* packet) {
     if (!isOpen) {
         std::cerr << "Encoder not open" << std::endl;
         return false;
     }
 
+    // Tuning can only change when the encoder is reopened, which forces a
+    // key frame, so wait for the GOP boundary where one is due anyway.
+    if (pendingContentMode != contentMode && frameIndex % codecContext->gop_size == 0) {
+        Close();
+        contentMode = pendingContentMode;
+        if (!Open()) {
+            std::cerr << "Failed to reopen encoder with new content mode" << std::endl;
+            return false;
+        }
+    }
+
     // Send the frame to the encoder
-    int ret = avcodec_send_frame(codecContext, frame);
+    const AVFrame* input = frame ? AttachRoi(frame) : frame;
+    if (input) {
+        input = StartSession(input);
+    }
+    ++frameIndex;
+    int ret = avcodec_send_frame(codecContext, input);
+    if (input == roiFrame) {
+        av_frame_unref(roiFrame);
+    }
     if (ret < 0) {
         std::cerr << "Error sending frame for encoding" << std::endl;
         return false;
@@ -85,9 +182,42 @@ bool FrameEncoder::EncodeFrame(const AVFrame* frame, AVPacket* packet) {
         return false;
     }
 
+    // Back to the caller's timeline.
+    if (packet->pts != AV_NOPTS_VALUE) {
+        packet->pts += ptsBase;
+    }
+    if (packet->dts != AV_NOPTS_VALUE) {
+        packet->dts += ptsBase;
+    }
     return true;
 }
 
+const AVFrame* FrameEncoder::StartSession(const AVFrame* input) {
+    if (frameIndex == 0) {
+        ptsBase = input->pts != AV_NOPTS_VALUE ? input->pts : 0;
+    }
+    if (frameIndex != 0 && ptsBase == 0) {
+        return input;
+    }
+    if (input != roiFrame && av_frame_ref(roiFrame, input) < 0) {
+        return input;
+    }
+    // A pooled context was only flushed, so its next frame would continue the
+    // old GOP. Open each session on a key frame at pts 0 instead.
+    if (roiFrame->pts != AV_NOPTS_VALUE) {
+        roiFrame->pts -= ptsBase;
+    }
+    if (frameIndex == 0) {
+        roiFrame->pict_type = AV_PICTURE_TYPE_I;
+#ifdef AV_FRAME_FLAG_KEY
+        roiFrame->flags |= AV_FRAME_FLAG_KEY;
+#else
+        roiFrame->key_frame = 1;
+#endif
+    }
+    return roiFrame;
+}
+
 void FrameEncoder::SetWidth(int w) {
 	width = w;
 }
@@ -118,4 +248,118 @@ void FrameEncoder::SetPixelFormat(int format) {
 
 int FrameEncoder::PixelFormat() const {
     return pixelFormat;
+}
+
+void FrameEncoder::SetContentMode(ContentType mode) {
+    pendingContentMode = mode;
+}
+
+ContentType FrameEncoder::ContentMode() const {
+    return contentMode;
+}
+
+void FrameEncoder::SetChangeMap(const BlockChangeMap& map) {
+    changeMap = map;
+    hasChangeMap = true;
+}
+
+void FrameEncoder::RequestRefinement(int frames) {
+    refinementFrames = frames;
+}
+
+void FrameEncoder::BuildRoiRects() {
+    roiRects.clear();
+    // Runs of equal level per macroblock row. A run matching a rect that
+    // ends on the row above extends it instead of starting a new one.
+    for (int by = 0; by < changeMap.blocks_high; ++by) {
+        const int top = by * BlockChangeMap::kBlockSize;
+        int bx = 0;
+        while (bx < changeMap.blocks_wide) {
+            const uint8_t level = changeMap.At(bx, by);
+            int end = bx + 1;
+            while (end < changeMap.blocks_wide && changeMap.At(end, by) == level) {
+                ++end;
+            }
+            if (level != BlockChangeMap::kUnchanged) {
+                const int left = bx * BlockChangeMap::kBlockSize;
+                const int right = end * BlockChangeMap::kBlockSize;
+                auto it = std::find_if(roiRects.begin(), roiRects.end(), [&](const RoiRect& rect) {
+                    return rect.bottom == top && rect.left == left && rect.right == right && rect.level == level;
+                });
+                if (it != roiRects.end()) {
+                    it->bottom = top + BlockChangeMap::kBlockSize;
+                }
+                else if (roiRects.size() < kMaxRoiRegions) {
+                    roiRects.push_back({ left, top, right, top + BlockChangeMap::kBlockSize, level });
+                }
+                else {
+                    return;
+                }
+            }
+            bx = end;
+        }
+    }
+}
+
+const AVFrame* FrameEncoder::AttachRoi(const AVFrame* frame) {
+    if (codecName != "libx264") {
+        hasChangeMap = false;
+        refinementFrames = 0;
+        return frame;
+    }
+
+    AVRational backgroundQOffset = kUnchangedQOffset;
+    if (refinementFrames > 0) {
+        // Refinement: the content is static, spend bits everywhere.
+        --refinementFrames;
+        hasChangeMap = false;
+        roiRects.clear();
+        backgroundQOffset = kRefinementQOffset;
+    }
+    else {
+        if (!hasChangeMap) {
+            return frame;
+        }
+        hasChangeMap = false;
+        if (changeMap.width != frame->width || changeMap.height != frame->height) {
+            return frame;
+        }
+        BuildRoiRects();
+        if (roiRects.size() >= kMaxRoiRegions) {
+            int x, y, w, h;
+            changeMap.BoundingBox(&x, &y, &w, &h);
+            roiRects.assign(1, { x, y, x + w, y + h, BlockChangeMap::kChanged });
+        }
+    }
+
+    if (av_frame_ref(roiFrame, frame) < 0) {
+        return frame;
+    }
+    // The whole-frame background region goes last: libx264 gives the first
+    // region in the array the highest priority.
+    const size_t count = roiRects.size() + 1;
+    AVFrameSideData* sideData = av_frame_new_side_data(roiFrame,
+        AV_FRAME_DATA_REGIONS_OF_INTEREST, count * sizeof(AVRegionOfInterest));
+    if (!sideData) {
+        av_frame_unref(roiFrame);
+        return frame;
+    }
+    AVRegionOfInterest* regions = reinterpret_cast<AVRegionOfInterest*>(sideData->data);
+    for (size_t i = 0; i < roiRects.size(); ++i) {
+        const RoiRect& rect = roiRects[i];
+        regions[i].self_size = sizeof(AVRegionOfInterest);
+        regions[i].left = rect.left;
+        regions[i].top = rect.top;
+        regions[i].right = std::min(rect.right, frame->width);
+        regions[i].bottom = std::min(rect.bottom, frame->height);
+        regions[i].qoffset = rect.level == BlockChangeMap::kChanged ? kChangedQOffset : kMovedQOffset;
+    }
+    AVRegionOfInterest& background = regions[count - 1];
+    background.self_size = sizeof(AVRegionOfInterest);
+    background.left = 0;
+    background.top = 0;
+    background.right = frame->width;
+    background.bottom = frame->height;
+    background.qoffset = backgroundQOffset;
+    return roiFrame;
 }
\ No newline at end of file
@@ -0,0 +1,140 @@
+// JoinTimeline.cpp
+#include "JoinTimeline.h"
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+namespace {
+// Indexed by JoinStage.
+const char* const kStageNames[] = {
+    "subscribe_received",
+    "peer_connection_ready",
+    "offer_created",
+    "offer_sent",
+    "answer_applied",
+    "candidate_pair_selected",
+    "ice_connected",
+    "first_frame_delivered",
+    "first_rtp_sent",
+};
+static_assert(std::size(kStageNames) == static_cast<size_t>(JoinStage::kCount), "one name per join stage");
+
+double Percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    const size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+}
+
+const char* JoinStageToString(JoinStage stage) {
+    const size_t index = static_cast<size_t>(stage);
+    return index < std::size(kStageNames) ? kStageNames[index] : "unknown";
+}
+
+void JoinTimeline::Begin(uint64_t consumer_id) {
+    Session session;
+    session.consumer_id = consumer_id;
+    session.start = Clock::now();
+    session.at_us.fill(-1);
+    session.at_us[static_cast<size_t>(JoinStage::kSubscribeReceived)] = 0;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_active[consumer_id] = session;
+}
+
+bool JoinTimeline::Mark(uint64_t consumer_id, JoinStage stage) {
+    const Clock::time_point now = Clock::now();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_active.find(consumer_id);
+    if (it == m_active.end()) {
+        return false;
+    }
+    int64_t& at_us = it->second.at_us[static_cast<size_t>(stage)];
+    if (at_us >= 0) {
+        return false;
+    }
+    at_us = std::chrono::duration_cast<std::chrono::microseconds>(now - it->second.start).count();
+    return true;
+}
+
+void JoinTimeline::End(uint64_t consumer_id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_active.find(consumer_id);
+    if (it == m_active.end()) {
+        return;
+    }
+    m_ended.push_back(it->second);
+    m_active.erase(it);
+    if (m_ended.size() > kMaxEndedSessions) {
+        m_ended.pop_front();
+    }
+}
+
+std::string JoinTimeline::Describe(uint64_t consumer_id) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_active.find(consumer_id);
+    if (it == m_active.end()) {
+        return std::string();
+    }
+    std::string description;
+    for (size_t stage = 1; stage < kStages; ++stage) {
+        const int64_t at_us = it->second.at_us[stage];
+        if (at_us < 0) {
+            continue;
+        }
+        if (!description.empty()) {
+            description += ", ";
+        }
+        description += kStageNames[stage];
+        description += " +" + std::to_string(at_us / 1000) + " ms";
+    }
+    return description;
+}
+
+boost::json::object JoinTimeline::Export() const {
+    std::vector<Session> sessions;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        sessions.assign(m_ended.begin(), m_ended.end());
+        for (const auto& [id, session] : m_active) {
+            sessions.push_back(session);
+        }
+    }
+    std::sort(sessions.begin(), sessions.end(),
+        [](const Session& a, const Session& b) { return a.start < b.start; });
+
+    std::array<std::vector<double>, kStages> reached;
+    boost::json::array exported;
+    for (const Session& session : sessions) {
+        boost::json::object stages;
+        for (size_t stage = 1; stage < kStages; ++stage) {
+            if (session.at_us[stage] >= 0) {
+                const double ms = session.at_us[stage] / 1000.0;
+                stages[kStageNames[stage]] = ms;
+                reached[stage].push_back(ms);
+            }
+        }
+        boost::json::object entry;
+        entry["consumer"] = session.consumer_id;
+        entry["ms"] = std::move(stages);
+        exported.push_back(std::move(entry));
+    }
+
+    boost::json::object percentiles;
+    for (size_t stage = 1; stage < kStages; ++stage) {
+        std::vector<double>& values = reached[stage];
+        std::sort(values.begin(), values.end());
+        boost::json::object summary;
+        summary["count"] = values.size();
+        summary["p50_ms"] = Percentile(values, 0.50);
+        summary["p95_ms"] = Percentile(values, 0.95);
+        summary["p99_ms"] = Percentile(values, 0.99);
+        percentiles[kStageNames[stage]] = std::move(summary);
+    }
+
+    boost::json::object report;
+    report["sessions"] = std::move(exported);
+    report["percentiles"] = std::move(percentiles);
+    return report;
+}
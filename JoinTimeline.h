@@ -0,0 +1,63 @@
+// JoinTimeline.h
+#pragma once
+#include <boost/json.hpp>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Milestones of a consumer's join, in the order they normally happen.
+enum class JoinStage {
+    kSubscribeReceived,
+    kPeerConnectionReady,    // Taken from the pool or created
+    kOfferCreated,
+    kOfferSent,              // Written to the signaling socket
+    kAnswerApplied,
+    kCandidatePairSelected,
+    kIceConnected,
+    kFirstFrameDelivered,    // Captured frame handed to the encoder's sink
+    kFirstRtpSent,
+    kCount
+};
+
+const char* JoinStageToString(JoinStage stage);
+
+// Time-to-first-frame breakdown per consumer. Each session starts at
+// subscribe; every later stage is kept the first time it is reached, as
+// time since subscribe. Marks for unknown consumers are ignored, so hooks
+// may fire for sessions that never began or have already ended. Ended
+// sessions are kept, up to kMaxEndedSessions, for Export(). Thread-safe.
+class JoinTimeline {
+public:
+    static constexpr size_t kMaxEndedSessions = 512;
+
+    // Starts (or restarts) the consumer's session at kSubscribeReceived.
+    void Begin(uint64_t consumer_id);
+    // Returns true if this was the first time the session reached `stage`.
+    bool Mark(uint64_t consumer_id, JoinStage stage);
+    void End(uint64_t consumer_id);
+
+    // "stage +ms, ..." for one session, for the log.
+    std::string Describe(uint64_t consumer_id) const;
+    // Every session's milliseconds per stage, and p50/p95/p99 per stage
+    // over the sessions that reached it.
+    boost::json::object Export() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+    static constexpr size_t kStages = static_cast<size_t>(JoinStage::kCount);
+
+    struct Session {
+        uint64_t consumer_id = 0;
+        Clock::time_point start;
+        std::array<int64_t, kStages> at_us;  // -1 until reached
+    };
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<uint64_t, Session> m_active;
+    std::deque<Session> m_ended;
+};
@@ -0,0 +1,35 @@
+// RefinementScheduler.cpp
+#include "RefinementScheduler.h"
+
+void RefinementScheduler::Reset() {
+    state_ = State::kIdle;
+    counter_ = 0;
+}
+
+RefinementScheduler::Action RefinementScheduler::OnTick(bool changed) {
+    if (changed) {
+        state_ = State::kActive;
+        counter_ = 0;
+        return Action::kDeliver;
+    }
+
+    switch (state_) {
+    case State::kActive:
+        // Wait a few ticks so a pause between keystrokes or scroll steps
+        // doesn't trigger a burst of refinement frames.
+        if (++counter_ < kStaticTicksBeforeRefine) {
+            return Action::kSkip;
+        }
+        state_ = State::kRefining;
+        counter_ = 0;
+        [[fallthrough]];
+    case State::kRefining:
+        if (++counter_ >= kRefinementFrames) {
+            state_ = State::kIdle;
+        }
+        return Action::kRefine;
+    case State::kIdle:
+    default:
+        return Action::kSkip;
+    }
+}
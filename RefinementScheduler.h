@@ -0,0 +1,32 @@
+// RefinementScheduler.h
+#pragma once
+
+// Decides, per capture tick, whether a frame should be delivered. While the
+// screen changes every new frame is delivered. Once it has been static for a
+// short while a few refinement frames (repeats of the last image) are sent so
+// the encoder can converge to full quality, then delivery stops until the
+// next change, keeping idle bandwidth near zero.
+class RefinementScheduler {
+public:
+    enum class Action {
+        kDeliver,  // New content, deliver the captured frame
+        kRefine,   // Static content, re-deliver the last frame for refinement
+        kSkip      // Nothing worth sending
+    };
+
+    // `changed` is true when the tick produced a frame with damaged content.
+    Action OnTick(bool changed);
+
+    // True once refinement is done and the source has gone silent.
+    bool Idle() const { return state_ == State::kIdle; }
+    void Reset();
+
+    static constexpr int kStaticTicksBeforeRefine = 3;
+    static constexpr int kRefinementFrames = 3;
+
+private:
+    enum class State { kActive, kRefining, kIdle };
+
+    State state_ = State::kIdle;
+    int counter_ = 0;
+};
@@ -1,5 +1,9 @@
 //ScreenCapture.cpp
 #include "ScreenCapture.h"
+#include "CaptureClock.h"
+#include <rtc_base/time_utils.h>
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 
 using Microsoft::WRL::ComPtr;
@@ -8,6 +12,14 @@ ScreenCapture* ScreenCapture::instance = nullptr;
 std::mutex ScreenCapture::mtx;
 
 ScreenCapture::~ScreenCapture() {
+    {
+        std::lock_guard<std::mutex> lock(m_sinks_mutex);
+        m_stopping = true;
+    }
+    m_sinks_changed.notify_all();
+    if (m_capture_thread.joinable()) {
+        m_capture_thread.join();
+    }
     if (m_duplication) {
         m_duplication.Reset();
     }
@@ -57,7 +69,55 @@ bool ScreenCapture::Initialize() {
     return true;
 }
 
-std::optional<webrtc::scoped_refptr<webrtc::I420Buffer>> ScreenCapture::CaptureFrame() {
+void ScreenCapture::FillChangeMap(const DXGI_OUTDUPL_FRAME_INFO& frame_info, BlockChangeMap* change_map) {
+    // Only the pointer moved: the desktop image is unchanged.
+    if (frame_info.LastPresentTime.QuadPart == 0) {
+        return;
+    }
+    if (frame_info.TotalMetadataBufferSize == 0) {
+        change_map->MarkAll(BlockChangeMap::kChanged);
+        return;
+    }
+    if (m_metadata.size() < frame_info.TotalMetadataBufferSize) {
+        m_metadata.resize(frame_info.TotalMetadataBufferSize);
+    }
+
+    // Move rects first: their destinations only need cheap prediction, but a
+    // dirty rect on top of them still wins.
+    UINT move_bytes = 0;
+    HRESULT hr = m_duplication->GetFrameMoveRects(
+        static_cast<UINT>(m_metadata.size()),
+        reinterpret_cast<DXGI_OUTDUPL_MOVE_RECT*>(m_metadata.data()), &move_bytes);
+    if (FAILED(hr)) {
+        change_map->MarkAll(BlockChangeMap::kChanged);
+        return;
+    }
+    const auto* moves = reinterpret_cast<const DXGI_OUTDUPL_MOVE_RECT*>(m_metadata.data());
+    for (UINT i = 0; i < move_bytes / sizeof(DXGI_OUTDUPL_MOVE_RECT); ++i) {
+        const RECT& r = moves[i].DestinationRect;
+        change_map->MarkRect(r.left, r.top, r.right, r.bottom, BlockChangeMap::kMoved);
+    }
+
+    UINT dirty_bytes = 0;
+    hr = m_duplication->GetFrameDirtyRects(
+        static_cast<UINT>(m_metadata.size()),
+        reinterpret_cast<RECT*>(m_metadata.data()), &dirty_bytes);
+    if (FAILED(hr)) {
+        change_map->MarkAll(BlockChangeMap::kChanged);
+        return;
+    }
+    const auto* dirty = reinterpret_cast<const RECT*>(m_metadata.data());
+    for (UINT i = 0; i < dirty_bytes / sizeof(RECT); ++i) {
+        change_map->MarkRect(dirty[i].left, dirty[i].top, dirty[i].right, dirty[i].bottom,
+            BlockChangeMap::kChanged);
+    }
+}
+
+std::optional<webrtc::scoped_refptr<webrtc::I420Buffer>> ScreenCapture::CaptureFrame(CaptureFrameInfo* info) {
+    if (info) {
+        info->timed_out = false;
+        info->capture_time_us = 0;
+    }
     if (!m_duplication) {
         std::cerr << "Duplication interface not initialized." << std::endl;
         return {};
@@ -66,6 +126,9 @@ std::optional<webrtc::scoped_refptr<webrtc::I420Buffer>> ScreenCapture::CaptureF
     DXGI_OUTDUPL_FRAME_INFO frame_info;
     ComPtr<IDXGIResource> resource;
     HRESULT hr = m_duplication->AcquireNextFrame(33, &frame_info, &resource);
+    if (info) {
+        info->timed_out = hr == DXGI_ERROR_WAIT_TIMEOUT;
+    }
 
     if (FAILED(hr)) {
         if (hr == DXGI_ERROR_WAIT_TIMEOUT) {
@@ -97,6 +160,14 @@ std::optional<webrtc::scoped_refptr<webrtc::I420Buffer>> ScreenCapture::CaptureF
     int w = desc.Width;
     int h = desc.Height;
 
+    if (info) {
+        info->change_map.Reset(w, h);
+        FillChangeMap(frame_info, &info->change_map);
+        if (frame_info.LastPresentTime.QuadPart != 0) {
+            info->capture_time_us = CaptureClock::FromQpcTicks(frame_info.LastPresentTime.QuadPart);
+        }
+    }
+
     D3D11_TEXTURE2D_DESC stagingDesc(desc);
     stagingDesc.Usage = D3D11_USAGE_STAGING;
     stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
@@ -155,4 +226,85 @@ std::optional<webrtc::scoped_refptr<webrtc::I420Buffer>> ScreenCapture::CaptureF
     m_duplication->ReleaseFrame();
 
     return i420_buffer_opt;
-}
\ No newline at end of file
+}
+
+void ScreenCapture::AddFrameSink(FrameSink* sink) {
+    {
+        std::lock_guard<std::mutex> lock(m_sinks_mutex);
+        if (std::find(m_sinks.begin(), m_sinks.end(), sink) != m_sinks.end() ||
+            std::find(m_joining_sinks.begin(), m_joining_sinks.end(), sink) != m_joining_sinks.end()) {
+            return;
+        }
+        (m_last_frame ? m_joining_sinks : m_sinks).push_back(sink);
+        if (!m_capture_thread.joinable()) {
+            m_capture_thread = std::thread([this]() { CaptureLoop(); });
+        }
+    }
+    m_sinks_changed.notify_all();
+}
+
+void ScreenCapture::RemoveFrameSink(FrameSink* sink) {
+    std::lock_guard<std::mutex> lock(m_sinks_mutex);
+    m_sinks.erase(std::remove(m_sinks.begin(), m_sinks.end(), sink), m_sinks.end());
+    m_joining_sinks.erase(std::remove(m_joining_sinks.begin(), m_joining_sinks.end(), sink), m_joining_sinks.end());
+}
+
+void ScreenCapture::CaptureLoop() {
+    int64_t last_frame_time_us = 0;
+    int consecutive_failures = 0;
+    int backoff_ms = kInitialBackoffMs;
+    CaptureFrameInfo info;
+    while (true) {
+        {
+            // Idle without sinks, so the duplication is only drained while
+            // someone is watching.
+            std::unique_lock<std::mutex> lock(m_sinks_mutex);
+            m_sinks_changed.wait(lock, [this]() {
+                return m_stopping || !m_sinks.empty() || !m_joining_sinks.empty();
+            });
+            if (m_stopping) {
+                return;
+            }
+        }
+
+        const int64_t elapsed_us = rtc::TimeMicros() - last_frame_time_us;
+        if (elapsed_us < kFrameIntervalUs) {
+            std::this_thread::sleep_for(std::chrono::microseconds(kFrameIntervalUs - elapsed_us));
+        }
+        std::optional<webrtc::scoped_refptr<webrtc::I420Buffer>> frame_opt = CaptureFrame(&info);
+        if (!frame_opt.has_value() && !info.timed_out) {
+            if (++consecutive_failures > kMaxConsecutiveFailures) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(backoff_ms));
+                backoff_ms = std::min(backoff_ms * 2, kMaxBackoffMs);
+            }
+            continue;
+        }
+        consecutive_failures = 0;
+        backoff_ms = kInitialBackoffMs;
+        webrtc::scoped_refptr<webrtc::I420Buffer> frame = frame_opt.value_or(nullptr);
+        if (frame) {
+            last_frame_time_us = rtc::TimeMicros();
+        }
+
+        std::lock_guard<std::mutex> lock(m_sinks_mutex);
+        if (!m_joining_sinks.empty()) {
+            if (!frame) {
+                // Nothing new on screen: replay the last picture, whole.
+                CaptureFrameInfo replay;
+                replay.change_map.Reset(m_last_frame->width(), m_last_frame->height());
+                replay.change_map.MarkAll(BlockChangeMap::kChanged);
+                for (FrameSink* sink : m_joining_sinks) {
+                    sink->OnCapturedFrame(m_last_frame, replay);
+                }
+            }
+            m_sinks.insert(m_sinks.end(), m_joining_sinks.begin(), m_joining_sinks.end());
+            m_joining_sinks.clear();
+        }
+        if (frame) {
+            m_last_frame = frame;
+        }
+        for (FrameSink* sink : m_sinks) {
+            sink->OnCapturedFrame(frame, info);
+        }
+    }
+}
@@ -12,7 +12,10 @@
 #include <dxgi1_2.h>
 #include <wrl/client.h>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <iostream>
+#include "BlockChangeMap.h"
 
 #include <third_party/libyuv/include/libyuv.h>
 #pragma comment(lib, "dxgi.lib")
@@ -20,16 +23,59 @@
 
 using Microsoft::WRL::ComPtr;
 
+// Side information about a captured frame, filled from the duplication
+// metadata so callers don't need another pass over the pixels.
+struct CaptureFrameInfo {
+	BlockChangeMap change_map;
+	bool timed_out = false;  // No new desktop frame within the wait interval
+	// Present time of the captured image on the rtc::TimeMicros() clock, or 0
+	// when the update carried no new image (pointer-only).
+	int64_t capture_time_us = 0;
+};
+
 class ScreenCapture {
+public:
+	// Receives every tick of the shared capture loop, on the loop's thread.
+	class FrameSink {
+	public:
+		// `frame` is null when nothing was captured this tick; `info.timed_out`
+		// then tells a static screen from a failed capture.
+		virtual void OnCapturedFrame(const webrtc::scoped_refptr<webrtc::I420Buffer>& frame,
+			const CaptureFrameInfo& info) = 0;
+	protected:
+		virtual ~FrameSink() = default;
+	};
+
 private:
 	static std::mutex mtx;
 	static ScreenCapture* instance;
 
+	static constexpr int64_t kFrameIntervalUs = 33333;
+	static constexpr int kMaxConsecutiveFailures = 5;
+	static constexpr int kInitialBackoffMs = 10;
+	static constexpr int kMaxBackoffMs = 1000;
+
 	ComPtr<ID3D11Device> m_device = nullptr;
 	ComPtr<ID3D11DeviceContext> m_context = nullptr;
 	ComPtr<IDXGIOutputDuplication> m_duplication = nullptr;
+	std::vector<BYTE> m_metadata;
+
+	// Guards the sink lists, m_last_frame and m_stopping. Held while a tick
+	// is fanned out, so a removed sink is never called again.
+	std::mutex m_sinks_mutex;
+	std::condition_variable m_sinks_changed;
+	std::vector<FrameSink*> m_sinks;
+	// Added while the loop already had a picture; they are handed it on the
+	// next tick instead of waiting for the screen to change.
+	std::vector<FrameSink*> m_joining_sinks;
+	webrtc::scoped_refptr<webrtc::I420Buffer> m_last_frame;
+	bool m_stopping = false;
+	std::thread m_capture_thread;
 
 	bool Initialize();
+	void FillChangeMap(const DXGI_OUTDUPL_FRAME_INFO& frame_info, BlockChangeMap* change_map);
+	std::optional<webrtc::scoped_refptr<webrtc::I420Buffer>> CaptureFrame(CaptureFrameInfo* info = nullptr);
+	void CaptureLoop();
 	ScreenCapture(){}
 
 public:
@@ -50,5 +96,12 @@ public:
 		return instance;
 	}
 	//void SaveToBitmap(const std::vector<uint8_t>& frameData, int w, int h, const wchar_t* filename);
-	std::optional<webrtc::scoped_refptr<webrtc::I420Buffer>> CaptureFrame();
+
+	// DXGI reports the rects changed since the previous AcquireNextFrame by
+	// anyone, so one loop drives the duplication and hands every frame and
+	// change map to all sinks. It runs while at least one sink is registered.
+	// RemoveFrameSink returns once the sink can no longer be called; do not
+	// call it from OnCapturedFrame.
+	void AddFrameSink(FrameSink* sink);
+	void RemoveFrameSink(FrameSink* sink);
 };
\ No newline at end of file
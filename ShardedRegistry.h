@@ -0,0 +1,104 @@
+// ShardedRegistry.h
+#pragma once
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+// Concurrent map split into independently locked shards, so threads working
+// on different keys rarely contend for the same mutex. Lookups return the
+// value by copy: values are meant to be cheap handles (scoped_refptr,
+// strands), and nothing is referenced outside a shard lock. Callbacks run
+// under the shard lock and must not call back into the registry.
+template <typename Key, typename Value, size_t kShards = 16, typename Hash = std::hash<Key>>
+class ShardedRegistry {
+public:
+    ShardedRegistry() = default;
+    ShardedRegistry(const ShardedRegistry&) = delete;
+    ShardedRegistry& operator=(const ShardedRegistry&) = delete;
+
+    // Adds `value` unless `key` is present. Returns true if it was added.
+    bool Insert(const Key& key, Value value) {
+        Shard& shard = ShardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.items.try_emplace(key, std::move(value)).second;
+    }
+
+    std::optional<Value> Find(const Key& key) const {
+        const Shard& shard = ShardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.items.find(key);
+        if (it == shard.items.end()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    bool Contains(const Key& key) const {
+        const Shard& shard = ShardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.items.find(key) != shard.items.end();
+    }
+
+    // Calls fn(value) on the entry for `key`. Returns false if absent.
+    template <typename Fn>
+    bool Update(const Key& key, Fn&& fn) {
+        Shard& shard = ShardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.items.find(key);
+        if (it == shard.items.end()) {
+            return false;
+        }
+        fn(it->second);
+        return true;
+    }
+
+    // Removes `key` and hands its value back, so the caller decides where
+    // the last reference is dropped.
+    std::optional<Value> Erase(const Key& key) {
+        Shard& shard = ShardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.items.find(key);
+        if (it == shard.items.end()) {
+            return std::nullopt;
+        }
+        std::optional<Value> value(std::move(it->second));
+        shard.items.erase(it);
+        return value;
+    }
+
+    // Visits every entry, one shard lock at a time; entries added or removed
+    // meanwhile may or may not be seen.
+    template <typename Fn>
+    void ForEach(Fn&& fn) const {
+        for (const Shard& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for (const auto& [key, value] : shard.items) {
+                fn(key, value);
+            }
+        }
+    }
+
+    size_t Size() const {
+        size_t size = 0;
+        for (const Shard& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            size += shard.items.size();
+        }
+        return size;
+    }
+
+private:
+    // Own cache line per shard, so neighbouring locks do not false-share.
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<Key, Value, Hash> items;
+    };
+
+    Shard& ShardFor(const Key& key) { return shards_[Hash{}(key) % kShards]; }
+    const Shard& ShardFor(const Key& key) const { return shards_[Hash{}(key) % kShards]; }
+
+    std::array<Shard, kShards> shards_;
+};
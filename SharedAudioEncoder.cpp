@@ -0,0 +1,257 @@
+// SharedAudioEncoder.cpp
+#include "SharedAudioEncoder.h"
+#include <absl/strings/match.h>
+#include <rtc_base/time_utils.h>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+
+SharedOpusEncoderCore::SharedOpusEncoderCore(std::unique_ptr<webrtc::AudioEncoder> encoder, int bitrate_bps)
+    : encoder_(std::move(encoder)), bitrate_bps_(bitrate_bps), history_(kHistoryBlocks) {
+    encoder_->OnReceivedUplinkBandwidth(bitrate_bps_, absl::nullopt);
+}
+
+uint64_t SharedOpusEncoderCore::HashBlock(rtc::ArrayView<const int16_t> audio) {
+    // FNV-1a over 64-bit words: only has to tell apart the few blocks in
+    // the history, and costs far less than encoding one.
+    constexpr uint64_t kPrime = 1099511628211ull;
+    uint64_t hash = 14695981039346656037ull;
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(audio.data());
+    const size_t size = audio.size() * sizeof(int16_t);
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * kPrime;
+    }
+    for (; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * kPrime;
+    }
+    return hash;
+}
+
+const SharedOpusEncoderCore::Entry* SharedOpusEncoderCore::Find(uint64_t sequence) const {
+    if (sequence >= next_sequence_ || next_sequence_ - sequence > kHistoryBlocks) {
+        return nullptr;
+    }
+    return &history_[sequence % kHistoryBlocks];
+}
+
+const SharedOpusEncoderCore::Entry& SharedOpusEncoderCore::Feed(uint64_t hash,
+    rtc::ArrayView<const int16_t> audio) {
+    // The leader changes from block to block, so the encoder runs on a
+    // timestamp of its own rather than whichever peer happens to feed it.
+    Entry& entry = history_[next_sequence_ % kHistoryBlocks];
+    entry.hash = hash;
+    entry.rtp_timestamp = timestamp_;
+    entry.payload.Clear();
+    entry.info = encoder_->Encode(timestamp_, audio, &entry.payload);
+    timestamp_ += static_cast<uint32_t>(encoder_->RtpTimestampRateHz() / 100);
+    ++next_sequence_;
+    last_feed_ms_ = rtc::TimeMillis();
+    return entry;
+}
+
+void SharedOpusEncoderCore::Replay(const Entry& entry, uint32_t rtp_timestamp, rtc::Buffer* encoded,
+    webrtc::AudioEncoder::EncodedInfo* info) {
+    encoded->AppendData(entry.payload);
+    *info = entry.info;
+    // The frame started the same number of samples before this block in
+    // every peer's timestamp domain.
+    info->encoded_timestamp = rtp_timestamp - (entry.rtp_timestamp - entry.info.encoded_timestamp);
+}
+
+bool SharedOpusEncoderCore::Encode(Cursor* cursor, uint64_t hash, uint32_t rtp_timestamp,
+    rtc::ArrayView<const int16_t> audio, rtc::Buffer* encoded, webrtc::AudioEncoder::EncodedInfo* info) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const bool had_last = cursor->has_last;
+    const uint64_t last_hash = cursor->last_hash;
+    cursor->last_hash = hash;
+    cursor->has_last = true;
+
+    if (cursor->next != Cursor::kUnsynced) {
+        if (const Entry* entry = Find(cursor->next)) {
+            if (entry->hash == hash) {
+                ++cursor->next;
+                Replay(*entry, rtp_timestamp, encoded, info);
+                return true;
+            }
+        }
+        else if (cursor->next == next_sequence_) {
+            // Ahead of everyone else: this proxy encodes the block.
+            ++cursor->next;
+            Replay(Feed(hash, audio), rtp_timestamp, encoded, info);
+            return true;
+        }
+        // The stream skipped or repeated a block, or fell out of the history.
+        cursor->next = Cursor::kUnsynced;
+    }
+
+    // Newest match first, so a run of identical (silent) blocks lines up
+    // with the leader rather than somewhere behind it.
+    const uint64_t oldest = next_sequence_ - std::min<uint64_t>(next_sequence_, kHistoryBlocks);
+    for (uint64_t sequence = next_sequence_; sequence-- > oldest;) {
+        const Entry& entry = history_[sequence % kHistoryBlocks];
+        if (entry.hash == hash) {
+            cursor->next = sequence + 1;
+            Replay(entry, rtp_timestamp, encoded, info);
+            return true;
+        }
+    }
+    // Not encoded yet. Safe to take the lead only if this proxy's previous
+    // block is the newest one, or nobody else is leading.
+    const Entry* newest = next_sequence_ > 0 ? Find(next_sequence_ - 1) : nullptr;
+    const bool next_in_line = newest && had_last && newest->hash == last_hash;
+    if (next_in_line || !newest || rtc::TimeMillis() - last_feed_ms_ > kLeaderTimeoutMs) {
+        cursor->next = next_sequence_ + 1;
+        Replay(Feed(hash, audio), rtp_timestamp, encoded, info);
+        return true;
+    }
+    return false;
+}
+
+namespace {
+
+// Picks the tier for `target_bps`. Moving up needs 10% headroom so a
+// target hovering at a boundary does not keep switching cores.
+int SelectTier(int target_bps, int current_bps) {
+    const int limit_bps = target_bps > current_bps ? std::max(current_bps, target_bps / 11 * 10) : target_bps;
+    int tier = SharedAudioEncoderFactory::kBitrateTiersBps[0];
+    for (int candidate : SharedAudioEncoderFactory::kBitrateTiersBps) {
+        if (candidate <= limit_bps) {
+            tier = candidate;
+        }
+    }
+    return tier;
+}
+
+// Per-peer face of a shared core. WebRTC drives it like any encoder; it
+// only rewrites timestamps and payload type on the shared payloads.
+class SharedOpusEncoder : public webrtc::AudioEncoder {
+public:
+    SharedOpusEncoder(int payload_type, const webrtc::SdpAudioFormat& format,
+        std::unique_ptr<webrtc::AudioEncoder> private_encoder,
+        std::shared_ptr<SharedAudioEncoderFactory::Registry> registry)
+        : payload_type_(payload_type), format_(format), private_encoder_(std::move(private_encoder)),
+        registry_(std::move(registry)) {
+        const int target_bps = private_encoder_->GetTargetBitrate();
+        SetTier(SelectTier(target_bps, target_bps));
+    }
+
+    int SampleRateHz() const override { return private_encoder_->SampleRateHz(); }
+    size_t NumChannels() const override { return private_encoder_->NumChannels(); }
+    int RtpTimestampRateHz() const override { return private_encoder_->RtpTimestampRateHz(); }
+    size_t Num10MsFramesInNextPacket() const override { return private_encoder_->Num10MsFramesInNextPacket(); }
+    size_t Max10MsFramesInAPacket() const override { return private_encoder_->Max10MsFramesInAPacket(); }
+    int GetTargetBitrate() const override {
+        return core_ ? core_->BitrateBps() : private_encoder_->GetTargetBitrate();
+    }
+    absl::optional<std::pair<webrtc::TimeDelta, webrtc::TimeDelta>> GetFrameLengthRange() const override {
+        return private_encoder_->GetFrameLengthRange();
+    }
+
+    void Reset() override {
+        cursor_ = SharedOpusEncoderCore::Cursor();
+        private_encoder_->Reset();
+    }
+
+    void OnReceivedUplinkBandwidth(int target_audio_bitrate_bps, absl::optional<int64_t> /* bwe_period_ms */) override {
+        const int tier = SelectTier(target_audio_bitrate_bps, GetTargetBitrate());
+        if (!core_ || tier != core_->BitrateBps()) {
+            SetTier(tier);
+        }
+    }
+
+protected:
+    EncodedInfo EncodeImpl(uint32_t rtp_timestamp, rtc::ArrayView<const int16_t> audio,
+        rtc::Buffer* encoded) override {
+        EncodedInfo info;
+        if (core_ && core_->Encode(&cursor_, SharedOpusEncoderCore::HashBlock(audio), rtp_timestamp, audio, encoded, &info)) {
+            using_private_ = false;
+        }
+        else {
+            if (!using_private_) {
+                // Do not let a half frame left from long ago leak in.
+                private_encoder_->Reset();
+                using_private_ = true;
+            }
+            info = private_encoder_->Encode(rtp_timestamp, audio, encoded);
+        }
+        info.payload_type = payload_type_;
+        return info;
+    }
+
+private:
+    // Without a core the peer simply keeps encoding privately.
+    void SetTier(int bitrate_bps) {
+        core_ = registry_->Acquire(payload_type_, format_, bitrate_bps);
+        cursor_ = SharedOpusEncoderCore::Cursor();
+        private_encoder_->OnReceivedUplinkBandwidth(bitrate_bps, absl::nullopt);
+    }
+
+    const int payload_type_;
+    const webrtc::SdpAudioFormat format_;
+    // Same configuration as the shared one; only runs while unsynced.
+    std::unique_ptr<webrtc::AudioEncoder> private_encoder_;
+    bool using_private_ = false;
+    std::shared_ptr<SharedAudioEncoderFactory::Registry> registry_;
+    std::shared_ptr<SharedOpusEncoderCore> core_;
+    SharedOpusEncoderCore::Cursor cursor_;
+};
+
+// Peers can only share an encoder if they negotiated the same parameters.
+std::string FormatKey(const webrtc::SdpAudioFormat& format, int bitrate_bps) {
+    std::string key = format.name;
+    std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    key += '/' + std::to_string(format.clockrate_hz) + '/' + std::to_string(format.num_channels);
+    for (const auto& [name, value] : format.parameters) {
+        key += ';' + name + '=' + value;
+    }
+    return key + '@' + std::to_string(bitrate_bps);
+}
+
+}  // namespace
+
+std::shared_ptr<SharedOpusEncoderCore> SharedAudioEncoderFactory::Registry::Acquire(int payload_type,
+    const webrtc::SdpAudioFormat& format, int bitrate_bps) {
+    const std::string key = FormatKey(format, bitrate_bps);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (std::shared_ptr<SharedOpusEncoderCore> core = cores_[key].lock()) {
+        return core;
+    }
+    std::unique_ptr<webrtc::AudioEncoder> encoder = base_->MakeAudioEncoder(payload_type, format, absl::nullopt);
+    if (!encoder) {
+        std::cerr << "Failed to create shared encoder for " << key << std::endl;
+        return nullptr;
+    }
+    auto core = std::make_shared<SharedOpusEncoderCore>(std::move(encoder), bitrate_bps);
+    cores_[key] = core;
+    // Drop entries whose cores are gone so tier changes do not pile up.
+    for (auto it = cores_.begin(); it != cores_.end();) {
+        it = it->second.expired() ? cores_.erase(it) : std::next(it);
+    }
+    return core;
+}
+
+SharedAudioEncoderFactory::SharedAudioEncoderFactory(rtc::scoped_refptr<webrtc::AudioEncoderFactory> base)
+    : base_(base), registry_(std::make_shared<Registry>(base)) {
+}
+
+std::vector<webrtc::AudioCodecSpec> SharedAudioEncoderFactory::GetSupportedEncoders() {
+    return base_->GetSupportedEncoders();
+}
+
+absl::optional<webrtc::AudioCodecInfo> SharedAudioEncoderFactory::QueryAudioEncoder(
+    const webrtc::SdpAudioFormat& format) {
+    return base_->QueryAudioEncoder(format);
+}
+
+std::unique_ptr<webrtc::AudioEncoder> SharedAudioEncoderFactory::MakeAudioEncoder(int payload_type,
+    const webrtc::SdpAudioFormat& format, absl::optional<webrtc::AudioCodecPairId> codec_pair_id) {
+    std::unique_ptr<webrtc::AudioEncoder> encoder = base_->MakeAudioEncoder(payload_type, format, codec_pair_id);
+    if (!encoder || !absl::EqualsIgnoreCase(format.name, "opus")) {
+        return encoder;
+    }
+    return std::make_unique<SharedOpusEncoder>(payload_type, format, std::move(encoder), registry_);
+}
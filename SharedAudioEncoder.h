@@ -0,0 +1,112 @@
+// SharedAudioEncoder.h
+#pragma once
+#include <api/audio_codecs/audio_encoder.h>
+#include <api/audio_codecs/audio_encoder_factory.h>
+#include <rtc_base/buffer.h>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Every peer used to run its own Opus encoder over the identical shared
+// capture stream. SharedAudioEncoderFactory wraps the builtin factory and
+// hands out per-peer proxies instead: each 20 ms frame is encoded once per
+// bitrate tier and the payload is replayed to every peer in that tier. A
+// proxy only keeps its own RTP timestamps and payload type.
+//
+// Proxies find their place in the shared stream by hashing the 10 ms blocks
+// they are given. All peers receive the same blocks from the shared capture
+// source, in the same order, so whichever proxy presents a block first
+// encodes it and the others look it up. A proxy that cannot line up yet
+// (just created, or its stream skipped a block) encodes with its own
+// private encoder until it finds its block again.
+class SharedOpusEncoderCore {
+public:
+    SharedOpusEncoderCore(std::unique_ptr<webrtc::AudioEncoder> encoder, int bitrate_bps);
+    SharedOpusEncoderCore(const SharedOpusEncoderCore&) = delete;
+    SharedOpusEncoderCore& operator=(const SharedOpusEncoderCore&) = delete;
+
+    // Position of a proxy in the shared block sequence.
+    struct Cursor {
+        static constexpr uint64_t kUnsynced = UINT64_MAX;
+        uint64_t next = kUnsynced;  // Sequence number of the next block
+        uint64_t last_hash = 0;     // Hash of the previous block, if any
+        bool has_last = false;
+    };
+
+    // Encodes or replays the block `audio` for the proxy at `cursor`,
+    // appending any payload to `encoded`. The returned info carries the
+    // proxy's own `rtp_timestamp` domain. Returns false if the proxy is not
+    // lined up with the shared stream; nothing is appended then.
+    bool Encode(Cursor* cursor, uint64_t hash, uint32_t rtp_timestamp, rtc::ArrayView<const int16_t> audio,
+        rtc::Buffer* encoded, webrtc::AudioEncoder::EncodedInfo* info);
+
+    int BitrateBps() const { return bitrate_bps_; }
+
+    static uint64_t HashBlock(rtc::ArrayView<const int16_t> audio);
+
+private:
+    // How far a proxy may trail the leading one; 160 ms covers any
+    // scheduling skew between the peers' encoder queues.
+    static constexpr size_t kHistoryBlocks = 16;
+    // With no block encoded for this long nobody leads any more, and an
+    // unsynced proxy may restart the sequence.
+    static constexpr int64_t kLeaderTimeoutMs = 100;
+
+    struct Entry {
+        uint64_t hash = 0;
+        uint32_t rtp_timestamp = 0;  // In the core's own timestamp domain
+        rtc::Buffer payload;
+        webrtc::AudioEncoder::EncodedInfo info;
+    };
+
+    // Both expect mutex_ held.
+    const Entry* Find(uint64_t sequence) const;
+    const Entry& Feed(uint64_t hash, rtc::ArrayView<const int16_t> audio);
+    static void Replay(const Entry& entry, uint32_t rtp_timestamp, rtc::Buffer* encoded,
+        webrtc::AudioEncoder::EncodedInfo* info);
+
+    mutable std::mutex mutex_;
+    std::unique_ptr<webrtc::AudioEncoder> encoder_;
+    const int bitrate_bps_;
+    std::vector<Entry> history_;  // Indexed by sequence % kHistoryBlocks
+    uint64_t next_sequence_ = 0;
+    uint32_t timestamp_ = 0;
+    int64_t last_feed_ms_ = 0;
+};
+
+class SharedAudioEncoderFactory : public webrtc::AudioEncoderFactory {
+public:
+    explicit SharedAudioEncoderFactory(rtc::scoped_refptr<webrtc::AudioEncoderFactory> base);
+
+    std::vector<webrtc::AudioCodecSpec> GetSupportedEncoders() override;
+    absl::optional<webrtc::AudioCodecInfo> QueryAudioEncoder(const webrtc::SdpAudioFormat& format) override;
+    // Opus gets a shared proxy; every other codec comes from `base` as is.
+    // The proxy keeps the encoder `base` made as its private fallback.
+    std::unique_ptr<webrtc::AudioEncoder> MakeAudioEncoder(int payload_type, const webrtc::SdpAudioFormat& format,
+        absl::optional<webrtc::AudioCodecPairId> codec_pair_id) override;
+
+    // Bitrates peers are grouped into. A peer encodes at the highest tier
+    // not above its target bitrate, or the lowest one.
+    static constexpr int kBitrateTiersBps[] = { 16000, 24000, 32000, 48000, 64000, 96000, 128000 };
+
+    // Hands out the shared encoder for `format` at `bitrate_bps`, creating
+    // it on first use. Cores live as long as a proxy holds them.
+    class Registry {
+    public:
+        explicit Registry(rtc::scoped_refptr<webrtc::AudioEncoderFactory> base) : base_(std::move(base)) {}
+        std::shared_ptr<SharedOpusEncoderCore> Acquire(int payload_type, const webrtc::SdpAudioFormat& format,
+            int bitrate_bps);
+
+    private:
+        rtc::scoped_refptr<webrtc::AudioEncoderFactory> base_;
+        std::mutex mutex_;
+        std::map<std::string, std::weak_ptr<SharedOpusEncoderCore>> cores_;
+    };
+
+private:
+    rtc::scoped_refptr<webrtc::AudioEncoderFactory> base_;
+    std::shared_ptr<Registry> registry_;
+};
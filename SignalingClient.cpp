@@ -1,11 +1,80 @@
 #include "SignalingClient.h"
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <api/stats/rtc_stats_collector_callback.h>
+#include <api/stats/rtcstats_objects.h>
 #include "CaptureSource.h" 
+
+namespace {
+// Subscribes expected while one pooled PeerConnection is being created
+// decide how many are kept ready.
+constexpr std::chrono::seconds kPoolRefillHorizon{ 2 };
+// Stats are asked for this often after ICE connects, until an RTP packet
+// has been sent or ten seconds have passed.
+constexpr std::chrono::milliseconds kFirstRtpPollInterval{ 20 };
+constexpr int kFirstRtpPollAttempts = 500;
+
+// Reports whether any outbound RTP stream has sent a packet yet.
+class OutboundRtpStatsCallback : public webrtc::RTCStatsCollectorCallback {
+public:
+    explicit OutboundRtpStatsCallback(std::function<void(bool sent)> onResult) : m_onResult(std::move(onResult)) {}
+
+    void OnStatsDelivered(const rtc::scoped_refptr<const webrtc::RTCStatsReport>& report) override {
+        bool sent = false;
+        for (const webrtc::RTCOutboundRtpStreamStats* stats : report->GetStatsOfType<webrtc::RTCOutboundRtpStreamStats>()) {
+            if (stats->packets_sent.has_value() && *stats->packets_sent > 0) {
+                sent = true;
+                break;
+            }
+        }
+        m_onResult(sent);
+    }
+
+private:
+    std::function<void(bool sent)> m_onResult;
+};
+
+// The answer's Opus fmtp sets how we encode. Asking for DTX there lets the
+// encoder stop sending while the capture silence gate feeds it zeros.
+std::string EnableOpusDtx(std::string_view sdp) {
+    const std::string_view rtpmap = "a=rtpmap:";
+    size_t pos = sdp.find(" opus/48000");
+    if (pos == std::string_view::npos) {
+        return std::string(sdp);
+    }
+    const size_t line_start = sdp.rfind(rtpmap, pos);
+    if (line_start == std::string_view::npos) {
+        return std::string(sdp);
+    }
+    const std::string_view payload_type = sdp.substr(line_start + rtpmap.size(), pos - line_start - rtpmap.size());
+    const std::string fmtp = "a=fmtp:" + std::string(payload_type) + " ";
+    std::string munged(sdp);
+    const size_t fmtp_start = munged.find(fmtp);
+    if (fmtp_start == std::string::npos) {
+        const size_t rtpmap_end = munged.find("\r\n", pos);
+        if (rtpmap_end != std::string::npos) {
+            munged.insert(rtpmap_end + 2, fmtp + "usedtx=1\r\n");
+        }
+        return munged;
+    }
+    const size_t fmtp_end = munged.find("\r\n", fmtp_start);
+    if (munged.substr(fmtp_start, fmtp_end - fmtp_start).find("usedtx=") == std::string::npos) {
+        munged.insert(fmtp_end == std::string::npos ? munged.size() : fmtp_end, ";usedtx=1");
+    }
+    return munged;
+}
+}
+
 SignalingClient::SignalingClient(net::io_context& ioc,
     const std::string& serverUrl,
     const std::string& serverPort,
     const std::string& serverPath)
-    : m_streamerId(0),
+    : m_ioc(ioc),
+    m_streamerId(0),
+    m_peerConnectionPool(1, 4, kPoolRefillHorizon),
+    m_poolStrand(net::make_strand(ioc)),
+    m_poolTimer(m_poolStrand),
     m_serverURL(serverUrl),
     m_serverPort(serverPort),
     m_serverPath(serverPath) {
@@ -21,6 +90,9 @@ SignalingClient::SignalingClient(net::io_context& ioc,
     //increase send time history
     // Configure for lower latency
     config.set_dscp(true);
+    // Gather candidates as soon as a PeerConnection exists, so pooled ones
+    // have them ready by the time they are handed out.
+    config.ice_candidate_pool_size = 1;
     // Create WebSocket client
     m_webSocket = std::make_shared<WebSocketClient>(ioc, serverUrl, serverPort, serverPath);
 }
@@ -33,7 +105,7 @@ SignalingClient::~SignalingClient() {
 void SignalingClient::Connect() {
     // Connect to WebSocket server with callbacks
     m_webSocket->Connect(
-        [this](const std::string& message) {
+        [this](std::string_view message) {
             OnMessage(message);
         },
         [this](WebSocketClient::ConnectionState state) {
@@ -57,6 +129,32 @@ int SignalingClient::GetStreamerId() const {
     return m_streamerId;
 }
 
+SignalingClient::Stats SignalingClient::GetStats() const {
+    Stats stats;
+    stats.local_candidates = m_localCandidates;
+    stats.candidate_messages = m_candidateMessages;
+    stats.remote_candidates = m_remoteCandidates;
+    stats.remote_candidates_deferred = m_remoteCandidatesDeferred;
+    stats.remote_candidates_failed = m_remoteCandidatesFailed;
+    stats.pool_hits = m_peerConnectionPool.Hits();
+    stats.pool_misses = m_peerConnectionPool.Misses();
+    stats.pool_size = m_peerConnectionPool.Size();
+    stats.pool_target = m_peerConnectionPool.Target();
+    return stats;
+}
+
+boost::json::object SignalingClient::ExportJoinTimings() const {
+    return m_joinTimeline.Export();
+}
+
+void SignalingClient::SetCandidateBatchWindow(std::chrono::milliseconds window) {
+    m_candidateBatchWindow = window;
+}
+
+void SignalingClient::SetPeerConnectionPoolSize(size_t min_size, size_t max_size) {
+    m_peerConnectionPool.SetLimits(min_size, max_size);
+}
+
 void SignalingClient::SetPeerConnectionFactory(rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> peer_connection_factory) {
     m_peerConnectionFactory = peer_connection_factory;
 }
@@ -75,147 +173,271 @@ void SignalingClient::OnConnectionStateChange(WebSocketClient::ConnectionState s
     else if (state == WebSocketClient::ConnectionState::CONNECTION_ERROR) {
         std::cerr << "Signaling server connection error" << std::endl;
     }
+    else if (state == WebSocketClient::ConnectionState::RECONNECTING) {
+        std::cout << "Reconnecting to signaling server (attempt "
+            << m_webSocket->GetStats().reconnects << ")" << std::endl;
+    }
 }
 
 
-void SignalingClient::OnMessage(const std::string& message) {
-    try {
-        std::cout << message << "\n";
-        boost::json::value value{ boost::json::parse(message) };
-        HandleJSONMessage(value);
+// Indexed by SignalingMessageType.
+const SignalingClient::MessageHandler SignalingClient::kMessageHandlers[] = {
+    &SignalingClient::OnConnectMessage,
+    &SignalingClient::OnSubscribeMessage,
+    &SignalingClient::OnAnswerMessage,
+    &SignalingClient::OnIceCandidateMessage,
+    &SignalingClient::OnConsumerDisconnectedMessage,
+};
+static_assert(std::size(SignalingClient::kMessageHandlers) == static_cast<size_t>(SignalingMessageType::kUnknown),
+    "one handler per signaling message type");
+
+void SignalingClient::OnMessage(std::string_view message) {
+    SignalingMessageType type;
+    const boost::json::object* obj = m_messageParser.Parse(message, &type);
+    if (!obj) {
+        return;
     }
-    catch (const boost::system::system_error& e) {
-        std::cerr << "JSON parsing failed: " << e.what() << std::endl;
+    if (type == SignalingMessageType::kUnknown) {
+        std::cerr << "Unknown message: " << message.substr(0, 80) << std::endl;
         return;
     }
+    try {
+        (this->*kMessageHandlers[static_cast<size_t>(type)])(*obj);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Malformed " << SignalingMessageTypeToString(type) << " message: " << e.what() << std::endl;
+    }
 }
 
-void SignalingClient::HandleJSONMessage(const boost::json::value& value) {
-    if (value.is_object()) {
-        const boost::json::object& obj = value.as_object();
-        if (!obj.contains("type")) {
-            std::cerr << "Message has no type field" << std::endl;
-            return;
-        }
-        std::string type = obj.at("type").as_string().c_str();
-        if (type == "connect") {
-            m_streamerId = static_cast<IdType>(obj.at("id").as_int64());
-            std::cout << "Connected with streamer id: " << m_streamerId << std::endl;
-        }
-        else if (type == "subscribe") {
-            IdType sender_id = static_cast<IdType>(obj.at("sender").as_int64());
+template <typename Fn>
+bool SignalingClient::PostToConsumer(IdType consumer_id, Fn&& fn) {
+    std::optional<Consumer> consumer = m_consumers.Find(consumer_id);
+    if (!consumer) {
+        return false;
+    }
+    net::post(consumer->strand, [self = rtc::scoped_refptr<SignalingClient>(this), fn = std::forward<Fn>(fn)]() mutable {
+        fn();
+    });
+    return true;
+}
 
-            if (m_consumers.find(sender_id) == m_consumers.end()) {
+rtc::scoped_refptr<webrtc::PeerConnectionInterface> SignalingClient::FindPeerConnection(IdType consumer_id) const {
+    std::optional<Consumer> consumer = m_consumers.Find(consumer_id);
+    return consumer ? consumer->peer_connection : nullptr;
+}
 
-            std::cout << "Consumer wants to subscribe" << sender_id << std::endl;
-            SendOffer(sender_id);
-            }
-            else {
-                std::cout << "Consumer " << sender_id << " already connected" << std::endl;
-            }
-        }
-        else if (type == "answer") {
-            IdType sender_id = static_cast<IdType>(obj.at("sender").as_int64());
-                std::string sdp = obj.at("sdp").as_string().c_str();
-                std::cout << "Consumer answered" << sender_id << std::endl;
-                HandleAnswer(sender_id, sdp);
-           
-        }
-        else if (type == "consumer-disconnected") {
-            IdType consumer_id =static_cast<IdType>(obj.at("consumer_id").as_int64());
-            m_consumers.erase(consumer_id);
-            std::cout << "Consumer disconnected: " << consumer_id << std::endl;
-        }
-        else if (type == "ice-candidate") {
-            IdType sender_id =static_cast<IdType>(obj.at("sender").as_int64());
-            boost::json::value iceCandidate = obj.at("candidate");
-            std::cout << "Received ICE candidate from peer: " << sender_id << std::endl;
+std::shared_ptr<SignalingClient::CandidateState> SignalingClient::FindCandidateState(IdType consumer_id) const {
+    std::optional<Consumer> consumer = m_consumers.Find(consumer_id);
+    return consumer ? consumer->candidates : nullptr;
+}
 
-            ProcessIceCandidate(sender_id, iceCandidate);
-        }
-        else {
-            std::cerr << "Unkwon message" << "\n";
+void SignalingClient::OnConnectMessage(const boost::json::object& message) {
+    const IdType streamer_id = static_cast<IdType>(message.at("id").as_int64());
+    m_streamerId = streamer_id;
+    std::cout << "Connected with streamer id: " << streamer_id << std::endl;
+    // Subscribes can come from now on.
+    ReplenishPool();
+}
+
+void SignalingClient::OnSubscribeMessage(const boost::json::object& message) {
+    IdType sender_id = static_cast<IdType>(message.at("sender").as_int64());
+    // Registered before the offer exists, so a repeated subscribe cannot
+    // start a second setup.
+    auto strand = net::make_strand(m_ioc);
+    if (!m_consumers.Insert(sender_id, Consumer{ strand, nullptr, std::make_shared<CandidateState>(strand) })) {
+        std::cout << "Consumer " << sender_id << " already connected" << std::endl;
+        return;
+    }
+    m_joinTimeline.Begin(sender_id);
+    std::cout << "Consumer wants to subscribe" << sender_id << std::endl;
+    PostToConsumer(sender_id, [this, sender_id] { SendOffer(sender_id); });
+}
+
+void SignalingClient::OnAnswerMessage(const boost::json::object& message) {
+    IdType sender_id = static_cast<IdType>(message.at("sender").as_int64());
+    std::cout << "Consumer answered" << sender_id << std::endl;
+    // The message is gone once this returns; the SDP goes along as a copy.
+    if (!PostToConsumer(sender_id, [this, sender_id, sdp = std::string(JsonStringView(message.at("sdp")))] {
+        HandleAnswer(sender_id, sdp);
+    })) {
+        std::cerr << "Peer connection not found: " << sender_id << std::endl;
+    }
+}
+
+void SignalingClient::OnIceCandidateMessage(const boost::json::object& message) {
+    IdType sender_id = static_cast<IdType>(message.at("sender").as_int64());
+    std::cout << "Received ICE candidate from peer: " << sender_id << std::endl;
+    // A batch carries "candidates", a single one "candidate".
+    std::vector<RemoteCandidate> remote;
+    auto add = [&remote](const boost::json::value& candidate) {
+        RemoteCandidate& added = remote.emplace_back();
+        added.sdp_mid = JsonStringView(candidate.at("sdpMid"));
+        added.sdp_mline_index = static_cast<int>(candidate.at("sdpMLineIndex").as_int64());
+        added.sdp = JsonStringView(candidate.at("candidate"));
+    };
+    if (const boost::json::value* batch = message.if_contains("candidates")) {
+        for (const boost::json::value& candidate : batch->as_array()) {
+            add(candidate);
         }
     }
     else {
-        std::cerr << "Parsed value is not a JSON object." << std::endl;
+        add(message.at("candidate"));
+    }
+    m_remoteCandidates += remote.size();
+    if (!PostToConsumer(sender_id, [this, sender_id, remote = std::move(remote)] {
+        for (const RemoteCandidate& candidate : remote) {
+            ProcessIceCandidate(sender_id, candidate);
+        }
+    })) {
+        std::cerr << "peer connection not found: " << sender_id << std::endl;
     }
 }
 
-void SignalingClient::SendOffer(IdType consumer_id) {
+void SignalingClient::OnConsumerDisconnectedMessage(const boost::json::object& message) {
+    IdType consumer_id = static_cast<IdType>(message.at("consumer_id").as_int64());
+    std::optional<Consumer> consumer = m_consumers.Erase(consumer_id);
+    if (consumer) {
+        // Let work already queued for the consumer finish before the last
+        // reference to its PeerConnection goes. Candidates still waiting for
+        // the batch window have no one to go to.
+        net::post(consumer->strand, [released = std::move(*consumer)] {
+            released.candidates->flush_timer.cancel();
+        });
+    }
+    m_joinTimeline.End(consumer_id);
+    std::cout << "Consumer disconnected: " << consumer_id << std::endl;
+}
 
-    class SignalingPeerConnectionObserver : public webrtc::PeerConnectionObserver {
-    public:
-        SignalingPeerConnectionObserver(SignalingClient* client, IdType consumer_id) : m_client(client), consumer_id_(consumer_id) {}
+class SignalingClient::SignalingPeerConnectionObserver : public webrtc::PeerConnectionObserver {
+public:
+    explicit SignalingPeerConnectionObserver(SignalingClient* client) : m_client(client) {}
 
-        void OnSignalingChange(webrtc::PeerConnectionInterface::SignalingState new_state) override {
-            std::cout << "Signaling state changed to: " << new_state << std::endl;
-        }
+    // Hands a pooled PeerConnection to a consumer. Until then it has no one
+    // to report to, and its events are dropped.
+    void Assign(IdType consumer_id) { consumer_id_ = consumer_id; }
+    IdType ConsumerId() const { return consumer_id_; }
 
-        void OnDataChannel(rtc::scoped_refptr<webrtc::DataChannelInterface> data_channel) override {
-            std::cout << "Data channel created" << std::endl;
-        }
+    void OnSignalingChange(webrtc::PeerConnectionInterface::SignalingState new_state) override {
+        std::cout << "Signaling state changed to: " << new_state << std::endl;
+    }
 
-        void OnRenegotiationNeeded() override {
-            std::cout << "Renegotiation needed" << std::endl;
-            // We're the answerer, so we don't create offers
+    void OnDataChannel(rtc::scoped_refptr<webrtc::DataChannelInterface> data_channel) override {
+        std::cout << "Data channel created" << std::endl;
+    }
 
-            auto peer_connection_it = m_client->m_consumers.find(consumer_id_);
-            if (peer_connection_it != m_client->m_consumers.end()) {
-                auto peer_connection = peer_connection_it->second;
+    void OnRenegotiationNeeded() override {
+        std::cout << "Renegotiation needed" << std::endl;
+        const IdType consumer_id = consumer_id_;
+        if (consumer_id == kUnassigned) {
+            return;
+        }
 
-                webrtc::PeerConnectionInterface::RTCOfferAnswerOptions options;
-                peer_connection->CreateOffer(
-                    new webrtc::RefCountedObject<CreateSDPOfferObserver>(consumer_id_, peer_connection, m_client),
-                    options
-                );
-            
-            }
-            else {
-                std::cerr << "Renegotiation needed but peer connection not found for consumer: " << consumer_id_ << std::endl;
+        auto peer_connection = m_client->FindPeerConnection(consumer_id);
+        if (peer_connection) {
+            // SendOffer() makes the first offer itself; this only covers
+            // changes after that.
+            if (!peer_connection->local_description()) {
+                return;
             }
+            webrtc::PeerConnectionInterface::RTCOfferAnswerOptions options;
+            peer_connection->CreateOffer(
+                new webrtc::RefCountedObject<CreateSDPOfferObserver>(consumer_id, peer_connection, m_client),
+                options
+            );
         }
+        else {
+            std::cerr << "Renegotiation needed but peer connection not found for consumer: " << consumer_id << std::endl;
+        }
+    }
 
-        void OnIceConnectionChange(webrtc::PeerConnectionInterface::IceConnectionState new_state) override {
-            std::cout << "ICE connection state changed to: " << new_state << std::endl;
-            if (new_state == webrtc::PeerConnectionInterface::kIceConnectionConnected) {
-                std::cout << "ICE connected! Media should be flowing." << std::endl;
-            }
-            else if (new_state == webrtc::PeerConnectionInterface::kIceConnectionFailed) {
-                std::cout << "ICE connection failed!" << std::endl;
+    void OnIceConnectionChange(webrtc::PeerConnectionInterface::IceConnectionState new_state) override {
+        std::cout << "ICE connection state changed to: " << new_state << std::endl;
+        if (new_state == webrtc::PeerConnectionInterface::kIceConnectionConnected) {
+            std::cout << "ICE connected! Media should be flowing." << std::endl;
+            const IdType consumer_id = consumer_id_;
+            if (consumer_id != kUnassigned) {
+                m_client->OnIceConnected(consumer_id);
             }
         }
+        else if (new_state == webrtc::PeerConnectionInterface::kIceConnectionFailed) {
+            std::cout << "ICE connection failed!" << std::endl;
+        }
+    }
 
-        void OnIceGatheringChange(webrtc::PeerConnectionInterface::IceGatheringState new_state) override {
-            std::cout << "ICE gathering state changed to: " << new_state << std::endl;
+    void OnIceSelectedCandidatePairChanged(const cricket::CandidatePairChangeEvent& event) override {
+        const IdType consumer_id = consumer_id_;
+        if (consumer_id != kUnassigned) {
+            m_client->m_joinTimeline.Mark(consumer_id, JoinStage::kCandidatePairSelected);
         }
+    }
 
-        void OnIceCandidate(const webrtc::IceCandidateInterface* candidate) override {
-            std::cout << "New ICE candidate" << std::endl;
-            if (m_client) {
-                m_client->OnIceCandidate(consumer_id_, candidate);
-            }
+    void OnIceGatheringChange(webrtc::PeerConnectionInterface::IceGatheringState new_state) override {
+        std::cout << "ICE gathering state changed to: " << new_state << std::endl;
+        const IdType consumer_id = consumer_id_;
+        if (new_state == webrtc::PeerConnectionInterface::kIceGatheringComplete && consumer_id != kUnassigned) {
+            m_client->OnIceGatheringComplete(consumer_id);
         }
+    }
 
-        void OnTrack(rtc::scoped_refptr<webrtc::RtpTransceiverInterface> transceiver) override {
-            std::cout << "Received track (unexpected in streamer role)" << std::endl;
+    void OnIceCandidate(const webrtc::IceCandidateInterface* candidate) override {
+        std::cout << "New ICE candidate" << std::endl;
+        // Pooled candidates surface once the offer is applied, which is
+        // after Assign().
+        const IdType consumer_id = consumer_id_;
+        if (consumer_id != kUnassigned) {
+            m_client->OnIceCandidate(consumer_id, candidate);
         }
-    private:
-        SignalingClient* m_client;
-        IdType consumer_id_;
+    }
 
+    void OnTrack(rtc::scoped_refptr<webrtc::RtpTransceiverInterface> transceiver) override {
+        std::cout << "Received track (unexpected in streamer role)" << std::endl;
+    }
 
-    };
+private:
+    static constexpr IdType kUnassigned = std::numeric_limits<IdType>::max();
 
+    SignalingClient* m_client;
+    std::atomic<IdType> consumer_id_ = kUnassigned;
+};
 
-    webrtc::PeerConnectionDependencies dependencies(new SignalingPeerConnectionObserver(this, consumer_id));
+void SignalingClient::SendOffer(IdType consumer_id) {
+    // Usually a pool pop; creating one here is the fallback.
+    std::optional<PooledPeerConnection> pooled = m_peerConnectionPool.Take();
+    ReplenishPool();
+    if (!pooled) {
+        pooled = CreatePeerConnection();
+    }
+    if (!pooled) {
+        std::cerr << "Failed to create PeerConnection for " << consumer_id << std::endl;
+        // Allows the consumer to subscribe again.
+        m_consumers.Erase(consumer_id);
+        m_joinTimeline.End(consumer_id);
+        return;
+    }
+    if (!m_consumers.Update(consumer_id, [&](Consumer& consumer) { consumer.peer_connection = pooled->peer_connection; })) {
+        // Left meanwhile; the PeerConnection is still unused.
+        m_peerConnectionPool.Put(std::move(*pooled));
+        return;
+    }
+    pooled->observer->Assign(consumer_id);
+    m_joinTimeline.Mark(consumer_id, JoinStage::kPeerConnectionReady);
+
+    webrtc::PeerConnectionInterface::RTCOfferAnswerOptions options;
+    pooled->peer_connection->CreateOffer(
+        new webrtc::RefCountedObject<CreateSDPOfferObserver>(consumer_id, pooled->peer_connection, this),
+        options);
+}
+
+std::optional<SignalingClient::PooledPeerConnection> SignalingClient::CreatePeerConnection() {
+    SignalingPeerConnectionObserver* observer = new SignalingPeerConnectionObserver(this);
+    webrtc::PeerConnectionDependencies dependencies(observer);
     webrtc::RTCErrorOr<rtc::scoped_refptr<webrtc::PeerConnectionInterface>> peer_connection =
         m_peerConnectionFactory->CreatePeerConnectionOrError(config, std::move(dependencies));
     if (!peer_connection.ok()) {
-        std::cerr << "Failed to create PeerConnection for " << consumer_id << std::endl;
-        return;
+        std::cerr << "Failed to create PeerConnection: " << peer_connection.error().message() << std::endl;
+        delete observer;
+        return std::nullopt;
     }
-    m_consumers.insert({ consumer_id,peer_connection.value() });
   
 
     webrtc::BitrateSettings bitrate_settings;
@@ -227,18 +449,24 @@ void SignalingClient::SendOffer(IdType consumer_id) {
 
 	peer_connection.value()->SetBitrate(bitrate_settings);
     
-    // Add video track with transceiver BEFORE setting remote description
+    // Tracks are attached before the offer exists, so it carries them.
+    // Pooled PeerConnections have no consumer yet; ids are per PeerConnection.
     try {
 
+        const std::string number = std::to_string(++m_peerConnectionsCreated);
+        std::string video_id = "video_track_" + number;
+        std::string audio_id = "audio_track_" + number;
 
-        std::string video_id = "video_track_" + std::to_string(consumer_id);
-        std::string audio_id = "audio_track_" + std::to_string(consumer_id);
-
-        std::string stream_id = "stream_" + std::to_string(consumer_id);
+        std::string stream_id = "stream_" + number;
 
         
-        webrtc::scoped_refptr<webrtc::VideoTrackInterface> video_track
+        webrtc::scoped_refptr<VideoCaptureTrack> video_track
         (new rtc::RefCountedObject<VideoCaptureTrack>(video_id));
+        // The sink is attached once the offer is answered, so by the first
+        // frame the PeerConnection has its consumer.
+        video_track->SetFirstFrameCallback([this, observer] {
+            m_joinTimeline.Mark(observer->ConsumerId(), JoinStage::kFirstFrameDelivered);
+        });
        
         webrtc::RTCErrorOr<webrtc::scoped_refptr<webrtc::RtpSenderInterface>>	rtp_sender =
             peer_connection.value()->AddTrack(video_track, { stream_id });
@@ -262,88 +490,246 @@ void SignalingClient::SendOffer(IdType consumer_id) {
     catch (const std::exception& e) {
         std::cerr << "Exception adding video track: " << e.what() << std::endl;
     }
+    return PooledPeerConnection{ peer_connection.value(), observer };
+}
+
+void SignalingClient::ReplenishPool() {
+    net::post(m_poolStrand, [self = rtc::scoped_refptr<SignalingClient>(this)] { self->RefillPoolStep(); });
 }
-void SignalingClient::HandleAnswer(IdType consumer_id,const std::string sdp) {
-    auto consumer_it = m_consumers.find(consumer_id);
-    if (consumer_it == m_consumers.end()) {
+
+void SignalingClient::RefillPoolStep() {
+    if (!m_peerConnectionFactory) {
+        return;
+    }
+    while (std::optional<PooledPeerConnection> surplus = m_peerConnectionPool.TakeSurplus()) {
+        surplus->peer_connection->Close();
+    }
+    if (m_peerConnectionPool.Size() < m_peerConnectionPool.Target()) {
+        std::optional<PooledPeerConnection> created = CreatePeerConnection();
+        if (created) {
+            m_peerConnectionPool.Put(std::move(*created));
+            // Yield between creations; the next subscribe may have
+            // changed the target anyway.
+            ReplenishPool();
+        }
+        return;
+    }
+    // The target only falls as demand ages out, and no subscribe may come
+    // to notice; look again after that.
+    if (m_peerConnectionPool.Size() > m_peerConnectionPool.MinSize()) {
+        m_poolTimer.expires_after(WarmPool<PooledPeerConnection>::kRateWindow);
+        m_poolTimer.async_wait([self = rtc::scoped_refptr<SignalingClient>(this)](const boost::system::error_code& ec) {
+            if (ec != net::error::operation_aborted) {
+                self->RefillPoolStep();
+            }
+        });
+    }
+}
+void SignalingClient::HandleAnswer(IdType consumer_id, std::string_view sdp) {
+    auto peer_connection = FindPeerConnection(consumer_id);
+    if (!peer_connection) {
         std::cerr << "Peer connection not found: " << consumer_id << std::endl;
         return;
     }
-    auto peer_connection = consumer_it->second;
     // Create description
 	webrtc::SdpParseError* error_out=nullptr;
 
 	std::unique_ptr<webrtc::SessionDescriptionInterface> session_description = 
-        webrtc::CreateSessionDescription(webrtc::SdpType::kAnswer, sdp, error_out);
+        webrtc::CreateSessionDescription(webrtc::SdpType::kAnswer, EnableOpusDtx(sdp), error_out);
     if (error_out){
 		std::cerr << "Error creating session description"<< error_out->line << std::endl;
     }
 
     // Create answer with proper observer
 	webrtc::scoped_refptr<SetRemoteSessionDescriptionObserver> observer(
-		new rtc::RefCountedObject<SetRemoteSessionDescriptionObserver>(consumer_id));
+		new rtc::RefCountedObject<SetRemoteSessionDescriptionObserver>(this, consumer_id));
     peer_connection->SetRemoteDescription(
         std::move(session_description), observer
         );
 }
-void SignalingClient::ProcessIceCandidate(IdType peerId, const boost::json::value& candidate) {
-    if (m_consumers.find(peerId) == m_consumers.end()) {
+void SignalingClient::ProcessIceCandidate(IdType peerId, const RemoteCandidate& candidate) {
+    auto peer_connection = FindPeerConnection(peerId);
+    std::shared_ptr<CandidateState> state = FindCandidateState(peerId);
+    if (!peer_connection || !state) {
         std::cerr << "peer connection not found: " << peerId << std::endl;
         return;
     }
-    auto peer_connection = m_consumers[peerId];
-
-    // Create ICE candidate from JSON
-    std::string sdpMid = candidate.at("sdpMid").as_string().c_str();
-    int sdpMLineIndex = static_cast<int>(candidate.at("sdpMLineIndex").as_int64());
-    std::string sdp = candidate.at("candidate").as_string().c_str();
+    // Candidates that beat the answer would be rejected; hold them until
+    // OnRemoteDescriptionSet(). After a failed answer nothing can use them.
+    switch (state->remote_description) {
+    case CandidateState::RemoteDescription::kPending:
+        state->incoming.push_back(candidate);
+        ++m_remoteCandidatesDeferred;
+        break;
+    case CandidateState::RemoteDescription::kFailed:
+        ++m_remoteCandidatesFailed;
+        break;
+    case CandidateState::RemoteDescription::kSet:
+        AddRemoteCandidate(peer_connection.get(), candidate);
+        break;
+    }
+}
 
+bool SignalingClient::AddRemoteCandidate(webrtc::PeerConnectionInterface* peer_connection, const RemoteCandidate& candidate) {
     // Create and add ICE candidate
     webrtc::SdpParseError error;
     std::unique_ptr<webrtc::IceCandidateInterface> ice_candidate(
-        webrtc::CreateIceCandidate(sdpMid, sdpMLineIndex, sdp, &error));
+        webrtc::CreateIceCandidate(candidate.sdp_mid, candidate.sdp_mline_index, candidate.sdp, &error));
 
     if (!ice_candidate) {
         std::cerr << "Failed to parse ICE candidate: " << error.description << std::endl;
-        return;
+        ++m_remoteCandidatesFailed;
+        return false;
     }
 
     // Add ICE candidate to peer connection
     if (!peer_connection->AddIceCandidate(ice_candidate.get())) {
         std::cerr << "Failed to add ICE candidate" << std::endl;
+        ++m_remoteCandidatesFailed;
+        return false;
     }
+    return true;
+}
+
+void SignalingClient::OnRemoteDescriptionSet(IdType consumer_id, bool ok) {
+    PostToConsumer(consumer_id, [this, consumer_id, ok] {
+        auto peer_connection = FindPeerConnection(consumer_id);
+        std::shared_ptr<CandidateState> state = FindCandidateState(consumer_id);
+        if (!peer_connection || !state) {
+            return;
+        }
+        std::vector<RemoteCandidate> incoming;
+        incoming.swap(state->incoming);
+        if (!ok) {
+            // Nothing to pair them with; the consumer has to subscribe again.
+            // Later candidates are counted as failed instead of piling up.
+            state->remote_description = CandidateState::RemoteDescription::kFailed;
+            m_remoteCandidatesFailed += incoming.size();
+            return;
+        }
+        m_joinTimeline.Mark(consumer_id, JoinStage::kAnswerApplied);
+        state->remote_description = CandidateState::RemoteDescription::kSet;
+        for (const RemoteCandidate& candidate : incoming) {
+            AddRemoteCandidate(peer_connection.get(), candidate);
+        }
+    });
 }
 
 void SignalingClient::OnIceCandidate(IdType consumer_id,const webrtc::IceCandidateInterface* candidate) {
-    // Convert ICE candidate to JSON
+    // Convert ICE candidate to JSON now; `candidate` is only valid during the call.
     std::string sdp;
     candidate->ToString(&sdp);
 
-    // Create JSON message for each peer
-        boost::json::object message;
-        message["type"] = "ice-candidate";
-        message["target"] = consumer_id;
+    boost::json::object candidateJson;
+    candidateJson["sdpMid"] = candidate->sdp_mid();
+    candidateJson["sdpMLineIndex"] = candidate->sdp_mline_index();
+    candidateJson["candidate"] = sdp;
+    ++m_localCandidates;
 
-        boost::json::object candidateJson;
-        candidateJson["sdpMid"] = candidate->sdp_mid();
-        candidateJson["sdpMLineIndex"] = candidate->sdp_mline_index();
-        candidateJson["candidate"] = sdp;
-        message["candidate"] = candidateJson;
+    PostToConsumer(consumer_id, [this, consumer_id, candidateJson = std::move(candidateJson)]() mutable {
+        QueueLocalCandidate(consumer_id, std::move(candidateJson));
+    });
+}
 
-        // Send ICE candidate to peer
-        SendToPeer(consumer_id, boost::json::serialize(message));
-    
+void SignalingClient::OnIceGatheringComplete(IdType consumer_id) {
+    // No more are coming, so there is nothing to wait for.
+    PostToConsumer(consumer_id, [this, consumer_id] {
+        if (std::shared_ptr<CandidateState> state = FindCandidateState(consumer_id)) {
+            FlushLocalCandidates(consumer_id, *state);
+        }
+    });
 }
 
-void SignalingClient::SendToPeer(IdType peerId, const std::string& message) {
+void SignalingClient::QueueLocalCandidate(IdType consumer_id, boost::json::object candidate) {
+    std::shared_ptr<CandidateState> state = FindCandidateState(consumer_id);
+    if (!state) {
+        return;
+    }
+    state->outgoing.emplace_back(std::move(candidate));
+    if (m_candidateBatchWindow.count() <= 0) {
+        FlushLocalCandidates(consumer_id, *state);
+        return;
+    }
+    if (state->outgoing.size() > 1) {
+        // The first candidate of the batch already armed the timer.
+        return;
+    }
+    // Host candidates come within a few milliseconds of each other; one
+    // message then carries them all.
+    state->flush_timer.expires_after(m_candidateBatchWindow);
+    state->flush_timer.async_wait([self = rtc::scoped_refptr<SignalingClient>(this), consumer_id, state](
+        const boost::system::error_code& ec) {
+        if (ec != net::error::operation_aborted) {
+            self->FlushLocalCandidates(consumer_id, *state);
+        }
+    });
+}
+
+void SignalingClient::FlushLocalCandidates(IdType consumer_id, CandidateState& state) {
+    state.flush_timer.cancel();
+    if (state.outgoing.empty()) {
+        return;
+    }
+    boost::json::object message;
+    message["type"] = "ice-candidate";
+    message["target"] = consumer_id;
+    // A lone candidate keeps the single-candidate form.
+    if (state.outgoing.size() == 1) {
+        message["candidate"] = std::move(state.outgoing.front());
+    }
+    else {
+        message["candidates"] = std::move(state.outgoing);
+    }
+    state.outgoing = boost::json::array();
+    ++m_candidateMessages;
+
+    // Send ICE candidates to peer
+    SendToPeer(consumer_id, boost::json::serialize(message));
+}
+
+void SignalingClient::OnIceConnected(IdType consumer_id) {
+    if (m_joinTimeline.Mark(consumer_id, JoinStage::kIceConnected)) {
+        PollFirstRtp(consumer_id, 0);
+    }
+}
+
+void SignalingClient::PollFirstRtp(IdType consumer_id, int attempt) {
+    auto peer_connection = FindPeerConnection(consumer_id);
+    if (!peer_connection || attempt >= kFirstRtpPollAttempts) {
+        return;
+    }
+    peer_connection->GetStats(rtc::scoped_refptr<webrtc::RTCStatsCollectorCallback>(
+        new rtc::RefCountedObject<OutboundRtpStatsCallback>(
+            [self = rtc::scoped_refptr<SignalingClient>(this), consumer_id, attempt](bool sent) {
+        if (sent) {
+            if (self->m_joinTimeline.Mark(consumer_id, JoinStage::kFirstRtpSent)) {
+                std::cout << "Consumer " << consumer_id << " joined: "
+                    << self->m_joinTimeline.Describe(consumer_id) << std::endl;
+            }
+            return;
+        }
+        auto timer = std::make_shared<net::steady_timer>(self->m_ioc, kFirstRtpPollInterval);
+        timer->async_wait([self, timer, consumer_id, attempt](const boost::system::error_code& ec) {
+            if (!ec) {
+                self->PollFirstRtp(consumer_id, attempt + 1);
+            }
+        });
+    })));
+}
+
+void SignalingClient::SendToPeer(IdType peerId, std::string message, std::optional<JoinStage> sentStage) {
     if (!m_webSocket || !m_webSocket->IsConnected()) {
         std::cerr << "WebSocket not connected" << std::endl;
         return;
     }
     // Send message via WebSocket
-    m_webSocket->Send(message, [peerId](const std::string& msg, WebSocketClient::MessageStatus status) {
+    m_webSocket->Send(std::move(message), [self = rtc::scoped_refptr<SignalingClient>(this), peerId, sentStage](
+        const std::string& msg, WebSocketClient::MessageStatus status) {
         if (status == WebSocketClient::MessageStatus::SENT) {
             std::cout << "Message sent to peer " << peerId << " successfully" << std::endl;
+            if (sentStage) {
+                self->m_joinTimeline.Mark(peerId, *sentStage);
+            }
         }
         else if (status == WebSocketClient::MessageStatus::FAILED) {
             std::cerr << "Failed to send message to peer " << peerId << std::endl;
@@ -2,14 +2,22 @@
 #pragma once
 
 #include "WebSocketClient.h"
+#include "SignalingMessage.h"
+#include "JoinTimeline.h"
+#include "ShardedRegistry.h"
+#include "WarmPool.h"
 #include <api/candidate.h>
 #include <api/peer_connection_interface.h>
 #include <boost/json.hpp>
+#include <chrono>
 #include <functional>
 #include <string>
+#include <string_view>
 #include <memory>
+#include <optional>
 #include <iostream>
 #include <atomic>
+#include <vector>
 #include <rtc_base/synchronization/mutex.h>
 
 class SetLocalDescriptionObserverInterface : public webrtc::SetLocalDescriptionObserverInterface {
@@ -38,6 +46,20 @@ class SignalingClient :public webrtc::RefCountInterface {
 public:
 	using PeerConnectionCallBack = std::function<void(int consumerId)>;
 	using IdType= uint64_t;
+
+	// ICE candidate traffic, readable from any thread.
+	struct Stats {
+		uint64_t local_candidates = 0;          // Gathered for all consumers
+		uint64_t candidate_messages = 0;        // Sent to carry them
+		uint64_t remote_candidates = 0;         // Received from consumers
+		uint64_t remote_candidates_deferred = 0; // Held until the answer was applied
+		uint64_t remote_candidates_failed = 0;
+		uint64_t pool_hits = 0;                 // Subscribes served a pooled PeerConnection
+		uint64_t pool_misses = 0;               // Subscribes that had to create one
+		uint64_t pool_size = 0;
+		uint64_t pool_target = 0;
+	};
+
 	SignalingClient(net::io_context& ioc, const std::string& serverURL, const std::string& serverPort, const std::string& serverPath);
 	~SignalingClient();
 	
@@ -50,6 +72,20 @@ public:
 
 	WebSocketClient::ConnectionState GetConnectionState() const;
 	int GetStreamerId() const;
+	Stats GetStats() const;
+	// Local candidates gathered within `window` of the first go to the
+	// consumer in one message. Zero sends each on its own. Set before
+	// Connect().
+	void SetCandidateBatchWindow(std::chrono::milliseconds window);
+	// Bounds for the pool of PeerConnections kept ready for subscribes. Each
+	// pooled one holds its tracks and pre-gathered ICE candidates, so even an
+	// idle streamer pays for `min_size` of them; its video track only starts
+	// capturing once a consumer's sender attaches. A `max_size` of zero
+	// creates them on subscribe.
+	void SetPeerConnectionPoolSize(size_t min_size, size_t max_size);
+	// Where each consumer's join time went, from subscribe to first RTP
+	// packet; see JoinTimeline::Export().
+	boost::json::object ExportJoinTimings() const;
 
 	void AddRef() const override { ++ref_count_; }
 	webrtc::RefCountReleaseStatus Release() const override {
@@ -63,7 +99,8 @@ public:
 private:
 	class SetRemoteSessionDescriptionObserver : public webrtc::SetRemoteDescriptionObserverInterface {
 	public:
-		SetRemoteSessionDescriptionObserver(IdType consumer_id) :consumer_id_(consumer_id) {}
+		SetRemoteSessionDescriptionObserver(SignalingClient* client, IdType consumer_id)
+			:client_(client), consumer_id_(consumer_id) {}
 		void OnSetRemoteDescriptionComplete(webrtc::RTCError error) override {
 			if (!error.ok()) {
 				std::cerr << "Failed to set remote description: " << error.message() << std::endl;
@@ -71,6 +108,7 @@ private:
 			else {
 				std::cout << "Remote description set successfully for consumer: " << consumer_id_ << std::endl;
 			}
+			client_->OnRemoteDescriptionSet(consumer_id_, error.ok());
 		}
 		// RefCounted implementation
 		void AddRef() const override { ++ref_count_; }
@@ -83,6 +121,7 @@ private:
 		}
 
 	private:
+		rtc::scoped_refptr<SignalingClient> client_;
 		IdType consumer_id_;
 		mutable std::atomic<int> ref_count_ = 0;
 	};
@@ -121,6 +160,9 @@ private:
 				return;
 			}
 			std::cout << "Offer SDP: " << sdp << "\n";
+			if (m_client) {
+				m_client->m_joinTimeline.Mark(m_consumer_id, JoinStage::kOfferCreated);
+			}
 
 			// First send answer to peer, before setting local description
 			// This ensures we don't have race conditions with ICE candidates
@@ -130,7 +172,7 @@ private:
 				message["target"] = m_consumer_id;
 				message["sdp"] = sdp;
 
-				m_client->SendToPeer(m_consumer_id, boost::json::serialize(message));
+				m_client->SendToPeer(m_consumer_id, boost::json::serialize(message), JoinStage::kOfferSent);
 			}
 
 			// Set local description
@@ -157,30 +199,113 @@ private:
 		SignalingClient* m_client;  // Raw pointer with explicit reference counting
 	};
 
+	// An ICE candidate as received, copied out of the message.
+	struct RemoteCandidate {
+		std::string sdp_mid;
+		int sdp_mline_index = 0;
+		std::string sdp;
+	};
+	class SignalingPeerConnectionObserver;
+	// A PeerConnection with its tracks attached and ICE candidates being
+	// gathered, made before anyone asked for it.
+	struct PooledPeerConnection {
+		rtc::scoped_refptr<webrtc::PeerConnectionInterface> peer_connection;
+		SignalingPeerConnectionObserver* observer;  // Lives as long as the PeerConnection
+	};
+	// A consumer's candidates in both directions. Only touched on the
+	// consumer's strand.
+	struct CandidateState {
+		explicit CandidateState(const net::strand<net::io_context::executor_type>& strand) : flush_timer(strand) {}
+		net::steady_timer flush_timer;
+		boost::json::array outgoing;             // Waiting for the batch window to close
+		enum class RemoteDescription { kPending, kSet, kFailed };
+		RemoteDescription remote_description = RemoteDescription::kPending;
+		std::vector<RemoteCandidate> incoming;   // Waiting for the remote description
+	};
+	// A subscribed consumer. Everything done for it runs on its own strand,
+	// so consumers are set up in parallel on the io_context's thread pool
+	// while messages for any one of them stay in order.
+	struct Consumer {
+		net::strand<net::io_context::executor_type> strand;
+		rtc::scoped_refptr<webrtc::PeerConnectionInterface> peer_connection;  // Null until SendOffer() creates it
+		std::shared_ptr<CandidateState> candidates;
+	};
+
+	// Runs fn() on the consumer's strand, keeping this client alive until it
+	// has run. Returns false if the consumer is unknown.
+	template <typename Fn>
+	bool PostToConsumer(IdType consumer_id, Fn&& fn);
+	rtc::scoped_refptr<webrtc::PeerConnectionInterface> FindPeerConnection(IdType consumer_id) const;
+	std::shared_ptr<CandidateState> FindCandidateState(IdType consumer_id) const;
+
 	void SendOffer(IdType consumer_id);
-	void HandleAnswer(IdType consumer_id, const std::string sdp);
-	void OnMessage(const std::string& message);
-	void SendToPeer(IdType peerId, const std::string& message);
-	void HandleJSONMessage(const boost::json::value& value);
-	void ProcessIceCandidate(IdType peerId, const boost::json::value& candidate);
+	std::optional<PooledPeerConnection> CreatePeerConnection();
+	// Brings the pool to its target in the background, one PeerConnection
+	// per step on m_poolStrand.
+	void ReplenishPool();
+	void RefillPoolStep();
+	void HandleAnswer(IdType consumer_id, std::string_view sdp);
+	void OnMessage(std::string_view message);
+	// `sentStage`, if given, is marked on the peer's join timeline once the
+	// message is written.
+	void SendToPeer(IdType peerId, std::string message, std::optional<JoinStage> sentStage = std::nullopt);
+	// Handlers for each SignalingMessageType, looked up in kMessageHandlers.
+	using MessageHandler = void (SignalingClient::*)(const boost::json::object& message);
+	static const MessageHandler kMessageHandlers[];
+	void OnConnectMessage(const boost::json::object& message);
+	void OnSubscribeMessage(const boost::json::object& message);
+	void OnAnswerMessage(const boost::json::object& message);
+	void OnIceCandidateMessage(const boost::json::object& message);
+	void OnConsumerDisconnectedMessage(const boost::json::object& message);
+	void ProcessIceCandidate(IdType peerId, const RemoteCandidate& candidate);
+	bool AddRemoteCandidate(webrtc::PeerConnectionInterface* peer_connection, const RemoteCandidate& candidate);
+	// Reported by SetRemoteSessionDescriptionObserver from WebRTC's
+	// signaling thread; applies or drops the candidates held back meanwhile.
+	void OnRemoteDescriptionSet(IdType consumer_id, bool ok);
 	void OnConnectionStateChange(WebSocketClient::ConnectionState state);
 	void OnIceCandidate(IdType consumer_id, const webrtc::IceCandidateInterface* candidate);
+	void OnIceGatheringComplete(IdType consumer_id);
+	// Strand-only halves of the above.
+	void QueueLocalCandidate(IdType consumer_id, boost::json::object candidate);
+	void FlushLocalCandidates(IdType consumer_id, CandidateState& state);
+	// Media may flow from here on; asks for stats until the first RTP
+	// packet has gone out, as nothing reports it directly.
+	void OnIceConnected(IdType consumer_id);
+	void PollFirstRtp(IdType consumer_id, int attempt);
 
 	std::shared_ptr<WebSocketClient> m_webSocket;
+	SignalingMessageParser m_messageParser;
 
 	rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> m_peerConnectionFactory;
 
-	IdType m_streamerId;
+	net::io_context& m_ioc;
+	std::atomic<IdType> m_streamerId;
 
 	PeerConnectionCallBack m_onPeerConnectionCallBack;
 
-	std::map<IdType,webrtc::scoped_refptr<webrtc::PeerConnectionInterface>> m_consumers;
+	// Written from the socket's strand and the consumers' strands, read from
+	// WebRTC's signaling thread.
+	ShardedRegistry<IdType, Consumer> m_consumers;
+
+	WarmPool<PooledPeerConnection> m_peerConnectionPool;
+	net::strand<net::io_context::executor_type> m_poolStrand;
+	net::steady_timer m_poolTimer;  // Rechecks the target once demand has aged out
+	std::atomic<uint64_t> m_peerConnectionsCreated = 0;
+
+	JoinTimeline m_joinTimeline;
 
 	std::string m_serverURL;
 	std::string m_serverPort;
 	std::string m_serverPath;
 
 	webrtc::PeerConnectionInterface::RTCConfiguration config;
+	std::chrono::milliseconds m_candidateBatchWindow{ 20 };
+
+	std::atomic<uint64_t> m_localCandidates = 0;
+	std::atomic<uint64_t> m_candidateMessages = 0;
+	std::atomic<uint64_t> m_remoteCandidates = 0;
+	std::atomic<uint64_t> m_remoteCandidatesDeferred = 0;
+	std::atomic<uint64_t> m_remoteCandidatesFailed = 0;
 
 	mutable std::atomic<int> ref_count_ = 0;
 
@@ -0,0 +1,64 @@
+// SignalingMessage.cpp
+#include "SignalingMessage.h"
+#include <array>
+#include <iostream>
+
+namespace {
+// Indexed by SignalingMessageType.
+constexpr std::array<std::string_view, static_cast<size_t>(SignalingMessageType::kUnknown)> kSignalingMessageNames = {
+    "connect",
+    "subscribe",
+    "answer",
+    "ice-candidate",
+    "consumer-disconnected",
+};
+}
+
+SignalingMessageType SignalingMessageTypeFromString(std::string_view type) {
+    for (size_t i = 0; i < kSignalingMessageNames.size(); ++i) {
+        if (kSignalingMessageNames[i] == type) {
+            return static_cast<SignalingMessageType>(i);
+        }
+    }
+    return SignalingMessageType::kUnknown;
+}
+
+const char* SignalingMessageTypeToString(SignalingMessageType type) {
+    const size_t index = static_cast<size_t>(type);
+    return index < kSignalingMessageNames.size() ? kSignalingMessageNames[index].data() : "unknown";
+}
+
+SignalingMessageParser::SignalingMessageParser(size_t arena_bytes)
+    : m_arenaBuffer(new unsigned char[arena_bytes]),
+    m_arena(m_arenaBuffer.get(), arena_bytes),
+    // Sharing the parser's storage makes taking its result a swap rather
+    // than a deep copy.
+    m_document(boost::json::storage_ptr(&m_arena)) {
+}
+
+const boost::json::object* SignalingMessageParser::Parse(std::string_view message, SignalingMessageType* type) {
+    *type = SignalingMessageType::kUnknown;
+    // The previous document lives in the arena; drop it before rewinding.
+    m_document = nullptr;
+    m_arena.release();
+    m_parser.reset(boost::json::storage_ptr(&m_arena));
+
+    boost::system::error_code ec;
+    m_parser.write(message.data(), message.size(), ec);
+    if (ec) {
+        std::cerr << "JSON parsing failed: " << ec.message() << std::endl;
+        return nullptr;
+    }
+    m_document = m_parser.release();
+
+    const boost::json::object* obj = m_document.if_object();
+    if (!obj) {
+        std::cerr << "Parsed value is not a JSON object." << std::endl;
+        return nullptr;
+    }
+    const boost::json::value* type_field = obj->if_contains("type");
+    if (type_field && type_field->is_string()) {
+        *type = SignalingMessageTypeFromString(JsonStringView(*type_field));
+    }
+    return obj;
+}
@@ -0,0 +1,50 @@
+// SignalingMessage.h
+#pragma once
+#include <boost/json.hpp>
+#include <cstddef>
+#include <memory>
+#include <string_view>
+
+// Message types of the signaling protocol, in the order of
+// kSignalingMessageNames.
+enum class SignalingMessageType {
+    kConnect,
+    kSubscribe,
+    kAnswer,
+    kIceCandidate,
+    kConsumerDisconnected,
+    kUnknown
+};
+
+// Maps the "type" field onto the enum; kUnknown for anything else.
+SignalingMessageType SignalingMessageTypeFromString(std::string_view type);
+const char* SignalingMessageTypeToString(SignalingMessageType type);
+
+// Parses signaling messages straight from the receive buffer without
+// allocating in steady state. Every document is built in one arena that is
+// rewound for the next message, and the parser's own stack is kept across
+// messages, so only a message larger than the arena touches the heap.
+// One per connection; not thread-safe.
+class SignalingMessageParser {
+public:
+    // Holds an SDP offer or answer with room to spare.
+    static constexpr size_t kDefaultArenaBytes = 64 * 1024;
+
+    explicit SignalingMessageParser(size_t arena_bytes = kDefaultArenaBytes);
+
+    // Returns the message object, or null if `message` is not a JSON
+    // object. Valid until the next Parse(); `type` is set either way.
+    const boost::json::object* Parse(std::string_view message, SignalingMessageType* type);
+
+private:
+    std::unique_ptr<unsigned char[]> m_arenaBuffer;
+    boost::json::monotonic_resource m_arena;
+    boost::json::parser m_parser;
+    boost::json::value m_document;
+};
+
+// Views a JSON string without copying it.
+inline std::string_view JsonStringView(const boost::json::value& value) {
+    const boost::json::string& str = value.as_string();
+    return std::string_view(str.data(), str.size());
+}
@@ -0,0 +1,101 @@
+// SpscRingBuffer.h
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+// Lock-free single-producer/single-consumer ring of trivially copyable
+// elements. One thread may call Write(), one other thread may call Read(),
+// Discard() and ReadAvailable(); neither ever blocks or allocates. Capacity
+// is rounded up to a power of two.
+template <typename T>
+class SpscRingBuffer {
+    static_assert(std::is_trivially_copyable_v<T>, "SpscRingBuffer holds trivially copyable elements");
+
+public:
+    explicit SpscRingBuffer(size_t min_capacity) {
+        capacity_ = 1;
+        while (capacity_ < min_capacity) {
+            capacity_ <<= 1;
+        }
+        mask_ = capacity_ - 1;
+        data_ = std::make_unique<T[]>(capacity_);
+    }
+
+    SpscRingBuffer(const SpscRingBuffer&) = delete;
+    SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+    size_t Capacity() const { return capacity_; }
+
+    // Elements ever written (producer side) or consumed (consumer side).
+    // Both count the same stream, so they can tag positions across threads.
+    size_t TotalWritten() const { return write_pos_.load(std::memory_order_relaxed); }
+    size_t TotalRead() const { return read_pos_.load(std::memory_order_relaxed); }
+
+    // Consumer side: number of elements ready to be read.
+    size_t ReadAvailable() const {
+        return write_pos_.load(std::memory_order_acquire) - read_pos_.load(std::memory_order_relaxed);
+    }
+
+    // Producer side: number of elements that fit without overwriting.
+    size_t WriteAvailable() const {
+        return capacity_ - (write_pos_.load(std::memory_order_relaxed) - read_pos_.load(std::memory_order_acquire));
+    }
+
+    // Producer: copies up to `count` elements in and returns how many fit.
+    // Passing nullptr writes value-initialized elements (silence for audio).
+    size_t Write(const T* src, size_t count) {
+        const size_t write = write_pos_.load(std::memory_order_relaxed);
+        const size_t read = read_pos_.load(std::memory_order_acquire);
+        count = std::min(count, capacity_ - (write - read));
+        const size_t offset = write & mask_;
+        const size_t first = std::min(count, capacity_ - offset);
+        CopyIn(data_.get() + offset, src, first);
+        CopyIn(data_.get(), src ? src + first : nullptr, count - first);
+        write_pos_.store(write + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer: copies up to `count` elements out and returns how many were read.
+    size_t Read(T* dst, size_t count) {
+        const size_t read = read_pos_.load(std::memory_order_relaxed);
+        const size_t write = write_pos_.load(std::memory_order_acquire);
+        count = std::min(count, write - read);
+        const size_t offset = read & mask_;
+        const size_t first = std::min(count, capacity_ - offset);
+        std::memcpy(dst, data_.get() + offset, first * sizeof(T));
+        std::memcpy(dst + first, data_.get(), (count - first) * sizeof(T));
+        read_pos_.store(read + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer: drops up to `count` of the oldest elements.
+    size_t Discard(size_t count) {
+        const size_t read = read_pos_.load(std::memory_order_relaxed);
+        const size_t write = write_pos_.load(std::memory_order_acquire);
+        count = std::min(count, write - read);
+        read_pos_.store(read + count, std::memory_order_release);
+        return count;
+    }
+
+private:
+    static void CopyIn(T* dst, const T* src, size_t count) {
+        if (src) {
+            std::memcpy(dst, src, count * sizeof(T));
+        }
+        else {
+            std::fill(dst, dst + count, T());
+        }
+    }
+
+    // Producer and consumer indices live on separate cache lines so the two
+    // threads do not false-share. Indices grow monotonically and wrap via mask_.
+    alignas(64) std::atomic<size_t> write_pos_ = 0;
+    alignas(64) std::atomic<size_t> read_pos_ = 0;
+    alignas(64) size_t capacity_ = 0;
+    size_t mask_ = 0;
+    std::unique_ptr<T[]> data_;
+};
@@ -0,0 +1,83 @@
+// SyntheticAudioCapture.cpp
+#include "SyntheticAudioCapture.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+constexpr double kTwoPi = 6.283185307179586;
+
+AudioFormat MakeFormat(const SyntheticAudioCapture::Config& config) {
+    AudioFormat format;
+    format.bits_per_sample = 16;
+    format.sample_rate = config.sample_rate;
+    format.number_of_channels = config.channels;
+    return format;
+}
+}
+
+SyntheticAudioCapture::SyntheticAudioCapture(const Config& config)
+    : PacedAudioCapture(MakeFormat(config), config.pacing), config_(config),
+    amplitude_(32767.0 * std::pow(10.0, config.level_dbfs / 20.0)),
+    rng_state_(config.seed ? config.seed : 1) {
+}
+
+double SyntheticAudioCapture::NextUniform() {
+    rng_state_ ^= rng_state_ << 13;
+    rng_state_ ^= rng_state_ >> 17;
+    rng_state_ ^= rng_state_ << 5;
+    return rng_state_ / 4294967296.0;
+}
+
+void SyntheticAudioCapture::NextSegment() {
+    talking_ = !talking_;
+    const double seconds = talking_ ? 0.4 + 1.2 * NextUniform() : 0.2 + 0.7 * NextUniform();
+    segment_left_ = static_cast<uint64_t>(seconds * config_.sample_rate);
+    // Each spurt gets its own pitch within the range of speaking voices.
+    fundamental_hz_ = 100.0 + 120.0 * NextUniform();
+    syllable_phase_ = 0.0;
+}
+
+double SyntheticAudioCapture::SpeechSample() {
+    if (segment_left_ == 0) {
+        NextSegment();
+    }
+    --segment_left_;
+    if (!talking_) {
+        return 0.0;
+    }
+    // A few harmonics of the fundamental under a syllable-rate envelope,
+    // with some breath noise; loud enough to open the silence gate and
+    // varied enough to exercise the encoder.
+    double voice = 0.0;
+    for (int harmonic = 1; harmonic <= 4; ++harmonic) {
+        voice += std::sin(kTwoPi * phase_ * harmonic) / harmonic;
+    }
+    const double envelope = 0.5 - 0.5 * std::cos(kTwoPi * syllable_phase_);
+    const double noise = 2.0 * NextUniform() - 1.0;
+    phase_ += fundamental_hz_ / config_.sample_rate;
+    phase_ -= std::floor(phase_);
+    syllable_phase_ += kSyllableRateHz / config_.sample_rate;
+    return envelope * ((1.0 - kNoiseShare) * voice / 2.1 + kNoiseShare * noise);
+}
+
+size_t SyntheticAudioCapture::Produce(int16_t* out, size_t frames) {
+    const size_t channels = config_.channels;
+    if (config_.signal == Signal::kSilence) {
+        std::fill(out, out + frames * channels, int16_t(0));
+        return frames;
+    }
+    for (size_t frame = 0; frame < frames; ++frame) {
+        double value;
+        if (config_.signal == Signal::kTone) {
+            value = std::sin(kTwoPi * phase_);
+            phase_ += config_.frequency_hz / config_.sample_rate;
+            phase_ -= std::floor(phase_);
+        }
+        else {
+            value = SpeechSample();
+        }
+        const int16_t sample = static_cast<int16_t>(std::clamp(value * amplitude_, -32768.0, 32767.0));
+        std::fill(out + frame * channels, out + (frame + 1) * channels, sample);
+    }
+    return frames;
+}
@@ -0,0 +1,50 @@
+// SyntheticAudioCapture.h
+#pragma once
+#include "AudioCaptureBackend.h"
+#include <cstdint>
+
+// Deterministic signal generator: the same config and seed give the same
+// samples on every run. It avoids <random> distributions, whose output
+// differs between standard libraries.
+class SyntheticAudioCapture : public PacedAudioCapture {
+public:
+    enum class Signal {
+        kTone,     // Steady sine at frequency_hz
+        kSpeech,   // Voiced talk spurts of 0.4-1.6 s separated by 0.2-0.9 s pauses
+        kSilence   // Digital silence
+    };
+
+    struct Config {
+        Signal signal = Signal::kTone;
+        int sample_rate = 48000;
+        size_t channels = 2;
+        double frequency_hz = 440.0;
+        double level_dbfs = -12.0;  // Peak level
+        uint32_t seed = 1;
+        Pacing pacing;
+    };
+
+    explicit SyntheticAudioCapture(const Config& config);
+
+protected:
+    size_t Produce(int16_t* out, size_t frames) override;
+
+private:
+    static constexpr double kSyllableRateHz = 4.0;
+    static constexpr double kNoiseShare = 0.1;
+
+    // xorshift32; uniform in [0, 1).
+    double NextUniform();
+    // Starts the next talk spurt or pause.
+    void NextSegment();
+    double SpeechSample();
+
+    const Config config_;
+    const double amplitude_;
+    uint32_t rng_state_;
+    double phase_ = 0.0;           // Of the tone or the voice fundamental, in cycles
+    double syllable_phase_ = 0.0;
+    bool talking_ = false;
+    uint64_t segment_left_ = 0;    // Frames left in the current spurt or pause
+    double fundamental_hz_ = 0.0;
+};
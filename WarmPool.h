@@ -0,0 +1,114 @@
+// WarmPool.h
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+// Entries made ahead of need, so a taker does not wait for one to be
+// built. The pool only stores them; the owner builds entries and Put()s
+// them whenever Size() is below Target(). The target follows demand: it
+// covers the takes expected over `refill_horizon` at the rate seen over the
+// last kRateWindow, kept within [min_size, max_size]. Thread-safe.
+template <typename Entry>
+class WarmPool {
+public:
+    using Clock = std::chrono::steady_clock;
+    static constexpr std::chrono::seconds kRateWindow{ 10 };
+
+    WarmPool(size_t min_size, size_t max_size, Clock::duration refill_horizon)
+        : m_min(std::min(min_size, max_size)), m_max(max_size), m_refillHorizon(refill_horizon) {}
+    WarmPool(const WarmPool&) = delete;
+    WarmPool& operator=(const WarmPool&) = delete;
+
+    // A max_size of zero turns the pool off.
+    void SetLimits(size_t min_size, size_t max_size) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_min = std::min(min_size, max_size);
+        m_max = max_size;
+    }
+
+    // Counts one demand and hands out the oldest entry, if one is ready.
+    std::optional<Entry> Take() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_max == 0) {
+            return std::nullopt;
+        }
+        m_demands.push_back(Clock::now());
+        if (m_ready.empty()) {
+            ++m_misses;
+            return std::nullopt;
+        }
+        ++m_hits;
+        std::optional<Entry> entry(std::move(m_ready.front()));
+        m_ready.pop_front();
+        return entry;
+    }
+
+    void Put(Entry entry) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_ready.push_back(std::move(entry));
+    }
+
+    // Removes an entry beyond Target(), newest first, for the owner to
+    // dispose of.
+    std::optional<Entry> TakeSurplus() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_ready.size() <= TargetLocked()) {
+            return std::nullopt;
+        }
+        std::optional<Entry> entry(std::move(m_ready.back()));
+        m_ready.pop_back();
+        return entry;
+    }
+
+    size_t Target() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return TargetLocked();
+    }
+
+    size_t Size() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_ready.size();
+    }
+
+    size_t MinSize() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_min;
+    }
+
+    uint64_t Hits() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_hits;
+    }
+
+    uint64_t Misses() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_misses;
+    }
+
+private:
+    size_t TargetLocked() const {
+        const Clock::time_point now = Clock::now();
+        while (!m_demands.empty() && now - m_demands.front() > kRateWindow) {
+            m_demands.pop_front();
+        }
+        const double expected = m_demands.size() * std::chrono::duration<double>(m_refillHorizon).count() /
+            std::chrono::duration<double>(kRateWindow).count();
+        return std::clamp(static_cast<size_t>(std::ceil(expected)), m_min, m_max);
+    }
+
+    mutable std::mutex m_mutex;
+    size_t m_min;
+    size_t m_max;
+    const Clock::duration m_refillHorizon;
+    std::deque<Entry> m_ready;
+    // Times of the takes within kRateWindow; trimmed as the target is read.
+    mutable std::deque<Clock::time_point> m_demands;
+    uint64_t m_hits = 0;
+    uint64_t m_misses = 0;
+};
@@ -8,200 +8,386 @@ WebSocketClient::WebSocketClient(net::io_context& ioc, std::string host, std::st
     m_port(std::move(port)),
     m_path(std::move(path)),
     m_connectionState(ConnectionState::DISCONNECTED),
-    m_MessagecurrentStatus(MessageStatus::QUEUED), 
-    m_strand(net::make_strand(ioc.get_executor()))
+    m_strand(net::make_strand(ioc.get_executor())),
+    m_resolver(m_strand),
+    m_resolveTimer(m_strand),
+    m_reconnectTimer(m_strand),
+    m_pingTimer(m_strand),
+    m_rng(std::random_device{}())
 {
 }
 
 WebSocketClient::~WebSocketClient() {
-    if (IsConnected()) {
-        Disconnect();
-    }
+    // Pending handlers hold a reference, so none are left by now; only the
+    // socket may still be open.
+    CloseSocket();
 }
 
 void WebSocketClient::Connect(MessageCallback onMessage, StateChangeCallback onStateChange) {
     // Set callbacks
     m_onMessage = std::move(onMessage);
     m_onStateChange = std::move(onStateChange);
+    m_reconnect = true;
+
+    net::post(m_strand, [self = shared_from_this()]() {
+        self->m_backoff = kInitialBackoff;
+        self->StartConnect();
+    });
+}
 
-    // Update state
+void WebSocketClient::StartConnect() {
+    if (!m_reconnect) {
+        return;
+    }
+    const uint64_t generation = ++m_generation;
+    CloseSocket();
+    m_ws = std::make_unique<Stream>(m_strand);
+    m_f_buffer.consume(m_f_buffer.size());
+    m_pingOutstanding = false;
     SetConnectionState(ConnectionState::CONNECTING);
 
-    try {
-        // Create a resolver and connect
-        tcp::resolver resolver(m_ioc);
-        // Look up the domain name
-        auto const results = resolver.resolve(m_host, m_port);
-        // Make the connection on the IP address we get from a lookup
-        m_ws = std::make_unique<websocket::stream<tcp::socket>>(m_strand);
-        net::connect(m_ws->next_layer(), results.begin(), results.end());
+    // The resolver has no timeout of its own; cancelling it completes the
+    // lookup with operation_aborted, which fails the attempt.
+    auto self = shared_from_this();
+    m_resolveTimer.expires_after(kResolveTimeout);
+    m_resolveTimer.async_wait([self, generation](beast::error_code ec) {
+        if (!ec && generation == self->m_generation) {
+            std::cerr << "WebSocket resolve timed out" << std::endl;
+            self->m_resolver.cancel();
+        }
+    });
+    m_resolver.async_resolve(m_host, m_port,
+        beast::bind_front_handler(&WebSocketClient::OnResolve, self, generation));
+}
 
-        // Set a decorator to pass the user-agent
-        m_ws->set_option(websocket::stream_base::decorator(
-            [](websocket::request_type& req) {
-                req.set(beast::http::field::user_agent, "WebRTC C++ Client");
-            }));
+void WebSocketClient::OnResolve(uint64_t generation, beast::error_code ec, tcp::resolver::results_type results) {
+    if (generation != m_generation) {
+        return;
+    }
+    m_resolveTimer.cancel();
+    if (ec) {
+        Fail("resolve", ec, generation);
+        return;
+    }
 
-        // Perform the websocket handshake
-        m_ws->handshake(m_host, m_path);
+    beast::get_lowest_layer(*m_ws).expires_after(kConnectTimeout);
+    beast::get_lowest_layer(*m_ws).async_connect(results,
+        [self = shared_from_this(), generation](beast::error_code ec, const tcp::endpoint&) {
+            self->OnConnect(generation, ec);
+        });
+}
 
-        // Update state
-        SetConnectionState(ConnectionState::CONNECTED);
-        
-        // Start reading
-        Read();
+void WebSocketClient::OnConnect(uint64_t generation, beast::error_code ec) {
+    if (generation != m_generation) {
+        return;
     }
-    catch (std::exception& e) {
-        std::cerr << "WebSocket connection error: " << e.what() << std::endl;
-        SetConnectionState(ConnectionState::CONNECTION_ERROR);
+    if (ec) {
+        Fail("connect", ec, generation);
+        return;
     }
+
+    // From here the websocket layer owns timeouts: one for the handshake,
+    // none while idle since the keepalive below covers that.
+    beast::get_lowest_layer(*m_ws).expires_never();
+    m_ws->set_option(websocket::stream_base::timeout{
+        kHandshakeTimeout, websocket::stream_base::none(), false });
+
+    // Set a decorator to pass the user-agent
+    m_ws->set_option(websocket::stream_base::decorator(
+        [](websocket::request_type& req) {
+            req.set(beast::http::field::user_agent, "WebRTC C++ Client");
+        }));
+    // Invoked on the strand from within async_read.
+    m_ws->control_callback([this](websocket::frame_type kind, beast::string_view) {
+        OnControlFrame(kind);
+    });
+
+    // Perform the websocket handshake
+    m_ws->async_handshake(m_host, m_path,
+        beast::bind_front_handler(&WebSocketClient::OnHandshake, shared_from_this(), generation));
 }
 
-void WebSocketClient::Send(const std::string& message, MessageStatusCallback onStatus) {
-    // Check if the connection is open
-    try {
-        if (!IsConnected()) {
-            if (onStatus) {
-                m_MessagecurrentStatus = MessageStatus::CANCELLED;
-                onStatus(message, m_MessagecurrentStatus);
-            }
-            return;
+void WebSocketClient::OnHandshake(uint64_t generation, beast::error_code ec) {
+    if (generation != m_generation) {
+        return;
+    }
+    if (ec) {
+        Fail("handshake", ec, generation);
+        return;
+    }
+
+    m_backoff = kInitialBackoff;
+    SetConnectionState(ConnectionState::CONNECTED);
+
+    // Start reading
+    Read(generation);
+    SchedulePing(generation, kPingInterval);
+}
+
+void WebSocketClient::Fail(const char* what, beast::error_code ec, uint64_t generation) {
+    if (generation != m_generation) {
+        return;
+    }
+    std::cerr << "WebSocket " << what << " error: " << ec.message() << std::endl;
+
+    // Orphan every handler of this attempt before tearing it down.
+    ++m_generation;
+    m_resolveTimer.cancel();
+    m_pingTimer.cancel();
+    m_resolver.cancel();
+    CloseSocket();
+    CancelQueuedMessages();
+    // The write in flight was orphaned with the rest of the attempt.
+    if (m_writing) {
+        Pending failed = std::move(m_writeBatch[m_writeIndex]);
+        m_writeBatch.clear();
+        m_writing = false;
+        if (failed.second) {
+            failed.second(*failed.first.data, MessageStatus::FAILED);
         }
+    }
 
-        // Push the message to the queue
-        {
-            std::lock_guard<std::mutex> lock(m_queueMutex);
-            m_messageQueue.push({ QueuedMessage(message), onStatus });
+    SetConnectionState(ConnectionState::CONNECTION_ERROR);
+    if (m_reconnect) {
+        ScheduleReconnect();
+    }
+}
+
+void WebSocketClient::ScheduleReconnect() {
+    // Full backoff +-20% so clients dropped together do not come back in
+    // lockstep.
+    std::uniform_real_distribution<double> jitter(0.8, 1.2);
+    const auto delay = std::chrono::milliseconds(
+        static_cast<int64_t>(m_backoff.count() * jitter(m_rng)));
+    m_backoff = std::min(m_backoff * 2, kMaxBackoff);
+    ++m_reconnects;
+
+    std::cout << "WebSocket reconnecting in " << delay.count() << " ms" << std::endl;
+    SetConnectionState(ConnectionState::RECONNECTING);
+    m_reconnectTimer.expires_after(delay);
+    m_reconnectTimer.async_wait([self = shared_from_this()](beast::error_code ec) {
+        if (!ec) {
+            self->StartConnect();
         }
+    });
+}
 
-        // Post to the strand to process the queue
-        net::post(m_strand, beast::bind_front_handler(
-            &WebSocketClient::DoSend,
-            shared_from_this()
-        ));
+void WebSocketClient::SchedulePing(uint64_t generation, std::chrono::steady_clock::duration delay) {
+    m_pingTimer.expires_after(delay);
+    m_pingTimer.async_wait([self = shared_from_this(), generation](beast::error_code ec) {
+        if (!ec && generation == self->m_generation) {
+            self->OnPingTimer(generation);
+        }
+    });
+}
+
+void WebSocketClient::OnPingTimer(uint64_t generation) {
+    if (m_pingOutstanding) {
+        Fail("keepalive", beast::error::timeout, generation);
+        return;
     }
-    catch (std::exception& e) {
-        std::cerr << "WebSocket connection error: " << e.what() << std::endl;
-        SetConnectionState(ConnectionState::CONNECTION_ERROR);
+
+    m_pingOutstanding = true;
+    m_pingSentAt = std::chrono::steady_clock::now();
+    ++m_pingsSent;
+    // Pings may overlap a pending write; beast queues control frames.
+    m_ws->async_ping({}, [self = shared_from_this(), generation](beast::error_code ec) {
+        if (ec) {
+            self->Fail("ping", ec, generation);
+        }
+    });
+    SchedulePing(generation, kPongTimeout);
+}
+
+void WebSocketClient::OnControlFrame(websocket::frame_type kind) {
+    if (kind != websocket::frame_type::pong || !m_pingOutstanding) {
+        return;
     }
+    m_pingOutstanding = false;
+    ++m_pongsReceived;
+
+    const auto now = std::chrono::steady_clock::now();
+    const double rtt = std::chrono::duration<double, std::milli>(now - m_pingSentAt).count();
+    const double smoothed = m_pongsReceived == 1 ? rtt
+        : m_smoothedRttMs + kRttSmoothing * (rtt - m_smoothedRttMs);
+    m_rttMs = rtt;
+    m_smoothedRttMs = smoothed;
+
+    // Replaces the pong deadline.
+    SchedulePing(m_generation, kPingInterval);
 }
 
-void WebSocketClient::DoSend() {
-    std::shared_ptr<std::string> message_data;
-    MessageStatusCallback statusCallback;
-    bool should_send = false;
+void WebSocketClient::CloseSocket() {
+    if (m_ws) {
+        beast::error_code ignored;
+        beast::get_lowest_layer(*m_ws).socket().close(ignored);
+    }
+}
 
+void WebSocketClient::CancelQueuedMessages() {
+    std::vector<Pending> cancelled;
     {
         std::lock_guard<std::mutex> lock(m_queueMutex);
+        cancelled.swap(m_messageQueue);
+        m_sendPosted = false;
+    }
+    const size_t keep = m_writing ? m_writeIndex + 1 : 0;
+    for (size_t i = keep; i < m_writeBatch.size(); ++i) {
+        cancelled.push_back(std::move(m_writeBatch[i]));
+    }
+    m_writeBatch.resize(keep);
 
-        // Check if already sending or no messages to send
-        if (m_MessagecurrentStatus == MessageStatus::SENDING || m_messageQueue.empty()) {
-            return;
+    for (auto& msg : cancelled) {
+        if (msg.second) {
+            msg.second(*msg.first.data, MessageStatus::CANCELLED);
         }
+    }
+}
 
-        // Get the message from the queue but don't remove it yet
-        auto& currentMsg = m_messageQueue.front();
-        message_data = currentMsg.first.data;
-        statusCallback = currentMsg.second;
-
-        // Update message status
-        m_MessagecurrentStatus = MessageStatus::SENDING;
-        currentMsg.first.status = m_MessagecurrentStatus;
-        should_send = true;
+void WebSocketClient::Send(std::string message, MessageStatusCallback onStatus) {
+    Send(std::make_shared<const std::string>(std::move(message)), std::move(onStatus));
+}
 
-        // Call callback while still in the lock if needed
-        if (statusCallback) {
-            statusCallback(*message_data, m_MessagecurrentStatus);
+void WebSocketClient::Send(std::shared_ptr<const std::string> message, MessageStatusCallback onStatus) {
+    // Check if the connection is open
+    if (!IsConnected()) {
+        if (onStatus) {
+            onStatus(*message, MessageStatus::CANCELLED);
         }
+        return;
     }
 
-    if (should_send) {
-        auto self = shared_from_this();
-        m_ws->async_write(
-            net::buffer(*message_data),
-            beast::bind_front_handler(
-                [this, self, message_data](beast::error_code ec, std::size_t bytes_transferred) {
-                    // Capture the shared_ptr to keep the data alive until the callback executes
-                    this->OnWrite(ec, bytes_transferred);
-                }
-            )
-        );
+    bool post = false;
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_messageQueue.emplace_back(QueuedMessage(std::move(message)), std::move(onStatus));
+        post = !m_sendPosted;
+        m_sendPosted = true;
+    }
+
+    // Post to the strand to process the queue
+    if (post) {
+        net::post(m_strand, beast::bind_front_handler(
+            &WebSocketClient::DoSend,
+            shared_from_this()
+        ));
     }
 }
 
-void WebSocketClient::OnWrite(beast::error_code ec, std::size_t bytes_transferred) {
-    // Get the message and its callback
-    std::pair<QueuedMessage, MessageStatusCallback> currentMsg;
+void WebSocketClient::DoSend() {
+    // The running batch calls back in here when it is done.
+    if (m_writing) {
+        return;
+    }
+    // Messages queued just before a connection loss must not leak into
+    // the next connection.
+    if (!IsConnected() || !m_ws) {
+        CancelQueuedMessages();
+        return;
+    }
+
     {
         std::lock_guard<std::mutex> lock(m_queueMutex);
-        if (!m_messageQueue.empty()) {
-            currentMsg = m_messageQueue.front();
-            m_messageQueue.pop();
-        }
+        m_sendPosted = false;
+        m_writeBatch.swap(m_messageQueue);
+    }
+    if (m_writeBatch.empty()) {
+        return;
     }
 
-    if (ec) {
-        std::cerr << "Write error: " << ec.message() << std::endl;
-
-        // Update message status
-        if (currentMsg.second) {
-            m_MessagecurrentStatus = MessageStatus::FAILED;
-            currentMsg.first.status = m_MessagecurrentStatus;
-            currentMsg.second(*currentMsg.first.data, m_MessagecurrentStatus);
+    m_writing = true;
+    m_writeIndex = 0;
+    ++m_writeBatches;
+    if (m_writeBatch.size() > m_largestBatch) {
+        m_largestBatch = m_writeBatch.size();
+    }
+    for (auto& msg : m_writeBatch) {
+        msg.first.status = MessageStatus::SENDING;
+        if (msg.second) {
+            msg.second(*msg.first.data, MessageStatus::SENDING);
         }
+    }
+    WriteNext();
+}
+
+void WebSocketClient::WriteNext() {
+    // Capture the shared_ptr to keep the data alive until the callback
+    // executes, even if a failure clears the batch first.
+    auto message_data = m_writeBatch[m_writeIndex].first.data;
+    const uint64_t generation = m_generation;
+    m_ws->async_write(
+        net::buffer(*message_data),
+        [self = shared_from_this(), message_data, generation](beast::error_code ec, std::size_t bytes_transferred) {
+            // A failed attempt has already settled the batch.
+            if (generation == self->m_generation) {
+                self->OnWrite(ec, bytes_transferred);
+            }
+        });
+}
 
-        SetConnectionState(ConnectionState::CONNECTION_ERROR);
+void WebSocketClient::OnWrite(beast::error_code ec, std::size_t bytes_transferred) {
+    if (ec) {
+        Fail("write", ec, m_generation);
         return;
     }
 
-    std::cout << "Message sent successfully: " << bytes_transferred << std::endl;
+    Pending& current = m_writeBatch[m_writeIndex];
+    current.first.status = MessageStatus::SENT;
+    ++m_messagesSent;
+    if (current.second) {
+        current.second(*current.first.data, MessageStatus::SENT);
+    }
 
-    // Update message status
-    if (currentMsg.second) {
-        m_MessagecurrentStatus = MessageStatus::SENT;
-        currentMsg.first.status = m_MessagecurrentStatus;
-        currentMsg.second(*currentMsg.first.data, m_MessagecurrentStatus);
+    if (++m_writeIndex < m_writeBatch.size()) {
+        WriteNext();
+        return;
     }
+    m_writeBatch.clear();
+    m_writing = false;
 
     // Check if there are more messages to send
-    
     DoSend();
 }
 
 void WebSocketClient::Disconnect() {
-    // Check if the connection is open
-    if (m_connectionState != ConnectionState::CONNECTED || !m_ws) {
-        return;
-    }
-
-    // Update state
-    SetConnectionState(ConnectionState::CLOSING);
-
-    // Cancel all pending messages
-    {
-        std::lock_guard<std::mutex> lock(m_queueMutex);
-        while (!m_messageQueue.empty()) {
-            auto& msg = m_messageQueue.front();
-            if (msg.second) {
-                m_MessagecurrentStatus = MessageStatus::CANCELLED;
-                msg.second(*msg.first.data, MessageStatus::CANCELLED);
-            }
-            m_messageQueue.pop();
-        }
-    }
+    // Stops any reconnect from here on, whatever state the attempt is in.
+    m_reconnect = false;
 
     // Post the disconnect operation to the strand
     net::post(m_strand, [self = shared_from_this()]() {
+        self->m_resolveTimer.cancel();
+        self->m_reconnectTimer.cancel();
+        self->m_pingTimer.cancel();
+        self->m_resolver.cancel();
+
+        // Cancel all pending messages
+        self->CancelQueuedMessages();
+
+        if (self->m_connectionState != ConnectionState::CONNECTED || !self->m_ws) {
+            // Mid-attempt or backing off: drop it without a close handshake.
+            ++self->m_generation;
+            self->CloseSocket();
+            self->SetConnectionState(ConnectionState::DISCONNECTED);
+            return;
+        }
+
+        // Update state
+        self->SetConnectionState(ConnectionState::CLOSING);
+        const uint64_t generation = self->m_generation;
         self->m_ws->async_close(websocket::close_code::normal,
-            [self](beast::error_code ec) {
+            [self, generation](beast::error_code ec) {
+                if (generation != self->m_generation) {
+                    return;
+                }
+                ++self->m_generation;
                 if (ec) {
                     std::cerr << "Close error: " << ec.message() << std::endl;
-                    self->SetConnectionState(ConnectionState::CONNECTION_ERROR);
+                    self->CloseSocket();
                 }
                 else {
-                    self->SetConnectionState(ConnectionState::DISCONNECTED);
                     std::cout << "Connection closed successfully" << std::endl;
                 }
+                self->SetConnectionState(ConnectionState::DISCONNECTED);
             });
         });
 }
@@ -214,6 +400,19 @@ bool WebSocketClient::IsConnected() const {
     return m_connectionState == ConnectionState::CONNECTED;
 }
 
+WebSocketClient::Stats WebSocketClient::GetStats() const {
+    Stats stats;
+    stats.rtt_ms = m_rttMs;
+    stats.smoothed_rtt_ms = m_smoothedRttMs;
+    stats.pings_sent = m_pingsSent;
+    stats.pongs_received = m_pongsReceived;
+    stats.reconnects = m_reconnects;
+    stats.messages_sent = m_messagesSent;
+    stats.write_batches = m_writeBatches;
+    stats.largest_batch = m_largestBatch;
+    return stats;
+}
+
 void WebSocketClient::SetConnectionState(ConnectionState newState) {
     // Only notify if state actually changed
     if (m_connectionState != newState) {
@@ -221,39 +420,46 @@ void WebSocketClient::SetConnectionState(ConnectionState newState) {
 
         // Notify state change listener if registered
         if (m_onStateChange) {
-            m_onStateChange(m_connectionState);
+            m_onStateChange(newState);
         }
     }
 }
 
-void WebSocketClient::Read() {
+void WebSocketClient::Read(uint64_t generation) {
     // Check if the connection is open
-    if (!IsConnected() || !m_ws) {
+    if (!IsConnected() || !m_ws || generation != m_generation) {
         return;
     }
 
-    // Post the read operation to the strand
     m_ws->async_read(
         m_f_buffer,
         beast::bind_front_handler(
-            [this](beast::error_code ec, std::size_t bytes_transferred) {
+            [self = shared_from_this(), generation](beast::error_code ec, std::size_t bytes_transferred) {
+                if (generation != self->m_generation) {
+                    return;
+                }
                 if (ec) {
-                    std::cerr << "Read error: " << ec.message() << std::endl;
-                    SetConnectionState(ConnectionState::CONNECTION_ERROR);
+                    // Our own close handshake ends the read; the close
+                    // handler reports it.
+                    if (self->m_connectionState == ConnectionState::CLOSING) {
+                        return;
+                    }
+                    // A close from the server is an error too: we want to
+                    // be connected until Disconnect().
+                    self->Fail("read", ec, generation);
                     return;
                 }
 
-                std::string message = beast::buffers_to_string(m_f_buffer.data());
-                m_f_buffer.consume(m_f_buffer.size());
-
-                if (m_onMessage) {
-                    m_onMessage(message);
+                // flat_buffer keeps the frame contiguous, so it is handed
+                // on in place and the buffer's storage is reused for the next.
+                if (self->m_onMessage) {
+                    const auto data = self->m_f_buffer.cdata();
+                    self->m_onMessage(std::string_view(static_cast<const char*>(data.data()), data.size()));
                 }
+                self->m_f_buffer.consume(self->m_f_buffer.size());
 
-                if (IsConnected()) {
-                    Read();
-                }
+                self->Read(generation);
             }
         )
     );
-}
\ No newline at end of file
+}
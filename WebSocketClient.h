@@ -1,14 +1,19 @@
 // WebSocketClient.h
 #pragma once
-#include <queue>
 #include <boost/beast/core.hpp>
 #include <boost/beast/websocket.hpp>
 #include <boost/asio/strand.hpp>
 #include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <random>
 #include <string>
+#include <string_view>
 #include <mutex>
 #include <memory>
+#include <vector>
 
 namespace beast = boost::beast;
 namespace websocket = beast::websocket;
@@ -23,7 +28,20 @@ public:
         CONNECTING,       // In the process of establishing connection
         CONNECTED,        // Successfully connected
         CONNECTION_ERROR, // Failed to connect or connection lost due to error
-        CLOSING           // In the process of closing the connection
+        CLOSING,          // In the process of closing the connection
+        RECONNECTING      // Waiting out the backoff before the next attempt
+    };
+
+    // Keepalive and reconnect counters, readable from any thread.
+    struct Stats {
+        double rtt_ms = 0.0;           // Last ping/pong round trip
+        double smoothed_rtt_ms = 0.0;
+        uint64_t pings_sent = 0;
+        uint64_t pongs_received = 0;
+        uint32_t reconnects = 0;       // Attempts after the first
+        uint64_t messages_sent = 0;
+        uint64_t write_batches = 0;    // Queue drains; each writes back to back
+        uint64_t largest_batch = 0;
     };
 
     // Enum for message operation status
@@ -46,59 +64,124 @@ public:
 
     // Struct to represent a message in the queue with its status
     struct QueuedMessage {
-        std::shared_ptr<std::string> data;
+        std::shared_ptr<const std::string> data;
         MessageType type;
         MessageStatus status;
         QueuedMessage(): type(MessageType::TEXT), status(MessageStatus::QUEUED) {}
-        QueuedMessage(std::string d, MessageType t = MessageType::TEXT)
-            : data(std::make_shared<std::string>(d)), type(t), status(MessageStatus::QUEUED) {
+        QueuedMessage(std::shared_ptr<const std::string> d, MessageType t = MessageType::TEXT)
+            : data(std::move(d)), type(t), status(MessageStatus::QUEUED) {
         }
     };
 
     // Type definitions for callbacks
-    using MessageCallback = std::function<void(std::string)>;
+    // The view points into the receive buffer and is valid only during
+    // the call.
+    using MessageCallback = std::function<void(std::string_view)>;
     using StateChangeCallback = std::function<void(ConnectionState)>;
     using MessageStatusCallback = std::function<void(const std::string&, MessageStatus)>;
 
     WebSocketClient(net::io_context& ioc, std::string host, std::string port, std::string path);
     ~WebSocketClient();
 
-    // Connect with state change notification
+    // Starts connecting and returns at once; progress is reported through
+    // onStateChange on the io_context. A lost or failed connection is
+    // retried with exponential backoff until Disconnect().
     void Connect(MessageCallback onMessage, StateChangeCallback onStateChange = nullptr);
-    void Send(const std::string& message, MessageStatusCallback onStatus = nullptr);
+    // Thread-safe. The text is moved, not copied; a shared buffer can be
+    // queued on several clients without copying it at all. onStatus runs
+    // without internal locks held, so it may call Send() again.
+    void Send(std::string message, MessageStatusCallback onStatus = nullptr);
+    void Send(std::shared_ptr<const std::string> message, MessageStatusCallback onStatus = nullptr);
     void Disconnect();
 
     // Getters for current state
     ConnectionState GetConnectionState() const;
     bool IsConnected() const; // Convenience method
+    Stats GetStats() const;
 
 private:
-   
+    using Stream = websocket::stream<beast::tcp_stream>;
+
+    // Each phase of an attempt has its own deadline so a dead server
+    // cannot stall startup.
+    static constexpr std::chrono::seconds kResolveTimeout{ 5 };
+    static constexpr std::chrono::seconds kConnectTimeout{ 5 };
+    static constexpr std::chrono::seconds kHandshakeTimeout{ 5 };
+    // A ping goes out kPingInterval after the last pong; without a pong
+    // within kPongTimeout the link is declared dead, so a silent drop is
+    // noticed within kPingInterval + kPongTimeout.
+    static constexpr std::chrono::seconds kPingInterval{ 2 };
+    static constexpr std::chrono::seconds kPongTimeout{ 3 };
+    static constexpr std::chrono::milliseconds kInitialBackoff{ 500 };
+    static constexpr std::chrono::milliseconds kMaxBackoff{ 30000 };
+    static constexpr double kRttSmoothing = 0.125;
 
     net::io_context& m_ioc;
     std::string m_host;
     std::string m_port;
     std::string m_path;
 
-    ConnectionState m_connectionState;
-    MessageStatus m_MessagecurrentStatus;
+    std::atomic<ConnectionState> m_connectionState;
 
     MessageCallback m_onMessage;
     StateChangeCallback m_onStateChange;
 
     net::strand<net::io_context::executor_type> m_strand;
-    std::unique_ptr<websocket::stream<tcp::socket>> m_ws;
+    std::unique_ptr<Stream> m_ws;
     beast::flat_buffer m_f_buffer;
 
-  
-
-    
-    // Message queue with status tracking
-    std::queue<std::pair<QueuedMessage, MessageStatusCallback>> m_messageQueue;
+    // Everything below runs on m_strand. Handlers carry the generation of
+    // the attempt that started them and are ignored once it is stale.
+    tcp::resolver m_resolver;
+    net::steady_timer m_resolveTimer;
+    net::steady_timer m_reconnectTimer;
+    net::steady_timer m_pingTimer;
+    uint64_t m_generation = 0;
+    std::atomic<bool> m_reconnect = false;  // Cleared by Disconnect()
+    std::chrono::milliseconds m_backoff = kInitialBackoff;
+    std::minstd_rand m_rng;
+    bool m_pingOutstanding = false;
+    std::chrono::steady_clock::time_point m_pingSentAt;
+
+    std::atomic<double> m_rttMs = 0.0;
+    std::atomic<double> m_smoothedRttMs = 0.0;
+    std::atomic<uint64_t> m_pingsSent = 0;
+    std::atomic<uint64_t> m_pongsReceived = 0;
+    std::atomic<uint32_t> m_reconnects = 0;
+    std::atomic<uint64_t> m_messagesSent = 0;
+    std::atomic<uint64_t> m_writeBatches = 0;
+    std::atomic<uint64_t> m_largestBatch = 0;
+
+    using Pending = std::pair<QueuedMessage, MessageStatusCallback>;
+    // Send() appends under the mutex and posts DoSend() only if none is
+    // pending, so a burst costs one post. DoSend() swaps the whole queue
+    // into m_writeBatch and writes it back to back on the strand; the two
+    // vectors trade storage, so a steady flow reuses their capacity.
+    std::vector<Pending> m_messageQueue;
+    bool m_sendPosted = false;
     std::mutex m_queueMutex;
-
-    void Read();
+    std::vector<Pending> m_writeBatch;
+    size_t m_writeIndex = 0;   // Entry in flight while m_writing
+    bool m_writing = false;
+
+    void StartConnect();
+    void OnResolve(uint64_t generation, beast::error_code ec, tcp::resolver::results_type results);
+    void OnConnect(uint64_t generation, beast::error_code ec);
+    void OnHandshake(uint64_t generation, beast::error_code ec);
+    // Tears the attempt down and schedules the next one.
+    void Fail(const char* what, beast::error_code ec, uint64_t generation);
+    void ScheduleReconnect();
+    void SchedulePing(uint64_t generation, std::chrono::steady_clock::duration delay);
+    void OnPingTimer(uint64_t generation);
+    void OnControlFrame(websocket::frame_type kind);
+    void CloseSocket();
+    // Cancels everything not yet handed to the socket; the write in
+    // flight, if any, is left to complete.
+    void CancelQueuedMessages();
+
+    void Read(uint64_t generation);
     void DoSend();
+    void WriteNext();
     void OnWrite(beast::error_code ec, std::size_t bytes_transferred);
     void SetConnectionState(ConnectionState newState);
 };
@@ -111,6 +194,7 @@ inline std::string ConnectionStateToString(WebSocketClient::ConnectionState stat
     case WebSocketClient::ConnectionState::CONNECTED: return "CONNECTED";
     case WebSocketClient::ConnectionState::CONNECTION_ERROR: return "CONNECTION_ERROR";
     case WebSocketClient::ConnectionState::CLOSING: return "CLOSING";
+    case WebSocketClient::ConnectionState::RECONNECTING: return "RECONNECTING";
     default: return "UNKNOWN";
     }
 }
@@ -1,5 +1,9 @@
+#include <algorithm>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <thread>
+#include <vector>
 #include <boost/asio.hpp>
 
 #include <api/create_peerconnection_factory.h>
@@ -15,6 +19,8 @@
 #include "api/video_codecs/video_decoder_factory_template_open_h264_adapter.h"
 
 #include "SignalingClient.h"
+#include "SharedAudioEncoder.h"
+#include "CaptureClock.h"
 #include <rtc_base/thread.h>
 
 int main() {
@@ -49,7 +55,9 @@ int main() {
             worker_thread,
             signaling_thread,
             nullptr,
-            webrtc::CreateBuiltinAudioEncoderFactory(),
+            // Every peer sends the same capture; encode it once per bitrate tier.
+            rtc::scoped_refptr<webrtc::AudioEncoderFactory>(new rtc::RefCountedObject<SharedAudioEncoderFactory>(
+                webrtc::CreateBuiltinAudioEncoderFactory())),
             webrtc::CreateBuiltinAudioDecoderFactory(),
             std::move(encoder_factory),
             std::move(decoder_factory),
@@ -76,6 +84,36 @@ int main() {
 
     signaling_client->Connect();
 
+    // Log how far apart the audio and video capture-to-delivery delays are;
+    // that is the skew delivery-time stamping would have put on the wire.
+    net::steady_timer av_sync_timer(ioc);
+    std::function<void()> report_av_sync = [&]() {
+        av_sync_timer.expires_after(std::chrono::seconds(10));
+        av_sync_timer.async_wait([&](const boost::system::error_code& ec) {
+            if (ec) {
+                return;
+            }
+            const AvSyncMonitor::Stats stats = AvSyncMonitor::Instance().GetStats();
+            if (stats.audio_samples != 0 && stats.video_samples != 0) {
+                std::cout << "A/V sync: audio delay " << stats.audio_delay_ms << " ms, video delay "
+                    << stats.video_delay_ms << " ms, offset " << stats.av_offset_ms << " ms" << std::endl;
+            }
+            report_av_sync();
+        });
+    };
+    report_av_sync();
+
+    // Each consumer is set up on its own strand; with a pool, slow
+    // PeerConnection calls for one consumer neither hold up another's nor
+    // the socket's read loop.
+    const unsigned io_threads = std::clamp(std::thread::hardware_concurrency(), 2u, 8u);
+    std::vector<std::thread> io_pool;
+    for (unsigned i = 1; i < io_threads; ++i) {
+        io_pool.emplace_back([&ioc] { ioc.run(); });
+    }
     ioc.run();
+    for (std::thread& thread : io_pool) {
+        thread.join();
+    }
     return 0;
 }